@@ -0,0 +1,24 @@
+QT -= gui
+QT += core network
+
+include (../common/common.pri)
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+SOURCES += \
+        benchclient.cpp \
+        benchmark.cpp \
+        main.cpp
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
+
+HEADERS += \
+    benchclient.h \
+    benchmark.h
+
+INCLUDEPATH += \
+    $${PWD}/../common
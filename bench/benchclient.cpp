@@ -0,0 +1,296 @@
+#include "benchclient.h"
+
+#include <QCryptographicHash>
+
+#include <cmath>
+
+/**
+ * @brief BenchClient::BenchClient
+ * @param id number of client, that makes names of its files unique
+ * @param options settings of benchmark
+ * @param content shared source of file data of at least options.maxSize bytes
+ * @param parent
+ */
+BenchClient::BenchClient(int id, const BenchOptions &options, const QByteArray &content, QObject *parent)
+    : QObject(parent)
+    , id(id)
+    , options(options)
+    , content(content)
+    , random(quint64(id) * 0x9E3779B97F4A7C15ULL + 1)
+{
+    connect(&socket, &QTcpSocket::connected, this, &BenchClient::connected);
+    connect(&socket, &QTcpSocket::readyRead, this, &BenchClient::readSocket);
+    connect(&socket, &QTcpSocket::bytesWritten, this, &BenchClient::sendNextChunk);
+    // see https://stackoverflow.com/questions/35655512/compile-error-when-connecting-qtcpsocketerror-using-the-new-qt5-signal-slot
+    connect(&socket, static_cast<void (QTcpSocket::*)(QAbstractSocket::SocketError)>(&QAbstractSocket::error), this, &BenchClient::socketError);
+}
+
+/**
+ * @brief Connect to server and send requests until deadline
+ * @param deadline time of clock in milliseconds, after which no requests are started
+ * @param clock clock shared by all clients
+ */
+void BenchClient::start(qint64 deadline, const QElapsedTimer *clock)
+{
+    this->deadline = deadline;
+    this->clock = clock;
+    socket.connectToHost(options.host, quint16(options.port));
+}
+
+/**
+ * @brief Request metrics of server, they come in statsReceived signal
+ */
+void BenchClient::requestStats()
+{
+    Protocol::writeFrame(&socket, Protocol::Stats, Protocol::NoFlags, ++lastRequestId, QByteArray());
+}
+
+/**
+ * @brief Offer compression if it is enabled and start the first request
+ */
+void BenchClient::connected()
+{
+    if (options.compression) {
+        QByteArray codecs(1, char(Protocol::Zlib));
+        Protocol::writeFrame(&socket, Protocol::Hello, Protocol::NoFlags, ++lastRequestId, QByteArray(),
+                             codecs.constData(), codecs.size());
+    }
+
+    nextRequest();
+}
+
+/**
+ * @brief Start the next request chosen by read/write mix, or finish when deadline has passed
+ */
+void BenchClient::nextRequest()
+{
+    if (clock->elapsed() >= deadline) {
+        finish();
+        return;
+    }
+
+    double choice = std::uniform_real_distribution<double>(0, 1)(random);
+    if (choice < options.writeRatio || savedNames.isEmpty())
+        startSave();
+    else if (choice < options.writeRatio + options.tableRatio)
+        startTable();
+    else
+        startLoad();
+}
+
+/**
+ * @brief Size of the next saved file
+ *
+ * @details Lognormal distribution has median minSize and sigma 1, sizes are clamped to maxSize
+ *
+ * @return
+ */
+qint64 BenchClient::nextSize()
+{
+    if (options.sizeDistribution == "uniform")
+        return std::uniform_int_distribution<qint64>(options.minSize, options.maxSize)(random);
+
+    if (options.sizeDistribution == "lognormal") {
+        double size = std::lognormal_distribution<double>(std::log(double(qMax<qint64>(options.minSize, 1))), 1.0)(random);
+        return qBound<qint64>(0, qint64(size), options.maxSize);
+    }
+
+    return options.minSize;
+}
+
+/**
+ * @brief Ask server for offset of new file with unique content, as Client::startUpload does
+ */
+void BenchClient::startSave()
+{
+    operation = Save;
+    busy = true;
+    requestId = ++lastRequestId;
+    fileName = QString("bench-%1-%2").arg(id).arg(saved++).toUtf8();
+
+    // unique head keeps server from deduplicating files
+    fileData = content.left(int(nextSize()));
+    QByteArray head = fileName + "\n";
+    fileData.replace(0, qMin(head.size(), fileData.size()), head.left(fileData.size()));
+    sent = 0;
+
+    QByteArray hash = QCryptographicHash::hash(fileData, QCryptographicHash::Sha256);
+    hashPending = true;
+    latency.start();
+    Protocol::writeFrame(&socket, Protocol::HaveHash, Protocol::NoFlags, requestId, fileName,
+                         hash.constData(), hash.size());
+}
+
+/**
+ * @brief Request one of files, that were saved by this client
+ */
+void BenchClient::startLoad()
+{
+    operation = Load;
+    busy = true;
+    requestId = ++lastRequestId;
+    received = 0;
+    loadFailed = false;
+
+    QString name = savedNames.at(std::uniform_int_distribution<int>(0, savedNames.size() - 1)(random));
+    fileName = name.toUtf8();
+
+    QVector<Protocol::FileRange> ranges;
+    Protocol::FileRange range;
+    range.fileName = name;
+    ranges.append(range);
+
+    QByteArray payload = Protocol::encodeRanges(ranges);
+    latency.start();
+    Protocol::writeFrame(&socket, Protocol::Load, Protocol::NoFlags, requestId, QByteArray(),
+                         payload.constData(), payload.size());
+}
+
+/**
+ * @brief Request the whole table
+ */
+void BenchClient::startTable()
+{
+    operation = Table;
+    busy = true;
+    requestId = ++lastRequestId;
+    latency.start();
+    Protocol::writeFrame(&socket, Protocol::Table, Protocol::NoFlags, requestId, QByteArray());
+}
+
+/**
+ * @brief Send chunks of saved file while socket has room for them, as Client::sendNextUploadChunk does
+ */
+void BenchClient::sendNextChunk()
+{
+    if (!busy || operation != Save || hashPending || sent < 0)
+        return;
+
+    while (socket.bytesToWrite() < Protocol::ChunkSize) {
+        qint64 size = qMin(Protocol::ChunkSize, fileData.size() - sent);
+        bool last = sent + size >= fileData.size();
+        const char *chunk = fileData.constData() + sent;
+
+        QByteArray compressed = codec == Protocol::Zlib ? Protocol::compressPayload(chunk, size) : QByteArray();
+        quint16 flags = last ? Protocol::LastChunk : Protocol::NoFlags;
+        if (!compressed.isEmpty())
+            Protocol::writeFrame(&socket, Protocol::Save, flags | Protocol::Compressed, requestId, fileName,
+                                 compressed.constData(), compressed.size(), quint64(sent));
+        else
+            Protocol::writeFrame(&socket, Protocol::Save, flags, requestId, fileName, chunk, size, quint64(sent));
+
+        sent += size;
+        if (last) {
+            sent = -1;  // everything was sent, confirmation is awaited
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Handle answers of server
+ */
+void BenchClient::readSocket()
+{
+    forever {
+        Protocol::FrameHeader header;
+        QByteArray name;
+        QByteArray buffer;
+
+        Protocol::ReadStatus status = Protocol::readFrame(&socket, header, name, buffer);
+        if (status == Protocol::NeedMoreData)
+            return;
+        if (status == Protocol::BadFrame) {
+            qWarning("Client %d got malformed frame from server", id);
+            socket.abort();
+            return;
+        }
+
+        switch (header.opcode) {
+        case Protocol::Hello:
+            codec = buffer.isEmpty() ? quint8(Protocol::Identity) : quint8(buffer.at(0));
+            break;
+        case Protocol::Stats:
+            emit statsReceived(buffer);
+            break;
+        case Protocol::HaveHash:
+            if (!busy || header.requestId != requestId)
+                break;
+            if (header.flags & (Protocol::Found | Protocol::Failed)) {
+                complete(!(header.flags & Protocol::Failed), 0);
+            } else {
+                hashPending = false;
+                sent = qint64(header.offset);
+                sendNextChunk();
+            }
+            break;
+        case Protocol::Save:
+            if (!busy || header.requestId != requestId)
+                break;
+            if (!(header.flags & Protocol::Failed))
+                savedNames.append(QString::fromUtf8(fileName));
+            complete(!(header.flags & Protocol::Failed), fileData.size());
+            break;
+        case Protocol::Load:
+            if (!busy || header.requestId != requestId)
+                break;
+            if (header.flags & Protocol::BatchDone)
+                complete(!loadFailed, received);
+            else if (header.flags & Protocol::Failed)
+                loadFailed = true;
+            else
+                received += buffer.size();
+            break;
+        case Protocol::Table:
+            if (busy && header.requestId == requestId)
+                complete(true, buffer.size());
+            break;
+        default:
+            break;  // table deltas aren't measured
+        }
+    }
+}
+
+/**
+ * @brief Record result of request in progress and start the next one
+ * @param ok request succeeded
+ * @param bytes bytes of file data that were transferred
+ */
+void BenchClient::complete(bool ok, qint64 bytes)
+{
+    OperationStats &result = stats[operation];
+    if (ok) {
+        result.latencies.append(latency.nsecsElapsed() / 1000);
+        result.bytes += bytes;
+    } else
+        ++result.errors;
+
+    busy = false;
+    nextRequest();
+}
+
+/**
+ * @brief Report error of connection, client is finished
+ * @param socketError
+ */
+void BenchClient::socketError(QAbstractSocket::SocketError socketError)
+{
+    Q_UNUSED(socketError)
+    qWarning("Client %d: %s", id, qPrintable(socket.errorString()));
+    if (busy)
+        ++stats[operation].errors;
+    busy = false;
+    deadline = 0;
+    finish();
+}
+
+/**
+ * @brief Emit finished once
+ */
+void BenchClient::finish()
+{
+    if (!done) {
+        done = true;
+        emit finished();
+    }
+}
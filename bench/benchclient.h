@@ -0,0 +1,106 @@
+#ifndef BENCHCLIENT_H
+#define BENCHCLIENT_H
+
+#include <QObject>
+
+#include <QTcpSocket>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QVector>
+
+#include <random>
+
+#include "protocol.h"
+
+/**
+ * @brief Settings of benchmark, that are chosen at startup (see main.cpp)
+ */
+struct BenchOptions
+{
+    QString host = "localhost";     ///< host of server
+    int port = 2323;                ///< port of server
+    int clients = 8;                ///< count of simulated clients
+    int duration = 10;              ///< seconds, during which new requests are issued
+    QString sizeDistribution = "fixed"; ///< distribution of sizes of saved files: fixed, uniform or lognormal
+    qint64 minSize = 64 * 1024;     ///< size of fixed distribution, lower bound of the others
+    qint64 maxSize = 64 * 1024;     ///< upper bound of uniform and lognormal distributions
+    double writeRatio = 0.5;        ///< fraction of requests that save files
+    double tableRatio = 0.1;        ///< fraction of requests that request table, the rest loads files
+    bool compressible = false;      ///< saved files consist of text instead of random bytes
+    bool compression = false;       ///< offer compression to server
+};
+
+/**
+ * @brief Latencies of one kind of request
+ */
+struct OperationStats
+{
+    QVector<qint64> latencies;      ///< microseconds of every completed request
+    qint64 bytes = 0;               ///< bytes of files that were transferred
+    int errors = 0;                 ///< requests that failed
+};
+
+/**
+ * @brief Simulated client, that sends requests one after another as the GUI client does
+ *
+ * @details Save request is HaveHash followed by chunks and completed by server's confirmation,
+ * load request is completed by Protocol::BatchDone frame, table request by Protocol::Table frame
+ */
+class BenchClient : public QObject
+{
+    Q_OBJECT
+public:
+    enum Operation { Save, Load, Table, OperationCount };
+
+    BenchClient(int id, const BenchOptions &options, const QByteArray &content, QObject *parent = nullptr);
+
+    void start(qint64 deadline, const QElapsedTimer *clock);
+    void requestStats();
+
+    OperationStats stats[OperationCount];   ///< results of every kind of request
+
+signals:
+    void finished();
+    void statsReceived(QByteArray text);
+
+private slots:
+    void connected();
+    void readSocket();
+    void sendNextChunk();
+    void socketError(QAbstractSocket::SocketError socketError);
+
+private:
+    void nextRequest();
+    void startSave();
+    void startLoad();
+    void startTable();
+    void complete(bool ok, qint64 bytes);
+    void finish();
+    qint64 nextSize();
+
+    int id;                         ///< number of client, that makes names of its files unique
+    BenchOptions options;           ///< settings of benchmark
+    QByteArray content;             ///< shared source of file data, saved files are its prefixes with unique head
+    QTcpSocket socket;              ///< connection to server
+    std::mt19937_64 random;         ///< chooses requests and sizes
+    qint64 deadline = 0;            ///< no requests are started after this time of clock
+    const QElapsedTimer *clock = nullptr;   ///< clock shared by all clients
+    quint32 lastRequestId = 0;      ///< id of the last request that was sent to server
+    quint8 codec = Protocol::Identity;  ///< codec that server has chosen for connection
+    bool done = false;              ///< finished was emitted
+
+    Operation operation = Save;     ///< kind of request in progress
+    bool busy = false;              ///< request is in progress
+    QElapsedTimer latency;          ///< started when request was sent
+    quint32 requestId = 0;          ///< id of request in progress
+    QByteArray fileName;            ///< UTF-8 name of file that is being saved or loaded
+    QByteArray fileData;            ///< data of file that is being saved
+    qint64 sent = 0;                ///< bytes of fileData that were already sent, -1 after the last chunk
+    bool hashPending = false;       ///< server hasn't answered HaveHash yet
+    qint64 received = 0;            ///< bytes of file that were loaded
+    bool loadFailed = false;        ///< server can't send file that is being loaded
+    quint64 saved = 0;              ///< count of files saved by this client
+    QStringList savedNames;         ///< names of files saved by this client, they are loaded later
+};
+
+#endif // BENCHCLIENT_H
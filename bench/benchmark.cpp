@@ -0,0 +1,203 @@
+#include "benchmark.h"
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QTextStream>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+static const int WatchdogSlack = 30 * 1000;     ///< milliseconds after duration, when report is written without waiting for clients
+
+/**
+ * @brief Value at quantile q of sorted values
+ * @param sorted
+ * @param q
+ * @return
+ */
+static qint64 percentile(const QVector<qint64> &sorted, double q)
+{
+    if (sorted.isEmpty())
+        return 0;
+
+    int index = int(std::ceil(q * sorted.size())) - 1;
+    return sorted.at(qBound(0, index, sorted.size() - 1));
+}
+
+/**
+ * @brief Create clients with shared content of saved files
+ * @param options settings of benchmark
+ * @param outputPath file of report, empty means standard output
+ * @param parent
+ */
+Benchmark::Benchmark(const BenchOptions &options, const QString &outputPath, QObject *parent)
+    : QObject(parent)
+    , options(options)
+    , outputPath(outputPath)
+{
+    // one buffer is shared by all clients, so memory of benchmark doesn't grow with their count
+    QByteArray content(int(options.maxSize), Qt::Uninitialized);
+    std::mt19937_64 random(42);
+    if (options.compressible) {
+        static const char words[] = "2024-01-01 12:00:00.000 INFO request handled in 12 ms, status=200 bytes=4096\n";
+        for (int i = 0; i < content.size(); ++i)
+            content[i] = words[(i + int(random() % 7)) % (sizeof(words) - 1)];
+    } else {
+        for (int i = 0; i < content.size(); ++i)
+            content[i] = char(random());
+    }
+
+    for (int i = 0; i < options.clients; ++i) {
+        BenchClient *client = new BenchClient(i, options, content, this);
+        connect(client, &BenchClient::finished, this, &Benchmark::clientFinished);
+        clients.append(client);
+    }
+
+    watchdog.setSingleShot(true);
+    connect(&watchdog, &QTimer::timeout, this, [this]() { report(); });
+}
+
+/**
+ * @brief Connect all clients and start sending requests
+ */
+void Benchmark::start()
+{
+    running = clients.size();
+    clock.start();
+    watchdog.start(options.duration * 1000 + WatchdogSlack);
+    for (BenchClient *client : clients)
+        client->start(qint64(options.duration) * 1000, &clock);
+}
+
+/**
+ * @brief Request metrics of server when the last client has finished
+ */
+void Benchmark::clientFinished()
+{
+    if (--running > 0)
+        return;
+
+    elapsed = clock.elapsed();
+    if (clients.isEmpty()) {
+        report();
+        return;
+    }
+
+    BenchClient *client = clients.first();
+    connect(client, &BenchClient::statsReceived, this, &Benchmark::report);
+    client->requestStats();
+}
+
+/**
+ * @brief Report of one kind of request
+ * @param operation see BenchClient::Operation
+ * @param seconds duration of benchmark
+ * @return
+ */
+QJsonObject Benchmark::operationReport(int operation, double seconds) const
+{
+    QVector<qint64> latencies;
+    qint64 bytes = 0;
+    int errors = 0;
+    for (BenchClient *client : clients) {
+        const OperationStats &stats = client->stats[operation];
+        latencies += stats.latencies;
+        bytes += stats.bytes;
+        errors += stats.errors;
+    }
+    std::sort(latencies.begin(), latencies.end());
+
+    double mean = 0;
+    for (qint64 latency : latencies)
+        mean += double(latency);
+    if (!latencies.isEmpty())
+        mean /= latencies.size();
+
+    QJsonObject latency;
+    latency["p50"] = double(percentile(latencies, 0.5));
+    latency["p99"] = double(percentile(latencies, 0.99));
+    latency["p999"] = double(percentile(latencies, 0.999));
+    latency["max"] = double(latencies.isEmpty() ? 0 : latencies.last());
+    latency["mean"] = mean;
+
+    QJsonObject result;
+    result["count"] = latencies.size();
+    result["errors"] = errors;
+    result["ops_per_second"] = seconds > 0 ? latencies.size() / seconds : 0.0;
+    result["bytes"] = double(bytes);
+    result["mib_per_second"] = seconds > 0 ? bytes / seconds / (1024 * 1024) : 0.0;
+    result["latency_us"] = latency;
+    return result;
+}
+
+/**
+ * @brief Write report and finish benchmark
+ * @param serverStats metrics of server in Prometheus text exposition format, can be empty
+ */
+void Benchmark::report(const QByteArray &serverStats)
+{
+    if (reported)
+        return;
+    reported = true;
+    watchdog.stop();
+
+    if (elapsed == 0)
+        elapsed = clock.elapsed();
+    double seconds = elapsed / 1000.0;
+
+    QJsonObject config;
+    config["host"] = options.host;
+    config["port"] = options.port;
+    config["clients"] = options.clients;
+    config["duration_s"] = options.duration;
+    config["size_distribution"] = options.sizeDistribution;
+    config["min_size"] = double(options.minSize);
+    config["max_size"] = double(options.maxSize);
+    config["write_ratio"] = options.writeRatio;
+    config["table_ratio"] = options.tableRatio;
+    config["compressible"] = options.compressible;
+    config["compression"] = options.compression;
+
+    QJsonObject operations;
+    operations["save"] = operationReport(BenchClient::Save, seconds);
+    operations["load"] = operationReport(BenchClient::Load, seconds);
+    operations["table"] = operationReport(BenchClient::Table, seconds);
+
+    int total = 0;
+    for (const QJsonValue &operation : operations)
+        total += operation.toObject()["count"].toInt();
+
+    // only unlabeled samples are picked up, e.g. "process_resident_memory_bytes 123"
+    QJsonObject server;
+    for (const QByteArray &line : serverStats.split('\n')) {
+        if (line.isEmpty() || line.startsWith('#') || line.contains('{'))
+            continue;
+        QList<QByteArray> sample = line.split(' ');
+        if (sample.size() == 2)
+            server[QString::fromLatin1(sample[0])] = sample[1].toDouble();
+    }
+    if (server.contains("process_resident_memory_bytes"))
+        server["rss_bytes"] = server["process_resident_memory_bytes"];
+
+    QJsonObject root;
+    root["config"] = config;
+    root["elapsed_s"] = seconds;
+    root["total_ops_per_second"] = seconds > 0 ? total / seconds : 0.0;
+    root["operations"] = operations;
+    root["server"] = server;
+
+    QByteArray json = QJsonDocument(root).toJson();
+    if (outputPath.isEmpty()) {
+        QTextStream(stdout) << json;
+    } else {
+        QFile file(outputPath);
+        if (file.open(QIODevice::WriteOnly))
+            file.write(json);
+        else
+            qWarning("Can't write report to %s", qPrintable(outputPath));
+    }
+
+    emit done();
+}
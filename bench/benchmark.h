@@ -0,0 +1,47 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QObject>
+
+#include <QList>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QTimer>
+
+#include "benchclient.h"
+
+/**
+ * @brief Runs simulated clients against server and reports results as JSON
+ *
+ * @details Clients send requests until the duration has passed, then metrics of server are requested
+ * and report with throughput, latency percentiles and server RSS is written to output
+ */
+class Benchmark : public QObject
+{
+    Q_OBJECT
+public:
+    Benchmark(const BenchOptions &options, const QString &outputPath, QObject *parent = nullptr);
+
+    void start();
+
+signals:
+    void done();
+
+private slots:
+    void clientFinished();
+    void report(const QByteArray &serverStats = QByteArray());
+
+private:
+    QJsonObject operationReport(int operation, double seconds) const;
+
+    BenchOptions options;           ///< settings of benchmark
+    QString outputPath;             ///< file of report, empty means standard output
+    QList<BenchClient*> clients;    ///< simulated clients
+    int running = 0;                ///< clients that haven't finished yet
+    QElapsedTimer clock;            ///< started with benchmark
+    qint64 elapsed = 0;             ///< milliseconds until the last client has finished
+    QTimer watchdog;                ///< reports anyway if server doesn't answer
+    bool reported = false;          ///< report was written
+};
+
+#endif // BENCHMARK_H
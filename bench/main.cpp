@@ -0,0 +1,57 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+
+#include "benchmark.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Load generator for server, prints report in JSON.");
+    parser.addHelpOption();
+    QCommandLineOption hostOption("host", "Host of server.", "host", "localhost");
+    parser.addOption(hostOption);
+    QCommandLineOption portOption("port", "Port of server.", "port", "2323");
+    parser.addOption(portOption);
+    QCommandLineOption clientsOption("clients", "Count of simulated clients.", "count", "8");
+    parser.addOption(clientsOption);
+    QCommandLineOption durationOption("duration", "Seconds, during which requests are sent.", "seconds", "10");
+    parser.addOption(durationOption);
+    QCommandLineOption distributionOption("size-distribution", "Distribution of sizes of saved files: fixed, uniform or lognormal.", "name", "fixed");
+    parser.addOption(distributionOption);
+    QCommandLineOption minSizeOption("min-size", "Size of files for fixed distribution, lower bound or median for others.", "bytes", "65536");
+    parser.addOption(minSizeOption);
+    QCommandLineOption maxSizeOption("max-size", "Upper bound of sizes of files.", "bytes", "65536");
+    parser.addOption(maxSizeOption);
+    QCommandLineOption writeRatioOption("write-ratio", "Fraction of requests, that save files.", "ratio", "0.5");
+    parser.addOption(writeRatioOption);
+    QCommandLineOption tableRatioOption("table-ratio", "Fraction of requests, that request table, the rest loads files.", "ratio", "0.1");
+    parser.addOption(tableRatioOption);
+    QCommandLineOption compressibleOption("compressible", "Save text files instead of random bytes.");
+    parser.addOption(compressibleOption);
+    QCommandLineOption compressionOption("compression", "Offer compression to server.");
+    parser.addOption(compressionOption);
+    QCommandLineOption outputOption("output", "File of report, standard output by default.", "path");
+    parser.addOption(outputOption);
+    parser.process(a);
+
+    BenchOptions options;
+    options.host = parser.value(hostOption);
+    options.port = parser.value(portOption).toInt();
+    options.clients = qMax(parser.value(clientsOption).toInt(), 1);
+    options.duration = qMax(parser.value(durationOption).toInt(), 1);
+    options.sizeDistribution = parser.value(distributionOption);
+    options.minSize = qMax<qint64>(parser.value(minSizeOption).toLongLong(), 0);
+    options.maxSize = qMax(parser.value(maxSizeOption).toLongLong(), options.minSize);
+    options.writeRatio = parser.value(writeRatioOption).toDouble();
+    options.tableRatio = parser.value(tableRatioOption).toDouble();
+    options.compressible = parser.isSet(compressibleOption);
+    options.compression = parser.isSet(compressionOption);
+
+    Benchmark benchmark(options, parser.value(outputOption));
+    QObject::connect(&benchmark, &Benchmark::done, &a, &QCoreApplication::quit, Qt::QueuedConnection);
+    benchmark.start();
+
+    return a.exec();
+}
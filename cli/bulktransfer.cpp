@@ -0,0 +1,202 @@
+#include "bulktransfer.h"
+
+#include <QTextStream>
+
+static const int FilesPerBatch = 1000;  ///< names of files in one load request
+
+/**
+ * @brief BulkTransfer::BulkTransfer
+ * @param core connection to server
+ * @param command what to do
+ * @param arguments paths of files to upload or names of files to download
+ * @param dir directory of downloaded files
+ * @param verbose print debug messages
+ * @param parent
+ */
+BulkTransfer::BulkTransfer(ClientCore *core, Command command, const QStringList &arguments, const QString &dir, bool verbose, QObject *parent)
+    : QObject(parent)
+    , core(core)
+    , command(command)
+    , arguments(arguments)
+    , dir(dir)
+    , verbose(verbose)
+{
+    connect(core, &ClientCore::newDebugMessage, this, &BulkTransfer::printDebugMessage);
+    connect(core, &ClientCore::newInfoMessage, this, &BulkTransfer::printMessage);
+    connect(core, &ClientCore::newWarningMessage, this, &BulkTransfer::printMessage);
+    connect(core, &ClientCore::newCriticalMessage, this, &BulkTransfer::printMessage);
+    connect(core, &ClientCore::uploadFinished, this, &BulkTransfer::uploadFinished);
+    connect(core, &ClientCore::downloadFinished, this, &BulkTransfer::downloadFinished);
+    connect(core, &ClientCore::batchFinished, this, &BulkTransfer::batchFinished);
+    connect(core, &ClientCore::pageReceived, this, &BulkTransfer::pageReceived);
+    connect(core, &ClientCore::statsReceived, this, &BulkTransfer::statsReceived);
+    connect(core, &ClientCore::disconnected, this, &BulkTransfer::disconnected);
+}
+
+/**
+ * @brief Set filters and order of files for List command
+ * @param listQuery
+ * @param maxRows count of files to list, 0 lists all of them
+ */
+void BulkTransfer::setQuery(const Protocol::Query &listQuery, quint32 maxRows)
+{
+    query = listQuery;
+    this->maxRows = maxRows;
+}
+
+/**
+ * @brief Send all requests of command
+ */
+void BulkTransfer::start()
+{
+    switch (command) {
+    case Upload:
+        total = arguments.size();
+        core->upload(arguments);
+        break;
+    case Download:
+        total = arguments.size();
+        for (int i = 0; i < arguments.size(); i += FilesPerBatch)
+            core->download(arguments.mid(i, FilesPerBatch), dir);
+        break;
+    case List:
+        query.limit = maxRows > 0 ? qMin(maxRows, Protocol::MaxQueryRows) : Protocol::MaxQueryRows;
+        core->query(query);
+        return;
+    case Stats:
+        core->requestStats();
+        return;
+    }
+
+    finishIfDone();
+}
+
+/**
+ * @brief Count saved file
+ * @param filePath
+ * @param ok
+ */
+void BulkTransfer::uploadFinished(const QString &filePath, bool ok)
+{
+    if (ok) {
+        ++done;
+        printDebugMessage(QString("Saved %1").arg(filePath));
+    } else {
+        ++failed;
+        printMessage(QString("Failed to save %1").arg(filePath));
+    }
+    finishIfDone();
+}
+
+/**
+ * @brief Count loaded file
+ * @param filePath
+ * @param ok
+ */
+void BulkTransfer::downloadFinished(const QString &filePath, bool ok)
+{
+    if (ok) {
+        ++done;
+        printDebugMessage(QString("Loaded %1").arg(filePath));
+    }
+}
+
+/**
+ * @brief Report files of batch, that weren't loaded
+ * @param requestId
+ * @param failedFiles names of files, that weren't loaded
+ */
+void BulkTransfer::batchFinished(quint32 requestId, const QStringList &failedFiles)
+{
+    Q_UNUSED(requestId)
+    for (const QString &fileName : failedFiles)
+        printMessage(QString("Failed to load %1").arg(fileName));
+
+    failed += failedFiles.size();
+    finishIfDone();
+}
+
+/**
+ * @brief Print page of table, one file per line: date/time, name and link separated by tabs,
+ * and request the next page until all files are listed
+ * @param requestId
+ * @param rows
+ * @param cursor cursor of page, empty if there are no more rows
+ */
+void BulkTransfer::pageReceived(quint32 requestId, const QVector<Protocol::TableRow> &rows, const QByteArray &cursor)
+{
+    Q_UNUSED(requestId)
+    if (command != List)
+        return;
+
+    QTextStream out(stdout);
+    for (const Protocol::TableRow &row : rows)
+        out << row.dateTime << '\t' << row.fileName << '\t' << row.link << '\n';
+    out.flush();
+    listed += quint32(rows.size());
+
+    if (cursor.isEmpty() || (maxRows > 0 && listed >= maxRows)) {
+        emit finished(EXIT_SUCCESS);
+        return;
+    }
+
+    query.cursor = cursor;
+    if (maxRows > 0)
+        query.limit = qMin(maxRows - listed, Protocol::MaxQueryRows);
+    core->query(query);
+}
+
+/**
+ * @brief Print metrics of server
+ * @param text
+ */
+void BulkTransfer::statsReceived(const QByteArray &text)
+{
+    if (command != Stats)
+        return;
+
+    QTextStream(stdout) << text;
+    emit finished(EXIT_SUCCESS);
+}
+
+/**
+ * @brief Connection was lost, command can't be completed
+ */
+void BulkTransfer::disconnected()
+{
+    printMessage(QString("Connection was lost, %1 of %2 file(s) were transferred").arg(done).arg(total));
+    emit finished(EXIT_FAILURE);
+}
+
+/**
+ * @brief Finish when nothing is pending
+ */
+void BulkTransfer::finishIfDone()
+{
+    if (command == Upload && core->pendingUploads() > 0)
+        return;
+    if (command == Download && core->pendingDownloads() > 0)
+        return;
+
+    printDebugMessage(QString("%1 of %2 file(s) were transferred").arg(done).arg(total));
+    emit finished(failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+
+/**
+ * @brief Print debug message to stderr in verbose mode
+ * @param str
+ */
+void BulkTransfer::printDebugMessage(const QString &str)
+{
+    if (verbose)
+        printMessage(str);
+}
+
+/**
+ * @brief Print message to stderr, so stdout has only results
+ * @param str
+ */
+void BulkTransfer::printMessage(const QString &str)
+{
+    QTextStream(stderr) << str << '\n';
+}
@@ -0,0 +1,57 @@
+#ifndef BULKTRANSFER_H
+#define BULKTRANSFER_H
+
+#include <QObject>
+
+#include <QStringList>
+
+#include "clientcore.h"
+
+/**
+ * @brief One command of command-line client, that is run over one connection
+ *
+ * @details All files are handed to ClientCore at once, so requests are pipelined
+ * instead of waiting for every round trip
+ */
+class BulkTransfer : public QObject
+{
+    Q_OBJECT
+public:
+    enum Command { Upload, Download, List, Stats };
+
+    BulkTransfer(ClientCore *core, Command command, const QStringList &arguments, const QString &dir, bool verbose, QObject *parent = nullptr);
+
+    void setQuery(const Protocol::Query &listQuery, quint32 maxRows);
+    void start();
+
+signals:
+    void finished(int exitCode);
+
+private slots:
+    void uploadFinished(const QString &filePath, bool ok);
+    void downloadFinished(const QString &filePath, bool ok);
+    void batchFinished(quint32 requestId, const QStringList &failed);
+    void pageReceived(quint32 requestId, const QVector<Protocol::TableRow> &rows, const QByteArray &cursor);
+    void statsReceived(const QByteArray &text);
+    void disconnected();
+
+    void printDebugMessage(const QString &str);
+    void printMessage(const QString &str);
+
+private:
+    void finishIfDone();
+
+    ClientCore *core;           ///< connection to server
+    Command command;            ///< what to do
+    QStringList arguments;      ///< paths of files to upload or names of files to download
+    QString dir;                ///< directory of downloaded files
+    bool verbose;               ///< print debug messages
+    Protocol::Query query;      ///< filters and order of listed files
+    quint32 maxRows = 0;        ///< count of listed files, 0 lists all of them
+    quint32 listed = 0;         ///< count of files that were listed
+    int total = 0;              ///< count of files to transfer
+    int done = 0;               ///< count of files that were transferred
+    int failed = 0;             ///< count of files that weren't transferred
+};
+
+#endif // BULKTRANSFER_H
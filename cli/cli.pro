@@ -0,0 +1,23 @@
+QT -= gui
+QT += core network
+
+include (../common/common.pri)
+include (../common/clientcore.pri)
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+SOURCES += \
+        bulktransfer.cpp \
+        main.cpp
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
+
+HEADERS += \
+    bulktransfer.h
+
+INCLUDEPATH += \
+    $${PWD}/../common
@@ -0,0 +1,126 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDirIterator>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+
+#include "clientcore.h"
+#include "bulktransfer.h"
+
+/**
+ * @brief Expand directories into files under them
+ * @param paths
+ * @return
+ */
+static QStringList expandPaths(const QStringList &paths)
+{
+    QStringList files;
+    for (const QString &path : paths) {
+        if (QFileInfo(path).isDir()) {
+            QDirIterator it(path, QDir::Files, QDirIterator::Subdirectories);
+            while (it.hasNext())
+                files.append(it.next());
+        } else
+            files.append(path);
+    }
+    return files;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Command-line client, that saves files on server and loads them over one connection.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("command", "upload, download, list or stats.");
+    parser.addPositionalArgument("files", "Paths of files or directories to upload, names of files to download.", "[files...]");
+    QCommandLineOption hostOption("host", "Host of server.", "host", "localhost");
+    parser.addOption(hostOption);
+    QCommandLineOption portOption("port", "Port of server.", "port", "2323");
+    parser.addOption(portOption);
+    QCommandLineOption dirOption("dir", "Directory for downloaded files.", "path", ".");
+    parser.addOption(dirOption);
+    QCommandLineOption listOption("from", "Read paths or names of files from this file, one per line.", "path");
+    parser.addOption(listOption);
+    QCommandLineOption verboseOption("verbose", "Print every transferred file.");
+    parser.addOption(verboseOption);
+    QCommandLineOption prefixOption("prefix", "List only files, which names start with prefix.", "prefix");
+    parser.addOption(prefixOption);
+    QCommandLineOption containsOption("contains", "List only files, which names contain text, case-insensitive.", "text");
+    parser.addOption(containsOption);
+    QCommandLineOption sinceOption("since", "List only files saved at or after this date/time (ISO 8601).", "datetime");
+    parser.addOption(sinceOption);
+    QCommandLineOption untilOption("until", "List only files saved before this date/time (ISO 8601).", "datetime");
+    parser.addOption(untilOption);
+    QCommandLineOption sortOption("sort", "Order of listed files: saved (order of the first save), newest or name.", "order", "saved");
+    parser.addOption(sortOption);
+    QCommandLineOption limitOption("limit", "List at most this count of files, 0 lists all of them.", "count", "0");
+    parser.addOption(limitOption);
+    QCommandLineOption parallelOption("parallel", "Upload files of 64 MiB and more in parts over this count of connections, 1 sends them over one connection.", "count", "4");
+    parser.addOption(parallelOption);
+    parser.process(a);
+
+    QStringList arguments = parser.positionalArguments();
+    if (arguments.isEmpty())
+        parser.showHelp(EXIT_FAILURE);
+
+    QString name = arguments.takeFirst();
+    BulkTransfer::Command command;
+    if (name == "upload")
+        command = BulkTransfer::Upload;
+    else if (name == "download")
+        command = BulkTransfer::Download;
+    else if (name == "list")
+        command = BulkTransfer::List;
+    else if (name == "stats")
+        command = BulkTransfer::Stats;
+    else
+        parser.showHelp(EXIT_FAILURE);
+
+    if (parser.isSet(listOption)) {
+        QFile list(parser.value(listOption));
+        if (!list.open(QIODevice::ReadOnly | QIODevice::Text)) {
+            QTextStream(stderr) << "Can't read " << list.fileName() << '\n';
+            return EXIT_FAILURE;
+        }
+        QTextStream in(&list);
+        in.setCodec("UTF-8");
+        while (!in.atEnd()) {
+            QString line = in.readLine();
+            if (!line.isEmpty())
+                arguments.append(line);
+        }
+    }
+    if (command == BulkTransfer::Upload)
+        arguments = expandPaths(arguments);
+
+    Protocol::Query query;
+    query.prefix = parser.value(prefixOption);
+    query.substring = parser.value(containsOption);
+    if (parser.isSet(sinceOption))
+        query.from = QDateTime::fromString(parser.value(sinceOption), Qt::ISODate).toMSecsSinceEpoch();
+    if (parser.isSet(untilOption))
+        query.to = QDateTime::fromString(parser.value(untilOption), Qt::ISODate).toMSecsSinceEpoch();
+    QString sort = parser.value(sortOption);
+    if (sort == "newest")
+        query.order = Protocol::NewestFirst;
+    else if (sort == "name")
+        query.order = Protocol::NameOrder;
+    else if (sort != "saved")
+        parser.showHelp(EXIT_FAILURE);
+
+    ClientCore core;
+    core.setParallelUploads(parser.value(parallelOption).toInt());
+    BulkTransfer transfer(&core, command, arguments, parser.value(dirOption), parser.isSet(verboseOption));
+    transfer.setQuery(query, parser.value(limitOption).toUInt());
+    QObject::connect(&transfer, &BulkTransfer::finished, &a, &QCoreApplication::exit, Qt::QueuedConnection);
+
+    if (!core.connectToServer(parser.value(hostOption), parser.value(portOption).toInt()))
+        return EXIT_FAILURE;
+
+    transfer.start();
+    return a.exec();
+}
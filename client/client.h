@@ -1,60 +1,70 @@
-#ifndef CLIENT_H
-#define CLIENT_H
-
-#include <QMainWindow>
-
-#include <QTcpSocket>
-
-QT_BEGIN_NAMESPACE
-namespace Ui { class Client; }
-QT_END_NAMESPACE
-
-/**
- * @brief Client with GUI
- */
-class Client : public QMainWindow
-{
-    Q_OBJECT
-
-public:
-    Client(const QString &, int, QWidget *parent = nullptr);
-    ~Client();
-
-signals:
-    void newDebugMessage(QString);
-    void newInfoMessage(QString);
-    void newWarningMessage(QString);
-    void newCriticalMessage(QString);
-
-private slots:
-    void on_saveButton_clicked();
-    void on_connectButton_clicked();
-    void on_loadButton_clicked();
-
-    void readSocket();
-    void discardSocket();
-    void displayError(QAbstractSocket::SocketError socketError);
-
-    void requestTable();
-    void updateTable(QString);
-    void insertRowInTable(QString dateTime, QString fileName, QString link);
-    void on_tableWidget_cellDoubleClicked(int row, int column);
-    QString getFileNamesOfSelectedTableRows();
-
-    void loadFiles(QString header, QByteArray &buffer);
-
-    void displayDebugMessage(const QString& str);
-    void displayInfoMessage(const QString& str);
-    void displayWarningMessage(const QString& str);
-    void displayCriticalMessage(const QString& str);
-
-private:
-    Ui::Client *ui;
-
-    QTcpSocket *socket = nullptr;   ///< socket is needed to communicate with server
-    QString saveDir;                ///< The last save dir. The default value is Documents directory
-    QString loadDir;                ///< The last load dir. The default value is Documents directory
-    QString host;                   ///< make a connection to host (any protocol) on the given port
-    int port;                       ///< number that identifies connection
-};
-#endif // CLIENT_H
+#ifndef CLIENT_H
+#define CLIENT_H
+
+#include <QMainWindow>
+
+#include <QStringList>
+
+#include "clientcore.h"
+#include "filetablemodel.h"
+
+QT_BEGIN_NAMESPACE
+namespace Ui { class Client; }
+QT_END_NAMESPACE
+
+/**
+ * @brief Client with GUI
+ */
+class Client : public QMainWindow
+{
+    Q_OBJECT
+
+public:
+    Client(const QString &, int, QWidget *parent = nullptr);
+    ~Client();
+
+signals:
+    void newDebugMessage(QString);
+    void newInfoMessage(QString);
+    void newWarningMessage(QString);
+    void newCriticalMessage(QString);
+
+private slots:
+    void on_saveButton_clicked();
+    void on_connectButton_clicked();
+    void on_loadButton_clicked();
+
+    void discardSocket();
+
+    void updateTable(const QVector<Protocol::TableRow> &rows);
+    void appendRowsToTable(const QVector<Protocol::TableRow> &rows);
+    void requestFirstPage();
+    void requestNextPage(const QByteArray &cursor);
+    void receivePage(quint32 requestId, const QVector<Protocol::TableRow> &rows, const QByteArray &cursor);
+    void on_filterEdit_textChanged(const QString &text);
+    void on_tableView_doubleClicked(const QModelIndex &index);
+    QStringList getFileNamesOfSelectedTableRows();
+
+    void batchFinished(quint32 requestId, const QStringList &failed);
+
+    void displayDebugMessage(const QString& str);
+    void displayInfoMessage(const QString& str);
+    void displayWarningMessage(const QString& str);
+    void displayCriticalMessage(const QString& str);
+
+private:
+    QVector<Protocol::TableRow> filtered(const QVector<Protocol::TableRow> &rows) const;
+
+    Ui::Client *ui;
+
+    ClientCore *core;               ///< connection to server, that does the whole networking
+    FileTableModel *tableModel;     ///< rows of tableView
+    QString filter;                 ///< only names that contain it are shown
+    quint32 pageRequestId = 0;      ///< id of the latest query of table, answers to older queries are ignored
+    bool firstPagePending = false;  ///< the latest query requests the first page, so its answer replaces rows
+    QString saveDir;                ///< The last save dir. The default value is Documents directory
+    QString loadDir;                ///< The last load dir. The default value is Documents directory
+    QString host;                   ///< make a connection to host (any protocol) on the given port
+    int port;                       ///< number that identifies connection
+};
+#endif // CLIENT_H
@@ -0,0 +1,205 @@
+#include "filetablemodel.h"
+
+/**
+ * @brief FileTableModel::FileTableModel
+ * @param parent
+ */
+FileTableModel::FileTableModel(QObject *parent)
+    : QAbstractTableModel(parent)
+{
+}
+
+/**
+ * @brief FileTableModel::rowCount
+ * @param parent
+ * @return
+ */
+int FileTableModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : rows.size();
+}
+
+/**
+ * @brief FileTableModel::columnCount
+ * @param parent
+ * @return
+ */
+int FileTableModel::columnCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+/**
+ * @brief Text of cell, it is requested by view only for visible rows
+ * @param index
+ * @param role
+ * @return
+ */
+QVariant FileTableModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= rows.size())
+        return QVariant();
+    if (role != Qt::DisplayRole && role != Qt::ToolTipRole)
+        return QVariant();
+
+    const Protocol::TableRow &row = rows.at(index.row());
+    switch (index.column()) {
+    case DateTimeColumn:
+        return row.dateTime;
+    case FileNameColumn:
+        return row.fileName;
+    case LinkColumn:
+        return row.link;
+    default:
+        return QVariant();
+    }
+}
+
+/**
+ * @brief FileTableModel::headerData
+ * @param section
+ * @param orientation
+ * @param role
+ * @return
+ */
+QVariant FileTableModel::headerData(int section, Qt::Orientation orientation, int role) const
+{
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole)
+        return QAbstractTableModel::headerData(section, orientation, role);
+
+    switch (section) {
+    case DateTimeColumn:
+        return QString("Creation's Date/Time");
+    case FileNameColumn:
+        return QString("Filename");
+    case LinkColumn:
+        return QString("Link");
+    default:
+        return QVariant();
+    }
+}
+
+/**
+ * @brief Check if server has more rows of table
+ * @param parent
+ * @return
+ */
+bool FileTableModel::canFetchMore(const QModelIndex &parent) const
+{
+    return !parent.isValid() && !cursor.isEmpty() && !fetching;
+}
+
+/**
+ * @brief Request the next page, it is appended by appendPage
+ * @param parent
+ */
+void FileTableModel::fetchMore(const QModelIndex &parent)
+{
+    if (!canFetchMore(parent))
+        return;
+
+    fetching = true;
+    emit moreRowsRequested(cursor);
+}
+
+/**
+ * @brief Replace all rows with rows of table or its first page sent by server
+ * @param newRows
+ * @param nextCursor cursor of page, empty if all rows were sent
+ */
+void FileTableModel::reset(const QVector<Protocol::TableRow> &newRows, const QByteArray &nextCursor)
+{
+    beginResetModel();
+    cursor = nextCursor;
+    fetching = false;
+    rows.clear();
+    rowOfFile.clear();
+    rows.reserve(newRows.size());
+    rowOfFile.reserve(newRows.size());
+    for (const Protocol::TableRow &row : newRows) {
+        QHash<QString, int>::const_iterator it = rowOfFile.constFind(row.fileName);
+        if (it != rowOfFile.constEnd()) {
+            rows[it.value()] = row;
+            continue;
+        }
+        rowOfFile.insert(row.fileName, rows.size());
+        rows.append(row);
+    }
+    endResetModel();
+}
+
+/**
+ * @brief Append rows that were added on server, rows of files that are already in table replace them
+ * @param newRows
+ */
+void FileTableModel::append(const QVector<Protocol::TableRow> &newRows)
+{
+    QVector<Protocol::TableRow> added;
+    for (const Protocol::TableRow &row : newRows) {
+        QHash<QString, int>::const_iterator it = rowOfFile.constFind(row.fileName);
+        if (it != rowOfFile.constEnd()) {
+            // file was saved again under the same name
+            int position = it.value();
+            if (position < rows.size()) {
+                rows[position] = row;
+                emit dataChanged(index(position, 0), index(position, ColumnCount - 1));
+            } else
+                added[position - rows.size()] = row;
+            continue;
+        }
+        rowOfFile.insert(row.fileName, rows.size() + added.size());
+        added.append(row);
+    }
+
+    if (added.isEmpty())
+        return;
+
+    beginInsertRows(QModelIndex(), rows.size(), rows.size() + added.size() - 1);
+    rows += added;
+    endInsertRows();
+}
+
+/**
+ * @brief Append the next page of table
+ * @param newRows
+ * @param nextCursor cursor of page, empty if there are no more pages
+ */
+void FileTableModel::appendPage(const QVector<Protocol::TableRow> &newRows, const QByteArray &nextCursor)
+{
+    cursor = nextCursor;
+    fetching = false;
+    append(newRows);
+}
+
+/**
+ * @brief Remove all rows
+ */
+void FileTableModel::clear()
+{
+    beginResetModel();
+    cursor.clear();
+    fetching = false;
+    rows.clear();
+    rowOfFile.clear();
+    endResetModel();
+}
+
+/**
+ * @brief FileTableModel::fileName
+ * @param row
+ * @return name of file in row
+ */
+QString FileTableModel::fileName(int row) const
+{
+    return rows.value(row).fileName;
+}
+
+/**
+ * @brief FileTableModel::link
+ * @param row
+ * @return link to file in row
+ */
+QString FileTableModel::link(int row) const
+{
+    return rows.value(row).link;
+}
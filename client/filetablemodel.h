@@ -0,0 +1,59 @@
+#ifndef FILETABLEMODEL_H
+#define FILETABLEMODEL_H
+
+#include <QAbstractTableModel>
+
+#include <QHash>
+#include <QVector>
+
+#include "protocol.h"
+
+/**
+ * @brief Table of saved files for QTableView
+ *
+ * @details Rows are kept in one contiguous vector as they were received from server, text of cells
+ * is produced only for rows that view shows. Rows that were added on server are appended
+ * with one beginInsertRows for the whole delta, row of file that was saved again is updated in place.
+ *
+ * Table may be filled page by page (see Protocol::Query): while cursor of the last page isn't empty,
+ * view asks for more rows when it is scrolled to the end, and model requests the next page by moreRowsRequested.
+ */
+class FileTableModel : public QAbstractTableModel
+{
+    Q_OBJECT
+public:
+    enum Column {
+        DateTimeColumn = 0,
+        FileNameColumn,
+        LinkColumn,
+        ColumnCount
+    };
+
+    explicit FileTableModel(QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    bool canFetchMore(const QModelIndex &parent) const override;
+    void fetchMore(const QModelIndex &parent) override;
+
+    void reset(const QVector<Protocol::TableRow> &newRows, const QByteArray &nextCursor = QByteArray());
+    void append(const QVector<Protocol::TableRow> &newRows);
+    void appendPage(const QVector<Protocol::TableRow> &newRows, const QByteArray &nextCursor);
+    void clear();
+
+    QString fileName(int row) const;
+    QString link(int row) const;
+
+signals:
+    void moreRowsRequested(const QByteArray &cursor);   ///< view needs rows of the page after cursor
+
+private:
+    QVector<Protocol::TableRow> rows;   ///< rows in order of the first save of file
+    QHash<QString, int> rowOfFile;      ///< file name -> position in rows
+    QByteArray cursor;                  ///< cursor of the last received page, empty if there are no more pages
+    bool fetching = false;              ///< the next page was requested and hasn't come yet
+};
+
+#endif // FILETABLEMODEL_H
@@ -0,0 +1,227 @@
+#include "asynclogger.h"
+
+#include <QDateTime>
+
+#include "logging_categories.h"
+
+/**
+ * @brief The only instance of logger, it is started on the first use
+ * @return
+ */
+AsyncLogger *AsyncLogger::instance()
+{
+    static AsyncLogger logger;
+    return &logger;
+}
+
+/**
+ * @brief AsyncLogger::AsyncLogger
+ */
+AsyncLogger::AsyncLogger()
+    : rateLimit(1000)
+{
+    for (int i = 0; i < Capacity; ++i)
+        ring[i].sequence.store(quint64(i));
+
+    setObjectName("AsyncLogger");
+    start(QThread::LowPriority);
+}
+
+/**
+ * @brief AsyncLogger::~AsyncLogger
+ */
+AsyncLogger::~AsyncLogger()
+{
+    stop();
+}
+
+/**
+ * @brief Put message into buffer, it is written later by logging thread
+ *
+ * @details Costs a few atomic operations and a copy of implicitly shared QString, the mutex is locked
+ * only by the message, that makes empty buffer non-empty, to wake logging thread
+ *
+ * @param type
+ * @param message
+ */
+void AsyncLogger::log(QtMsgType type, const QString &message)
+{
+    qint64 timestamp = QDateTime::currentMSecsSinceEpoch();
+
+    if (type == QtDebugMsg || type == QtInfoMsg) {
+        int limit = rateLimit.load();
+        if (limit > 0) {
+            qint64 second = timestamp / 1000;
+            qint64 current = window.load();
+            if (current != second && window.testAndSetRelaxed(current, second))
+                windowCount.store(0);
+            if (windowCount.fetchAndAddRelaxed(1) >= limit) {
+                suppressed.ref();
+                return;
+            }
+        }
+    }
+
+    // bounded multi-producer queue, see http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+    quint64 position = head.load();
+    Record *record;
+    forever {
+        record = &ring[position & (Capacity - 1)];
+        qint64 difference = qint64(record->sequence.loadAcquire()) - qint64(position);
+        if (difference == 0) {
+            if (head.testAndSetRelaxed(position, position + 1, position))
+                break;
+        } else if (difference < 0) {
+            dropped.ref();  // buffer is full
+            return;
+        } else
+            position = head.load();
+    }
+
+    record->timestamp = timestamp;
+    record->type = type;
+    record->message = message;
+    record->sequence.storeRelease(position + 1);
+
+    // record may be read before it is counted, so pending goes negative for a moment, any count up to 0 means empty buffer
+    if (pending.fetchAndAddOrdered(1) <= 0) {
+        QMutexLocker locker(&sleepMutex);
+        wakeUp.wakeOne();
+    }
+}
+
+/**
+ * @brief Change count of debug and info messages, that are written per second
+ * @param messagesPerSecond 0 means unlimited
+ */
+void AsyncLogger::setRateLimit(int messagesPerSecond)
+{
+    rateLimit.store(qMax(messagesPerSecond, 0));
+}
+
+/**
+ * @brief Write all buffered messages and stop logging thread
+ */
+void AsyncLogger::stop()
+{
+    stopping.storeRelease(1);
+    {
+        QMutexLocker locker(&sleepMutex);
+        wakeUp.wakeOne();
+    }
+    wait();
+}
+
+/**
+ * @brief Write messages until stop is called
+ */
+void AsyncLogger::run()
+{
+    forever {
+        bool stop = stopping.loadAcquire();
+        if (!drain()) {
+            flushRepeats();
+            if (stop)
+                break;
+
+            QMutexLocker locker(&sleepMutex);
+            while (pending.loadAcquire() <= 0 && !stopping.loadAcquire())
+                wakeUp.wait(&sleepMutex);
+        }
+    }
+}
+
+/**
+ * @brief Write all messages, that are in buffer now
+ * @return false if buffer was empty
+ */
+bool AsyncLogger::drain()
+{
+    bool any = false;
+    forever {
+        Record &record = ring[tail & (Capacity - 1)];
+        if (record.sequence.loadAcquire() != tail + 1)
+            break;
+
+        QString message;
+        message.swap(record.message);
+        QtMsgType type = record.type;
+        qint64 timestamp = record.timestamp;
+        record.sequence.storeRelease(tail + Capacity);
+        ++tail;
+        pending.fetchAndSubOrdered(1);
+
+        write(type, timestamp, message);
+        any = true;
+    }
+
+    int count = dropped.fetchAndStoreRelaxed(0);
+    if (count > 0)
+        write(QtWarningMsg, QDateTime::currentMSecsSinceEpoch(), QString("%1 message(s) were dropped, logging can't keep up").arg(count));
+    count = suppressed.fetchAndStoreRelaxed(0);
+    if (count > 0)
+        write(QtInfoMsg, QDateTime::currentMSecsSinceEpoch(), QString("%1 message(s) were suppressed by rate limit").arg(count));
+
+    return any;
+}
+
+/**
+ * @brief Format and write message, repeats of the same message are counted instead
+ * @param type
+ * @param timestamp
+ * @param message
+ */
+void AsyncLogger::write(QtMsgType type, qint64 timestamp, const QString &message)
+{
+    if (type == lastType && message == lastMessage) {
+        ++repeats;
+        lastTimestamp = timestamp;
+        return;
+    }
+    flushRepeats();
+
+    QString line = QString("%1 %2").arg(QDateTime::fromMSecsSinceEpoch(timestamp).toString("yyyy-MM-dd hh:mm:ss.zzz ")).arg(message);
+    switch (type) {
+    case QtDebugMsg:
+        qDebug(logDebug()).noquote() << line;
+        break;
+    case QtInfoMsg:
+        qInfo(logInfo()).noquote() << line;
+        break;
+    case QtWarningMsg:
+        qWarning(logWarning()).noquote() << line;
+        break;
+    default:
+        qCritical(logCritical()).noquote() << line;
+        break;
+    }
+
+    lastType = type;
+    lastMessage = message;
+}
+
+/**
+ * @brief Write count of repeats of the last message
+ */
+void AsyncLogger::flushRepeats()
+{
+    if (repeats == 0)
+        return;
+
+    QString line = QString("%1 last message was repeated %2 time(s)").arg(QDateTime::fromMSecsSinceEpoch(lastTimestamp).toString("yyyy-MM-dd hh:mm:ss.zzz ")).arg(repeats);
+    repeats = 0;
+    switch (lastType) {
+    case QtDebugMsg:
+        qDebug(logDebug()).noquote() << line;
+        break;
+    case QtInfoMsg:
+        qInfo(logInfo()).noquote() << line;
+        break;
+    case QtWarningMsg:
+        qWarning(logWarning()).noquote() << line;
+        break;
+    default:
+        qCritical(logCritical()).noquote() << line;
+        break;
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef ASYNCLOGGER_H
+#define ASYNCLOGGER_H
+
+#include <QThread>
+#include <QString>
+#include <QAtomicInteger>
+#include <QMutex>
+#include <QWaitCondition>
+
+/**
+ * @brief Logging backend, that formats and writes messages on its own thread
+ *
+ * @details Callers only put message with its time into lock-free ring buffer, so logging doesn't stall
+ * threads that serve sockets. Background thread formats time and writes messages through categories
+ * of logging_categories.h, it sleeps while buffer is empty and is woken by the message, that makes it non-empty.
+ * When buffer is full, messages are dropped and counted.
+ *
+ * Debug and info messages are rate-limited per second, warnings and critical messages are never limited.
+ * Identical consecutive messages are collapsed into one line with count of repeats.
+ *
+ * log can be called from any thread.
+ */
+class AsyncLogger : public QThread
+{
+public:
+    static AsyncLogger *instance();
+
+    void log(QtMsgType type, const QString &message);
+    void setRateLimit(int messagesPerSecond);
+    void stop();
+
+protected:
+    void run() override;
+
+private:
+    AsyncLogger();
+    ~AsyncLogger();
+
+    /**
+     * @brief Slot of ring buffer
+     */
+    struct Record
+    {
+        QAtomicInteger<quint64> sequence;   ///< position, that slot is ready for: pos to be written, pos + 1 to be read
+        qint64 timestamp = 0;               ///< milliseconds since epoch
+        QtMsgType type = QtDebugMsg;
+        QString message;
+    };
+
+    static const int Capacity = 8192;       ///< count of slots, power of two
+
+    bool drain();
+    void write(QtMsgType type, qint64 timestamp, const QString &message);
+    void flushRepeats();
+
+    Record ring[Capacity];
+    QAtomicInteger<quint64> head;           ///< position of the next record to write, shared by producers
+    quint64 tail = 0;                       ///< position of the next record to read, used by logging thread only
+    QAtomicInt dropped;                     ///< messages, that didn't fit into buffer
+    QAtomicInt stopping;                    ///< logging thread should drain buffer and finish
+    QAtomicInt pending;                     ///< records, that were written, but not read yet, may be briefly negative
+    QMutex sleepMutex;                      ///< guards sleep of logging thread
+    QWaitCondition wakeUp;                  ///< wakes logging thread, when buffer becomes non-empty or logger stops
+
+    QAtomicInt rateLimit;                   ///< debug and info messages per second, 0 means unlimited
+    QAtomicInteger<qint64> window;          ///< second, that is being counted
+    QAtomicInt windowCount;                 ///< messages in window
+    QAtomicInt suppressed;                  ///< messages, that were dropped by rate limit
+
+    // used by logging thread only
+    QString lastMessage;                    ///< the last written message
+    QtMsgType lastType = QtDebugMsg;        ///< type of the last written message
+    qint64 lastTimestamp = 0;               ///< time of the last repeat of the last written message
+    int repeats = 0;                        ///< repeats of the last written message, that weren't written yet
+};
+
+#endif // ASYNCLOGGER_H
@@ -0,0 +1,808 @@
+#include "clientcore.h"
+
+#include <QFileInfo>
+#include <QCryptographicHash>
+#include <QFutureWatcher>
+#include <QtConcurrent>
+
+/**
+ * @brief ClientCore::ClientCore
+ * @param parent
+ */
+ClientCore::ClientCore(QObject *parent)
+    : QObject(parent)
+{
+}
+
+/**
+ * @brief Close connection and files of transfers
+ */
+ClientCore::~ClientCore()
+{
+    if (socket) {
+        socket->disconnect(this);
+        socket->close();
+    }
+    closeUpload();
+    if (downloadFile)
+        downloadFile->close();
+}
+
+/**
+ * @brief Connect to server, offer compression and resume transfers that were interrupted by disconnect
+ * @param host
+ * @param port
+ * @param timeout milliseconds to wait for connection
+ * @return false if connection can't be established
+ */
+bool ClientCore::connectToServer(const QString &host, int port, int timeout)
+{
+    if (socket) {
+        emit newInfoMessage(QString("Already connected to server"));
+        return true;
+    }
+
+    this->host = host;
+    this->port = port;
+    socket = new QTcpSocket(this);
+    connect(socket, &QTcpSocket::readyRead, this, &ClientCore::readSocket);
+    connect(socket, &QTcpSocket::disconnected, this, &ClientCore::discardSocket);
+    connect(socket, &QTcpSocket::bytesWritten, this, &ClientCore::sendNextUploadChunk);
+    // see https://stackoverflow.com/questions/35655512/compile-error-when-connecting-qtcpsocketerror-using-the-new-qt5-signal-slot
+    connect(socket, static_cast<void (QTcpSocket::*)(QAbstractSocket::SocketError)>(&QAbstractSocket::error), this, &ClientCore::displayError);
+
+    socket->connectToHost(host, quint16(port));
+    if (!socket->waitForConnected(timeout)) {
+        emit newCriticalMessage(QString("The following error occurred: %1.").arg(socket->errorString()));
+        socket->disconnect(this);
+        socket->deleteLater();
+        socket = nullptr;
+        return false;
+    }
+
+    // offer compression, server answers before it handles the next requests
+    QByteArray codecs(1, char(Protocol::Zlib));
+    Protocol::writeFrame(socket, Protocol::Hello, Protocol::NoFlags, ++lastRequestId, QByteArray(),
+                         codecs.constData(), codecs.size());
+    emit connected();
+
+    // transfers that were interrupted by disconnect continue from where they stopped
+    startNextUpload();
+    QList<DownloadBatch> batches = downloadBatches.values();
+    downloadBatches.clear();
+    for (const DownloadBatch &batch : batches)
+        downloadBatches.insert(requestDownloads(batch), batch);
+
+    return true;
+}
+
+/**
+ * @brief Close connection, transfers in progress are resumed on the next connect
+ */
+void ClientCore::disconnectFromServer()
+{
+    if (socket)
+        socket->disconnectFromHost();
+}
+
+/**
+ * @brief ClientCore::isConnected
+ * @return
+ */
+bool ClientCore::isConnected() const
+{
+    return socket && socket->state() == QAbstractSocket::ConnectedState;
+}
+
+/**
+ * @brief Queue files to save on server, they are sent one after another (see startNextUpload)
+ * @param filePaths
+ */
+void ClientCore::upload(const QStringList &filePaths)
+{
+    uploadQueue += filePaths;
+    startNextUpload();
+}
+
+/**
+ * @brief Request files from server in one batch, next batch can be requested before the previous one is completed
+ * @param fileNames names of files in table
+ * @param dir directory, where files are stored
+ * @return id of request, it is reported by batchFinished. 0 if there is nothing to request
+ */
+quint32 ClientCore::download(const QStringList &fileNames, const QString &dir)
+{
+    if (fileNames.isEmpty())
+        return 0;
+
+    DownloadBatch batch;
+    batch.dir = dir;
+    batch.files = fileNames;
+
+    // batch without connection is requested on connect
+    quint32 requestId = isConnected() ? requestDownloads(batch) : ++lastRequestId;
+    downloadBatches.insert(requestId, batch);
+    return requestId;
+}
+
+/**
+ * @brief Request the whole table from server, it comes in tableReset
+ */
+void ClientCore::requestTable()
+{
+    if (socket) {
+        if (socket->isOpen()) {
+            tableRequested = true;
+            Protocol::writeFrame(socket, Protocol::Table, Protocol::NoFlags, ++lastRequestId, QByteArray());
+        } else
+            emit newCriticalMessage("socket doesn't seem to be opened!");
+    } else
+        emit newCriticalMessage("Not connected!");
+}
+
+/**
+ * @brief Request one page of table, it comes in pageReceived
+ *
+ * @details Answer to the first page starts tracking of deltas from its sequence number,
+ * so table can be filled page by page instead of requesting the whole table
+ *
+ * @param query filters, order and cursor of the previous page, see Protocol::Query
+ * @return id of request, 0 if it wasn't sent
+ */
+quint32 ClientCore::query(const Protocol::Query &query)
+{
+    if (!isConnected()) {
+        emit newCriticalMessage("Not connected!");
+        return 0;
+    }
+
+    QByteArray payload = Protocol::encodeQuery(query);
+    if (!Protocol::writeFrame(socket, Protocol::Query, Protocol::NoFlags, ++lastRequestId, QByteArray(), payload.constData(), payload.size()))
+        return 0;
+
+    if (query.cursor.isEmpty())
+        firstPageRequests.insert(lastRequestId);
+    return lastRequestId;
+}
+
+/**
+ * @brief Request metrics of server, they come in statsReceived
+ */
+void ClientCore::requestStats()
+{
+    if (isConnected())
+        Protocol::writeFrame(socket, Protocol::Stats, Protocol::NoFlags, ++lastRequestId, QByteArray());
+}
+
+/**
+ * @brief Send big files in parts over several connections, every part over its own one (see MultipartUpload)
+ * @param connections count of connections for one file, 1 disables uploads in parts
+ * @param minSize smaller files are sent over the main connection
+ */
+void ClientCore::setParallelUploads(int connections, qint64 minSize)
+{
+    parallelConnections = qMax(1, connections);
+    parallelMinSize = minSize;
+}
+
+/**
+ * @brief Count of files, that aren't confirmed as saved by server yet
+ * @return
+ */
+int ClientCore::pendingUploads() const
+{
+    return uploadQueue.size() + hashRequests.size() + awaitingConfirmation.size() + multipartUploads.size() + (uploadPath.isEmpty() ? 0 : 1);
+}
+
+/**
+ * @brief Count of batches, that aren't completed yet
+ * @return
+ */
+int ClientCore::pendingDownloads() const
+{
+    return downloadBatches.size();
+}
+
+/**
+ * @brief Start sending of the next file, that server has opened, and check hashes of next queued files ahead
+ *
+ * @details Before upload SHA-256 of file is computed on thread pool and sent to server (see hashComputed), if server already has such content, file is saved
+ * without sending it. Up to MaxHashRequests files are hashed and checked at once, server answers found content right away
+ * and opens uploads of the rest one after another. Answer, that opens upload, carries how many bytes of this content
+ * server has already received (see hashChecked), and file is sent chunk by chunk from there (see sendNextUploadChunk),
+ * so it is never read into memory as a whole. If server has file with the same name, only difference
+ * to it may be sent (see sendNextUploadPatch). Big files are handed over to MultipartUpload
+ * after their hash is computed.
+ */
+void ClientCore::startNextUpload()
+{
+    // server opens uploads one at a time, upload, that was opened while the previous file was sent, goes next
+    if (!uploadFile && !openedUploads.isEmpty()) {
+        QPair<Protocol::FrameHeader, QByteArray> opened = openedUploads.takeFirst();
+        openUpload(opened.first, opened.second);
+    }
+
+    while (hashRequests.size() < MaxHashRequests && !uploadQueue.isEmpty() && isConnected()) {
+        HashRequest request;
+        request.path = uploadQueue.takeFirst();
+        request.name = QFileInfo(request.path).fileName().toUtf8();
+        quint32 requestId = ++lastRequestId;
+        hashRequests.insert(requestId, request);
+
+        // file is hashed on thread pool, so big files don't block event loop
+        QString path = request.path;
+        QFutureWatcher<QByteArray> *watcher = new QFutureWatcher<QByteArray>(this);
+        connect(watcher, &QFutureWatcher<QByteArray>::finished, this, [this, watcher, requestId]() {
+            watcher->deleteLater();
+            hashComputed(requestId, watcher->result());
+        });
+        watcher->setFuture(QtConcurrent::run([path]() {
+            QFile file(path);
+            QCryptographicHash hash(QCryptographicHash::Sha256);
+            if (!file.open(QIODevice::ReadOnly) || !hash.addData(&file))
+                return QByteArray();
+            return hash.result();
+        }));
+    }
+}
+
+/**
+ * @brief Ask server if it already has content of hashed file, chunks are sent only if it hasn't
+ * @param requestId id of upload, whose file was hashed, hash of request, that was dropped by disconnect, is ignored
+ * @param digest raw SHA-256 of file, empty if file can't be read
+ */
+void ClientCore::hashComputed(quint32 requestId, const QByteArray &digest)
+{
+    QMap<quint32, HashRequest>::iterator it = hashRequests.find(requestId);
+    if (it == hashRequests.end() || !isConnected())
+        return;
+
+    QString path = it->path;
+    qint64 size = QFileInfo(path).size();
+    if (digest.isEmpty()) {
+        emit newWarningMessage(QString("Can't open file %1 to read!").arg(path));
+        hashRequests.erase(it);
+        emit uploadFinished(path, false);
+        startNextUpload();
+        return;
+    }
+
+    if (parallelConnections > 1 && size >= parallelMinSize) {
+        hashRequests.erase(it);
+        MultipartUpload *multipart = new MultipartUpload(path, digest, parallelConnections, this);
+        connect(multipart, &MultipartUpload::newDebugMessage, this, &ClientCore::newDebugMessage);
+        connect(multipart, &MultipartUpload::newWarningMessage, this, &ClientCore::newWarningMessage);
+        connect(multipart, &MultipartUpload::newCriticalMessage, this, &ClientCore::newCriticalMessage);
+        connect(multipart, &MultipartUpload::finished, this, &ClientCore::multipartFinished);
+        multipartUploads.insert(multipart);
+        multipart->start(host, port);
+        startNextUpload();
+        return;
+    }
+
+    quint16 flags = size >= DeltaSync::MinFileSize ? Protocol::Delta : Protocol::NoFlags;
+    Protocol::writeFrame(socket, Protocol::HaveHash, flags, requestId, it->name,
+                         digest.constData(), digest.size());
+}
+
+/**
+ * @brief Close file that is being sent and forget it
+ */
+void ClientCore::closeUpload()
+{
+    if (uploadFile) {
+        uploadFile->close();
+        uploadFile->deleteLater();
+        uploadFile = nullptr;
+    }
+    delete uploadEncoder;
+    uploadEncoder = nullptr;
+    uploadPath.clear();
+}
+
+/**
+ * @brief Send next chunks of uploadFile while socket has room for them.
+ *
+ * @details Every chunk is sent in Protocol::Save frame with its offset in file, the last chunk has Protocol::LastChunk flag.
+ * Chunks are compressed if server supports it and they don't look like already compressed data.
+ * Slot is called again on bytesWritten, so at most one chunk is waiting in the socket's write buffer.
+ * After the last chunk the next queued file is started right away, its confirmation comes later (see uploadSaved).
+ */
+void ClientCore::sendNextUploadChunk()
+{
+    if (!uploadFile || !socket)
+        return;
+    if (uploadEncoder) {
+        sendNextUploadPatch();
+        return;
+    }
+
+    char chunk[Protocol::ChunkSize];
+    while (socket->bytesToWrite() < Protocol::ChunkSize) {
+        qint64 position = uploadFile->pos();
+        qint64 size = uploadFile->read(chunk, Protocol::ChunkSize);
+        bool failed = size < 0;
+        if (failed) {
+            emit newCriticalMessage(QString("An error occurred while trying to read file %1!").arg(uploadFile->fileName()));
+            size = 0;
+        }
+
+        // empty file is sent as one empty chunk
+        bool last = failed || uploadFile->atEnd();
+        quint16 flags = last ? Protocol::LastChunk : Protocol::NoFlags;
+        QByteArray compressed = codec == Protocol::Zlib ? Protocol::compressPayload(chunk, size) : QByteArray();
+        if (!compressed.isEmpty())
+            Protocol::writeFrame(socket, Protocol::Save, flags | Protocol::Compressed,
+                                 uploadRequestId, uploadName, compressed.constData(), compressed.size(), quint64(position));
+        else
+            Protocol::writeFrame(socket, Protocol::Save, flags,
+                                 uploadRequestId, uploadName, chunk, size, quint64(position));
+
+        if (last) {
+            emit newDebugMessage(QString("File %1 was sent to server").arg(QString::fromUtf8(uploadName)));
+            awaitingConfirmation.insert(uploadRequestId, uploadPath);
+            closeUpload();
+            startNextUpload();
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Send next parts of difference of uploadFile to stored file while socket has room for them.
+ *
+ * @details Every part is sent in Protocol::Patch frame with its position in file, the last part has Protocol::LastChunk flag.
+ * Like chunks, parts are compressed if server supports it, and the next queued file is started right after the last part.
+ */
+void ClientCore::sendNextUploadPatch()
+{
+    while (socket->bytesToWrite() < Protocol::ChunkSize) {
+        qint64 position = uploadEncoder->position();
+        QByteArray patch = uploadEncoder->next();
+        if (uploadEncoder->hasError())
+            emit newCriticalMessage(QString("An error occurred while trying to read file %1!").arg(uploadFile->fileName()));
+
+        bool last = uploadEncoder->atEnd();
+        quint16 flags = last ? Protocol::LastChunk : Protocol::NoFlags;
+        QByteArray compressed = codec == Protocol::Zlib ? Protocol::compressPayload(patch.constData(), patch.size()) : QByteArray();
+        if (!compressed.isEmpty())
+            Protocol::writeFrame(socket, Protocol::Patch, flags | Protocol::Compressed,
+                                 uploadRequestId, uploadName, compressed.constData(), compressed.size(), quint64(position));
+        else
+            Protocol::writeFrame(socket, Protocol::Patch, flags,
+                                 uploadRequestId, uploadName, patch.constData(), patch.size(), quint64(position));
+
+        if (last) {
+            emit newDebugMessage(QString("Difference of file %1 was sent to server: %2 bytes of data, %3 bytes are taken from stored file")
+                                 .arg(QString::fromUtf8(uploadName)).arg(uploadEncoder->literalBytes()).arg(uploadEncoder->copiedBytes()));
+            awaitingConfirmation.insert(uploadRequestId, uploadPath);
+            closeUpload();
+            startNextUpload();
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Forget upload in parts and report its result
+ * @param filePath
+ * @param ok all parts were saved and server has added file into table
+ */
+void ClientCore::multipartFinished(const QString &filePath, bool ok)
+{
+    MultipartUpload *multipart = qobject_cast<MultipartUpload*>(sender());
+    multipartUploads.remove(multipart);
+    multipart->deleteLater();
+
+    if (ok)
+        emit newDebugMessage(QString("File %1 was saved on server").arg(QFileInfo(filePath).fileName()));
+    else
+        emit newWarningMessage(QString("Server failed to save file %1!").arg(QFileInfo(filePath).fileName()));
+    emit uploadFinished(filePath, ok);
+}
+
+/**
+ * @brief Finish upload if server already has content of file, otherwise open upload, that server has opened
+ *
+ * @details Server opens one upload at a time, answer, that comes while uploadFile is being sent, waits for it
+ *
+ * @param header header of Protocol::HaveHash answer
+ * @param payload signatures of stored file, if answer has Protocol::Delta flag
+ */
+void ClientCore::hashChecked(const Protocol::FrameHeader &header, const QByteArray &payload)
+{
+    QMap<quint32, HashRequest>::iterator it = hashRequests.find(header.requestId);
+    if (it == hashRequests.end())
+        return;
+
+    if (header.flags & (Protocol::Found | Protocol::Failed)) {
+        QString filePath = it->path;
+        bool found = header.flags & Protocol::Found;
+        if (found)
+            emit newDebugMessage(QString("Server already has content of file %1, it was saved without upload").arg(QString::fromUtf8(it->name)));
+        else
+            emit newWarningMessage(QString("Server can't receive file %1 right now!").arg(QString::fromUtf8(it->name)));
+        hashRequests.erase(it);
+        emit uploadFinished(filePath, found);
+        startNextUpload();
+    } else if (uploadFile)
+        openedUploads.append(qMakePair(header, payload));
+    else
+        openUpload(header, payload);
+}
+
+/**
+ * @brief Start sending of file, whose upload server has opened, from the offset, that server has already received,
+ * or as difference to stored file, if server has sent its signatures
+ * @param header header of Protocol::HaveHash answer
+ * @param payload signatures of stored file, if answer has Protocol::Delta flag
+ */
+void ClientCore::openUpload(const Protocol::FrameHeader &header, const QByteArray &payload)
+{
+    HashRequest request = hashRequests.take(header.requestId);
+    uploadPath = request.path;
+    uploadName = request.name;
+    uploadRequestId = header.requestId;
+
+    uploadFile = new QFile(uploadPath, this);
+    if (!uploadFile->open(QIODevice::ReadOnly)) {
+        // server waits for this file, empty last chunk closes its upload and is answered as failed
+        emit newWarningMessage(QString("Can't open file %1 to read!").arg(uploadPath));
+        Protocol::writeFrame(socket, Protocol::Save, Protocol::LastChunk, uploadRequestId, uploadName, nullptr, 0, header.offset);
+        awaitingConfirmation.insert(uploadRequestId, uploadPath);
+        closeUpload();
+        startNextUpload();
+        return;
+    }
+
+    DeltaSync::Signatures signatures;
+    if ((header.flags & Protocol::Delta) && header.offset == 0) {
+        // server takes plain chunks too, so malformed signatures aren't fatal
+        if (DeltaSync::decodeSignatures(payload, signatures)) {
+            uploadEncoder = new DeltaSync::Encoder(uploadFile, signatures);
+            emit newDebugMessage(QString("Server has file %1, only difference to it is sent").arg(QString::fromUtf8(uploadName)));
+        } else
+            emit newWarningMessage(QString("Got malformed signatures of file %1, it is sent as a whole").arg(QString::fromUtf8(uploadName)));
+    }
+
+    if (header.offset > 0) {
+        if (header.offset > quint64(uploadFile->size()) || !uploadFile->seek(qint64(header.offset))) {
+            emit newWarningMessage(QString("Server has more of file %1 than its size, file was changed!").arg(QString::fromUtf8(uploadName)));
+            uploadFile->seek(0);
+        } else
+            emit newDebugMessage(QString("Upload of file %1 is resumed from %2 bytes").arg(QString::fromUtf8(uploadName)).arg(header.offset));
+    }
+    sendNextUploadChunk();
+}
+
+/**
+ * @brief Finish upload when server has confirmed that file is saved
+ * @param header header of Protocol::Save answer
+ */
+void ClientCore::uploadSaved(const Protocol::FrameHeader &header)
+{
+    QString filePath = awaitingConfirmation.take(header.requestId);
+    if (filePath.isEmpty()) {
+        // upload was rejected before its last chunk was sent
+        if (header.requestId != uploadRequestId || !uploadFile)
+            return;
+        filePath = uploadPath;
+        closeUpload();
+        startNextUpload();
+    }
+
+    bool ok = !(header.flags & Protocol::Failed);
+    if (ok)
+        emit newDebugMessage(QString("File %1 of size %2 bytes was saved on server").arg(QFileInfo(filePath).fileName()).arg(header.offset));
+    else
+        emit newWarningMessage(QString("Server failed to save file %1!").arg(QFileInfo(filePath).fileName()));
+
+    emit uploadFinished(filePath, ok);
+}
+
+/**
+ * @brief Remember codec, that server has chosen for connection
+ * @param payload payload of Protocol::Hello answer
+ */
+void ClientCore::codecNegotiated(const QByteArray &payload)
+{
+    codec = payload.isEmpty() ? quint8(Protocol::Identity) : quint8(payload.at(0));
+    emit newDebugMessage(QString("Server has chosen codec %1").arg(codec));
+}
+
+/**
+ * @brief Request files of batch from server.
+ *
+ * @details Files are received into "<name>.part" files, so if such file is left by interrupted download,
+ * only the rest of file is requested. Ranges are sent in Protocol::Load frame (see Protocol::encodeRanges).
+ *
+ * @param batch
+ * @return id of request
+ */
+quint32 ClientCore::requestDownloads(const DownloadBatch &batch)
+{
+    QVector<Protocol::FileRange> ranges;
+    for (const QString &fileName : batch.files) {
+        Protocol::FileRange range;
+        range.fileName = fileName;
+        QFileInfo partial(batch.dir+"/"+fileName+".part");
+        if (partial.exists()) {
+            range.offset = partial.size();
+            emit newDebugMessage(QString("Download of file %1 is resumed from %2 bytes").arg(fileName).arg(range.offset));
+        }
+        ranges.append(range);
+    }
+
+    QByteArray payload = Protocol::encodeRanges(ranges);
+    Protocol::writeFrame(socket, Protocol::Load, Protocol::NoFlags, ++lastRequestId, QByteArray(),
+                         payload.constData(), payload.size());
+    return lastRequestId;
+}
+
+/**
+ * @brief Read all complete frames from socket
+ */
+void ClientCore::readSocket()
+{
+    // several chunks may arrive within one readyRead, so handle all complete frames
+    forever {
+        Protocol::FrameHeader header;
+        QByteArray name;
+        QByteArray buffer;
+
+        Protocol::ReadStatus status = Protocol::readFrame(socket, header, name, buffer);
+        if (status == Protocol::NeedMoreData) {
+            if (socket->bytesAvailable() > 0) {
+                QString message = QString("%1 :: Waiting for more data to come..").arg(socket->socketDescriptor());
+                emit newDebugMessage(message);
+            }
+            return;
+        } else if (status == Protocol::BadFrame) {
+            emit newWarningMessage("Got malformed frame from server!");
+            socket->abort();
+            return;
+        }
+
+        switch (header.opcode) {
+        case Protocol::Table:
+            updateTable(buffer);
+            break;
+        case Protocol::TableDelta:
+            applyTableDelta(buffer);
+            break;
+        case Protocol::Load:
+            loadFiles(header, QString::fromUtf8(name), buffer);
+            break;
+        case Protocol::HaveHash:
+            hashChecked(header, buffer);
+            break;
+        case Protocol::Save:
+            uploadSaved(header);
+            break;
+        case Protocol::Hello:
+            codecNegotiated(buffer);
+            break;
+        case Protocol::Stats:
+            emit statsReceived(buffer);
+            break;
+        case Protocol::Query:
+            queryAnswered(header, buffer);
+            break;
+        default:
+            emit newWarningMessage(QString("Got wrong opcode: %1!").arg(header.opcode));
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Forget connection, transfers that weren't completed are kept to resume them on reconnect
+ */
+void ClientCore::discardSocket()
+{
+    socket->deleteLater();
+    socket = nullptr;
+
+    // files that weren't confirmed are sent again, server resumes or deduplicates them
+    QStringList unconfirmed = awaitingConfirmation.values();
+    if (!uploadPath.isEmpty())
+        unconfirmed.append(uploadPath);
+    for (const HashRequest &request : hashRequests)
+        unconfirmed.append(request.path);
+    uploadQueue = unconfirmed + uploadQueue;
+    awaitingConfirmation.clear();
+    hashRequests.clear();
+    openedUploads.clear();
+    closeUpload();
+    codec = Protocol::Identity;
+
+    if (downloadFile) {
+        downloadFile->close();
+        downloadFile->deleteLater();
+        downloadFile = nullptr;
+    }
+
+    tableSequence = 0;
+    tableRequested = false;
+    tableTracked = false;
+    firstPageRequests.clear();
+
+    emit disconnected();
+}
+
+/**
+ * @brief ClientCore::displayError
+ * @param socketError
+ */
+void ClientCore::displayError(QAbstractSocket::SocketError socketError)
+{
+    switch (socketError) {
+        case QAbstractSocket::RemoteHostClosedError:
+        break;
+        case QAbstractSocket::HostNotFoundError:
+            emit newWarningMessage("The host was not found. Please check the host name and port settings.");
+        break;
+        case QAbstractSocket::ConnectionRefusedError:
+            emit newWarningMessage("The connection was refused by the peer. Make sure QTCPServer is running, and check that the host name and port settings are correct.");
+        break;
+        default:
+            emit newWarningMessage(QString("The following error occurred: %1.").arg(socket ? socket->errorString() : QString()));
+        break;
+    }
+}
+
+/**
+ * @brief Replace all rows of table with rows of table sent by server
+ * @param payload payload of Protocol::Table frame
+ */
+void ClientCore::updateTable(const QByteArray &payload)
+{
+    quint64 sequence = 0;
+    QVector<Protocol::TableRow> rows;
+    if (!Protocol::decodeTable(payload, sequence, rows)) {
+        emit newWarningMessage("Got malformed table from server!");
+        return;
+    }
+    emit newDebugMessage(QString("Got table from server with %1 rows, sequence number is %2").arg(rows.size()).arg(sequence));
+
+    tableSequence = sequence;
+    tableRequested = false;
+    tableTracked = true;
+    emit tableReset(rows);
+}
+
+/**
+ * @brief Append rows that were added on server since the last known sequence number
+ *
+ * @details Delta that is already included in table is ignored. If some delta was missed,
+ * the whole table is requested again.
+ *
+ * @param payload payload of Protocol::TableDelta frame
+ */
+void ClientCore::applyTableDelta(const QByteArray &payload)
+{
+    quint64 sequence = 0;
+    QVector<Protocol::TableRow> rows;
+    if (!Protocol::decodeTable(payload, sequence, rows)) {
+        emit newWarningMessage("Got malformed table delta from server!");
+        return;
+    }
+
+    quint64 first = sequence - quint64(rows.size()) + 1;    // sequence number of the first row of delta
+    if (!tableTracked || tableRequested || !firstPageRequests.isEmpty() || sequence <= tableSequence)
+        return;     // table isn't shown, the whole table or the first page is on its way or delta is already applied
+
+    if (first > tableSequence + 1) {
+        emit newDebugMessage(QString("Missed rows %1..%2 of table, requesting the whole table").arg(tableSequence + 1).arg(first - 1));
+        requestTable();
+        return;
+    }
+
+    // skip rows that are already in table
+    rows.remove(0, int(tableSequence + 1 - first));
+    tableSequence = sequence;
+    emit rowsAppended(rows);
+}
+
+/**
+ * @brief Pass page of table to its requester
+ * @param header header of answer
+ * @param payload see Protocol::encodeQueryResult
+ */
+void ClientCore::queryAnswered(const Protocol::FrameHeader &header, const QByteArray &payload)
+{
+    bool firstPage = firstPageRequests.remove(header.requestId);
+
+    quint64 sequence = 0;
+    QByteArray cursor;
+    QVector<Protocol::TableRow> rows;
+    if (header.flags & Protocol::Failed) {
+        emit newWarningMessage("Server has rejected query of table!");
+    } else if (!Protocol::decodeQueryResult(payload, sequence, cursor, rows)) {
+        emit newWarningMessage("Got malformed page of table from server!");
+        cursor.clear();
+        rows.clear();
+    } else if (firstPage && !tableRequested) {
+        // page has all changes up to sequence, deltas after it are applied
+        tableSequence = sequence;
+        tableTracked = true;
+    }
+
+    emit pageReceived(header.requestId, rows, cursor);
+}
+
+/**
+ * @brief Write received chunk of file to the partial file in directory of its batch.
+ *
+ * @details Server sends requested files one after another, every file as a sequence of Protocol::Load frames,
+ * every chunk carries its offset in file. First chunk opens "<name>.part" file, chunk with Protocol::LastChunk flag
+ * closes it and renames it to the name of file. Partial file is kept if connection is lost, so download can be resumed.
+ * Frame with Protocol::BatchDone flag completes the batch.
+ *
+ * @param header header of frame
+ * @param fileName name of file
+ * @param buffer chunk of file data
+ */
+void ClientCore::loadFiles(const Protocol::FrameHeader &header, const QString &fileName, const QByteArray &buffer)
+{
+    QMap<quint32, DownloadBatch>::iterator batch = downloadBatches.find(header.requestId);
+    if (batch == downloadBatches.end()) {
+        emit newDebugMessage(QString("Got chunk of file %1 of unknown request %2").arg(fileName).arg(header.requestId));
+        return;
+    }
+
+    if (header.flags & Protocol::BatchDone) {
+        QStringList failed = batch->files;
+        if (failed.isEmpty())
+            emit newDebugMessage(QString("All files of request %1 were loaded into %2").arg(header.requestId).arg(batch->dir));
+        downloadBatches.erase(batch);
+        emit batchFinished(header.requestId, failed);
+        return;
+    }
+
+    if (header.flags & Protocol::Failed) {
+        emit newWarningMessage(QString("Server can't send file %1!").arg(fileName));
+        emit downloadFinished(batch->dir+"/"+fileName, false);
+        return;     // file stays in batch and is reported when batch is done
+    }
+
+    if (!downloadFile) {
+        emit newDebugMessage(QString("You are receiving a file from sd:%1, called %2..").arg(socket->socketDescriptor()).arg(fileName));
+
+        QString filePath = batch->dir+"/"+fileName+".part";
+        emit newDebugMessage(QString("Trying to safe received file under path %1..").arg(filePath));
+
+        // the rest of file is appended to the part that was received before
+        downloadFile = new QFile(filePath, this);
+        bool opened = header.offset > 0 ? downloadFile->open(QIODevice::ReadWrite) && downloadFile->resize(qint64(header.offset))
+                                        : downloadFile->open(QIODevice::WriteOnly);
+        if (!opened || !downloadFile->seek(qint64(header.offset))) {
+            emit newWarningMessage(QString("An error occurred while trying to save the received file %1!").arg(filePath));    // the rest chunks are skipped
+            downloadFile->close();
+        }
+    }
+
+    if (downloadFile->isOpen() && downloadFile->write(buffer) != buffer.size()) {
+        emit newWarningMessage(QString("An error occurred while trying to write the received chunk of file %1!").arg(fileName));
+        downloadFile->close();
+    }
+
+    if (header.flags & Protocol::LastChunk) {
+        QString filePath = batch->dir+"/"+fileName;
+        bool ok = false;
+        if (downloadFile->isOpen()) {
+            downloadFile->close();
+
+            QFile::remove(filePath);
+            ok = downloadFile->rename(filePath);
+            if (ok) {
+                emit newDebugMessage(QString("File from sd:%1 successfully stored on disk under the path %2").arg(socket->socketDescriptor()).arg(filePath));
+                batch->files.removeOne(fileName);
+            } else
+                emit newWarningMessage(QString("Can't rename received file %1 to %2!").arg(downloadFile->fileName()).arg(filePath));
+        }
+        downloadFile->deleteLater();
+        downloadFile = nullptr;
+        emit downloadFinished(filePath, ok);
+    }
+}
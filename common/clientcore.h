@@ -0,0 +1,139 @@
+#ifndef CLIENTCORE_H
+#define CLIENTCORE_H
+
+#include <QObject>
+
+#include <QTcpSocket>
+#include <QFile>
+#include <QMap>
+#include <QPair>
+#include <QSet>
+#include <QStringList>
+#include <QVector>
+
+#include "protocol.h"
+#include "deltasync.h"
+#include "multipartupload.h"
+
+/**
+ * @brief Files that were requested from server in one Protocol::Load request
+ */
+struct DownloadBatch
+{
+    QString dir;        ///< directory, where files are stored
+    QStringList files;  ///< names of files, that aren't received yet
+};
+
+/**
+ * @brief File, whose hash is being computed or checked by server with Protocol::HaveHash request
+ */
+struct HashRequest
+{
+    QString path;       ///< path of file
+    QByteArray name;    ///< UTF-8 name of file
+};
+
+/**
+ * @brief Networking and framing of client without GUI
+ *
+ * @details Core keeps one connection to server and pipelines requests over it:
+ * all download batches are sent at once and served by server in order. Several queued files are hashed
+ * and checked by server ahead (see MaxHashRequests), so content, that server already has, costs no round trip
+ * of its own, and the next upload is sent as soon as server has opened it, without waiting for confirmation
+ * of the previous one.
+ * Uploads and downloads that weren't completed are resumed after reconnect.
+ * Big files may be sent in parts over several additional connections (see setParallelUploads).
+ *
+ * Results are reported by signals, errors go to newWarningMessage/newCriticalMessage and never block.
+ */
+class ClientCore : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ClientCore(QObject *parent = nullptr);
+    ~ClientCore();
+
+    static const qint64 DefaultParallelMinSize = 64 * 1024 * 1024;  ///< files from this size are sent in parts by default
+    static const int MaxHashRequests = 8;   ///< queued files, that are hashed and checked by server ahead of their upload
+
+    bool connectToServer(const QString &host, int port, int timeout = 30000);
+    void disconnectFromServer();
+    bool isConnected() const;
+
+    void upload(const QStringList &filePaths);
+    quint32 download(const QStringList &fileNames, const QString &dir);
+    void requestTable();
+    quint32 query(const Protocol::Query &query);
+    void requestStats();
+    void setParallelUploads(int connections, qint64 minSize = DefaultParallelMinSize);
+
+    int pendingUploads() const;
+    int pendingDownloads() const;
+
+signals:
+    void newDebugMessage(QString);
+    void newInfoMessage(QString);
+    void newWarningMessage(QString);
+    void newCriticalMessage(QString);
+
+    void connected();
+    void disconnected();
+
+    void tableReset(const QVector<Protocol::TableRow> &rows);       ///< the whole table was received
+    void rowsAppended(const QVector<Protocol::TableRow> &rows);     ///< rows that were appended to table, row of file that is already in table replaces it
+    void uploadFinished(const QString &filePath, bool ok);
+    void downloadFinished(const QString &filePath, bool ok);
+    void batchFinished(quint32 requestId, const QStringList &failed);
+    void statsReceived(const QByteArray &text);
+    void pageReceived(quint32 requestId, const QVector<Protocol::TableRow> &rows, const QByteArray &cursor);   ///< page of table, empty cursor means that there are no more rows
+
+private slots:
+    void readSocket();
+    void discardSocket();
+    void displayError(QAbstractSocket::SocketError socketError);
+    void sendNextUploadChunk();
+    void sendNextUploadPatch();
+    void multipartFinished(const QString &filePath, bool ok);
+
+private:
+    void startNextUpload();
+    void hashComputed(quint32 requestId, const QByteArray &digest);
+    void openUpload(const Protocol::FrameHeader &header, const QByteArray &payload);
+    void closeUpload();
+    void hashChecked(const Protocol::FrameHeader &header, const QByteArray &payload);
+    void uploadSaved(const Protocol::FrameHeader &header);
+    void codecNegotiated(const QByteArray &payload);
+    quint32 requestDownloads(const DownloadBatch &batch);
+    void loadFiles(const Protocol::FrameHeader &header, const QString &fileName, const QByteArray &buffer);
+    void updateTable(const QByteArray &payload);
+    void applyTableDelta(const QByteArray &payload);
+    void queryAnswered(const Protocol::FrameHeader &header, const QByteArray &payload);
+
+    QTcpSocket *socket = nullptr;   ///< socket is needed to communicate with server
+    QString host;                   ///< host of server, parts of files are sent to it over their own connections
+    int port = 0;                   ///< port of server
+    quint32 lastRequestId = 0;      ///< id of the last request that was sent to server
+    quint8 codec = Protocol::Identity;  ///< codec that server has chosen for connection, see Protocol::Codec
+    quint64 tableSequence = 0;      ///< sequence number of the last row of table
+    bool tableRequested = false;    ///< the whole table was requested and deltas are ignored until it comes
+    QSet<quint32> firstPageRequests;///< ids of queries without cursor, their answers start tracking of deltas
+    bool tableTracked = false;      ///< table or its first page was received, so deltas are applied
+
+    QStringList uploadQueue;        ///< paths of files, that wait for their upload
+    QMap<quint32, HashRequest> hashRequests;    ///< request id -> file, whose upload isn't opened by server yet
+    QList<QPair<Protocol::FrameHeader, QByteArray>> openedUploads;  ///< answers of server, that opened upload while uploadFile is sent
+    QMap<quint32, QString> awaitingConfirmation;   ///< request id -> path of file, that was sent, but isn't confirmed by server yet
+    QString uploadPath;             ///< path of file that is being sent
+    QFile *uploadFile = nullptr;    ///< file that is being sent to server chunk by chunk
+    QByteArray uploadName;          ///< UTF-8 name of uploadFile
+    quint32 uploadRequestId = 0;    ///< id of request that uploads uploadFile
+    DeltaSync::Encoder *uploadEncoder = nullptr;    ///< makes difference of uploadFile to stored file, nullptr if file is sent as a whole
+    int parallelConnections = 1;    ///< count of connections for parts of big file, 1 means that files are never sent in parts
+    qint64 parallelMinSize = DefaultParallelMinSize;    ///< files from this size are sent in parts
+    QSet<MultipartUpload*> multipartUploads;    ///< uploads of files in parts, that aren't finished yet
+
+    QMap<quint32, DownloadBatch> downloadBatches;   ///< request id -> files of load requests that aren't completed
+    QFile *downloadFile = nullptr;  ///< partial file that is being received from server chunk by chunk
+};
+
+#endif // CLIENTCORE_H
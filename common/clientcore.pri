@@ -0,0 +1,9 @@
+QT += concurrent
+
+HEADERS += \
+    $$PWD/clientcore.h \
+    $$PWD/multipartupload.h
+
+SOURCES += \
+    $$PWD/clientcore.cpp \
+    $$PWD/multipartupload.cpp
@@ -1,5 +1,11 @@
-HEADERS += \
-    $$PWD/logging_categories.h
-
-SOURCES += \
-    $$PWD/logging_categories.cpp
+HEADERS += \
+    $$PWD/asynclogger.h \
+    $$PWD/deltasync.h \
+    $$PWD/logging_categories.h \
+    $$PWD/protocol.h
+
+SOURCES += \
+    $$PWD/asynclogger.cpp \
+    $$PWD/deltasync.cpp \
+    $$PWD/logging_categories.cpp \
+    $$PWD/protocol.cpp
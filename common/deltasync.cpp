@@ -0,0 +1,391 @@
+#include "deltasync.h"
+
+#include <cmath>
+
+namespace DeltaSync {
+
+static const int ReadSize = 256 * 1024;        ///< bytes read from new file at once
+static const int PatchSize = 64 * 1024;        ///< patch is returned, when it has grown to this size
+static const int LiteralSize = 64 * 1024;      ///< literal data is put into patch in pieces of this size
+static const int ScanBudget = 4 * 1024 * 1024; ///< bytes of new file scanned for one patch at most, so buffer stays small and matching files don't block the caller
+static const int CopySize = 1024 * 1024;       ///< bytes copied from stored file at once
+
+/**
+ * @brief Choose block size for file: square root of its size, so count of signatures and cost of literal data grow equally
+ * @param fileSize
+ * @return
+ */
+int blockSizeFor(qint64 fileSize)
+{
+    qint64 size = qint64(std::sqrt(double(fileSize)));
+    size = (size + 1023) / 1024 * 1024;
+    return int(qBound<qint64>(MinBlockSize, size, MaxBlockSize));
+}
+
+/**
+ * @brief Weak checksum of rsync: sum of bytes and weighted sum of bytes, both modulo 2^16
+ * @param data
+ * @param size
+ * @return
+ */
+quint32 weakChecksum(const char *data, int size)
+{
+    const uchar *bytes = reinterpret_cast<const uchar*>(data);
+    quint32 s1 = 0;
+    quint32 s2 = 0;
+    for (int i = 0; i < size; ++i) {
+        s1 += bytes[i];
+        s2 += s1;
+    }
+    return (s1 & 0xFFFF) | (s2 << 16);
+}
+
+/**
+ * @brief Strong hash of block
+ * @param data
+ * @param size
+ * @return StrongHashSize bytes
+ */
+QByteArray strongHash(const char *data, int size)
+{
+    return QCryptographicHash::hash(QByteArray::fromRawData(data, size), QCryptographicHash::Md5);
+}
+
+/**
+ * @brief Compute signatures of all blocks of file
+ * @param file opened file, it is read from the beginning
+ * @param signatures
+ * @return false if file can't be read
+ */
+bool computeSignatures(QIODevice *file, Signatures &signatures)
+{
+    signatures.fileSize = file->size();
+    signatures.blockSize = blockSizeFor(signatures.fileSize);
+    signatures.weak.clear();
+    signatures.strong.clear();
+    if (!file->seek(0))
+        return false;
+
+    QByteArray block(signatures.blockSize, Qt::Uninitialized);
+    for (qint64 position = 0; position < signatures.fileSize; position += signatures.blockSize) {
+        int size = int(qMin<qint64>(signatures.blockSize, signatures.fileSize - position));
+        if (file->read(block.data(), size) != size)
+            return false;
+        signatures.weak.append(weakChecksum(block.constData(), size));
+        signatures.strong.append(strongHash(block.constData(), size));
+    }
+    return true;
+}
+
+/**
+ * @brief Encode signatures into payload of answer to Protocol::HaveHash
+ * @param signatures
+ * @return
+ */
+QByteArray encodeSignatures(const Signatures &signatures)
+{
+    QByteArray payload;
+    payload.reserve(16 + signatures.blockCount() * (4 + StrongHashSize));
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_9);
+
+    out << signatures.blockSize << signatures.fileSize;
+    for (int i = 0; i < signatures.blockCount(); ++i) {
+        out << signatures.weak[i];
+        out.writeRawData(signatures.strong[i].constData(), StrongHashSize);
+    }
+    return payload;
+}
+
+/**
+ * @brief Decode signatures from payload of answer to Protocol::HaveHash
+ * @param payload
+ * @param signatures
+ * @return false if payload is malformed
+ */
+bool decodeSignatures(const QByteArray &payload, Signatures &signatures)
+{
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_5_9);
+
+    in >> signatures.blockSize >> signatures.fileSize;
+    if (in.status() != QDataStream::Ok || signatures.blockSize < MinBlockSize || signatures.blockSize > MaxBlockSize || signatures.fileSize < 0)
+        return false;
+
+    // count of blocks follows from size of file, so payload must have exactly that many signatures
+    qint64 count = (signatures.fileSize + signatures.blockSize - 1) / signatures.blockSize;
+    if (count * (4 + StrongHashSize) != payload.size() - in.device()->pos())
+        return false;
+
+    signatures.weak.resize(int(count));
+    signatures.strong.resize(int(count));
+    char strong[StrongHashSize];
+    for (int i = 0; i < count; ++i) {
+        in >> signatures.weak[i];
+        in.readRawData(strong, StrongHashSize);
+        signatures.strong[i] = QByteArray(strong, StrongHashSize);
+    }
+    return in.status() == QDataStream::Ok;
+}
+
+/**
+ * @brief Write part of new file, that is described by patch, into target
+ * @param patch instructions, see Instruction
+ * @param base stored file, that blocks are copied from
+ * @param blockSize size of blocks, that signatures of base were computed for
+ * @param target file, that is being rebuilt
+ * @param hash hash of written content, nullptr if it isn't needed
+ * @param written count of bytes, that were written into target
+ * @return false if patch is malformed, writes more than encoder can describe with one patch or files can't be read or written
+ */
+bool applyPatch(const QByteArray &patch, QIODevice *base, qint32 blockSize, QIODevice *target, QCryptographicHash *hash, qint64 &written)
+{
+    QDataStream in(patch);
+    in.setVersion(QDataStream::Qt_5_9);
+
+    const qint64 baseSize = base->size();
+    // encoder scans ScanBudget bytes for one patch, the last block may end beyond it and literal data is carried
+    // by patch itself, so short copy instruction, that copies more, is forged and would fill disk
+    const qint64 maxWritten = qint64(ScanBudget) + MaxBlockSize + patch.size();
+    QByteArray block;
+    written = 0;
+    while (!in.atEnd()) {
+        quint8 instruction = 0;
+        in >> instruction;
+
+        if (instruction == Copy) {
+            quint32 first = 0;
+            quint32 count = 0;
+            in >> first >> count;
+            // blocks must lie inside stored file, counts are checked before they are multiplied
+            if (in.status() != QDataStream::Ok || blockSize <= 0 || count == 0)
+                return false;
+            qint64 blockCount = (baseSize + blockSize - 1) / blockSize;
+            if (qint64(first) >= blockCount || qint64(count) > blockCount - qint64(first))
+                return false;
+            qint64 begin = qint64(first) * blockSize;
+            qint64 end = qMin(baseSize, begin + qint64(count) * blockSize);
+            if (end - begin > maxWritten - written || !base->seek(begin))
+                return false;
+
+            while (begin < end) {
+                int size = int(qMin<qint64>(end - begin, CopySize));
+                block.resize(size);
+                if (base->read(block.data(), size) != size || target->write(block) != size)
+                    return false;
+                if (hash)
+                    hash->addData(block);
+                written += size;
+                begin += size;
+            }
+        } else if (instruction == Literal) {
+            quint32 size = 0;
+            in >> size;
+            if (in.status() != QDataStream::Ok || size > quint32(patch.size() - in.device()->pos()))
+                return false;
+            // literal data is written straight from patch
+            const char *data = patch.constData() + in.device()->pos();
+            if (in.skipRawData(int(size)) != int(size))
+                return false;
+            if (target->write(data, size) != qint64(size))
+                return false;
+            if (hash)
+                hash->addData(data, int(size));
+            written += size;
+        } else
+            return false;
+    }
+
+    return in.status() == QDataStream::Ok;
+}
+
+/**
+ * @brief Encoder::Encoder
+ * @param file opened new file, it is read from its current position
+ * @param signatures signatures of stored file
+ */
+Encoder::Encoder(QIODevice *file, const Signatures &signatures)
+    : file(file)
+    , signatures(signatures)
+{
+    blocks.reserve(signatures.blockCount());
+    for (int i = 0; i < signatures.blockCount(); ++i)
+        blocks.insert(signatures.weak[i], i);
+}
+
+/**
+ * @brief Describe the next part of file
+ *
+ * @details Window of block size slides over file byte by byte while its weak checksum is rolled. When checksum and
+ * strong hash of window match block of stored file, bytes before window are put as literal data and window
+ * jumps over block. Consecutive blocks are put as one copy. Tail of file, that is shorter than block,
+ * can match only the last block of stored file.
+ *
+ * @return patch, the last one is returned when atEnd becomes true
+ */
+QByteArray Encoder::next()
+{
+    QByteArray patch;
+    if (finished)
+        return patch;
+
+    QDataStream out(&patch, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_9);
+
+    const int blockSize = signatures.blockSize;
+    const int start = window;
+    while (patch.size() < PatchSize && window - start < ScanBudget) {
+        if (!fill(window + blockSize + 1)) {
+            error = true;
+            finished = true;
+            break;
+        }
+
+        int available = buffer.size() - window;
+        if (available < blockSize) {
+            // here the whole file is in buffer
+            if (available > 0 && signatures.blockCount() > 0) {
+                int index = findBlock(available, weakChecksum(buffer.constData() + window, available));
+                if (index == signatures.blockCount() - 1) {
+                    putLiteral(out, window);
+                    if (copyFirst < 0 || index != copyFirst + copyCount)
+                        putCopy(out);
+                    if (copyFirst < 0)
+                        copyFirst = index;
+                    ++copyCount;
+                    window += available;
+                    literalStart = window;
+                }
+            }
+            putLiteral(out, buffer.size());
+            putCopy(out);
+            finished = true;
+            break;
+        }
+
+        if (!rolling) {
+            quint32 weak = weakChecksum(buffer.constData() + window, blockSize);
+            s1 = weak & 0xFFFF;
+            s2 = weak >> 16;
+            rolling = true;
+        }
+
+        int index = findBlock(blockSize, (s1 & 0xFFFF) | (s2 << 16));
+        if (index >= 0) {
+            putLiteral(out, window);
+            if (copyFirst < 0 || index != copyFirst + copyCount)
+                putCopy(out);
+            if (copyFirst < 0)
+                copyFirst = index;
+            ++copyCount;
+            window += blockSize;
+            literalStart = window;
+            rolling = false;
+            continue;
+        }
+
+        // the first byte leaves window and the next one enters it
+        if (available > blockSize) {
+            quint32 leaving = uchar(buffer.at(window));
+            quint32 entering = uchar(buffer.at(window + blockSize));
+            s1 = s1 - leaving + entering;
+            s2 = s2 - quint32(blockSize) * leaving + s1;
+        } else
+            rolling = false;
+        ++window;
+
+        if (window - literalStart >= LiteralSize)
+            putLiteral(out, window);
+    }
+
+    // patch describes whole blocks only, so offset of the next patch is known to server
+    putCopy(out);
+
+    // described bytes are dropped from buffer
+    buffer.remove(0, literalStart);
+    window -= literalStart;
+    literalStart = 0;
+    return patch;
+}
+
+/**
+ * @brief Read file until buffer has needed bytes or file has ended
+ * @param needed
+ * @return false if file can't be read
+ */
+bool Encoder::fill(int needed)
+{
+    while (buffer.size() < needed && !eof) {
+        int size = buffer.size();
+        buffer.resize(size + ReadSize);
+        qint64 count = file->read(buffer.data() + size, ReadSize);
+        if (count < 0) {
+            buffer.resize(size);
+            return false;
+        }
+        buffer.resize(size + int(count));
+        if (count == 0)
+            eof = true;
+    }
+    return true;
+}
+
+/**
+ * @brief Put bytes from literalStart to end as literal data, pending copy goes first
+ * @param out
+ * @param end
+ */
+void Encoder::putLiteral(QDataStream &out, int end)
+{
+    if (end <= literalStart)
+        return;
+
+    putCopy(out);
+    int size = end - literalStart;
+    out << quint8(Literal) << quint32(size);
+    out.writeRawData(buffer.constData() + literalStart, size);
+    literalStart = end;
+    literal += size;
+    described += size;
+}
+
+/**
+ * @brief Put pending copy of consecutive blocks
+ * @param out
+ */
+void Encoder::putCopy(QDataStream &out)
+{
+    if (copyFirst < 0)
+        return;
+
+    out << quint8(Copy) << quint32(copyFirst) << quint32(copyCount);
+    qint64 begin = copyFirst * signatures.blockSize;
+    qint64 size = qMin(signatures.fileSize, begin + copyCount * signatures.blockSize) - begin;
+    copied += size;
+    described += size;
+    copyFirst = -1;
+    copyCount = 0;
+}
+
+/**
+ * @brief Find block of stored file, that has the same content as window
+ * @param length size of window
+ * @param weak weak checksum of window
+ * @return index of block, -1 if there is no such block
+ */
+int Encoder::findBlock(int length, quint32 weak) const
+{
+    QByteArray strong;
+    for (QMultiHash<quint32, int>::const_iterator it = blocks.constFind(weak); it != blocks.constEnd() && it.key() == weak; ++it) {
+        if (signatures.blockLength(it.value()) != length)
+            continue;
+        // strong hash is computed only when weak checksum matches
+        if (strong.isEmpty())
+            strong = strongHash(buffer.constData() + window, length);
+        if (strong == signatures.strong[it.value()])
+            return it.value();
+    }
+    return -1;
+}
+
+}
@@ -0,0 +1,107 @@
+#ifndef DELTASYNC_H
+#define DELTASYNC_H
+
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QIODevice>
+#include <QMultiHash>
+#include <QVector>
+
+/**
+ * @brief rsync-style upload of difference between new file and stored file with the same name
+ *
+ * @details Server splits its copy into blocks and sends signature of every block: rolling weak checksum
+ * and strong hash (see computeSignatures). Client slides window of block size over new file, blocks,
+ * whose weak checksum and strong hash match, are sent as references, the rest as literal data (see Encoder).
+ * Server rebuilds new file from references to its copy and literal data (see applyPatch).
+ *
+ * Patch is a sequence of instructions, encoded with QDataStream:
+ *
+ * | instruction | fields                                   |
+ * |-------------|------------------------------------------|
+ * | Copy        | quint32 first block, quint32 count       |
+ * | Literal     | quint32 size, size raw bytes             |
+ */
+namespace DeltaSync {
+
+const qint64 MinFileSize = 64 * 1024;       ///< smaller files are always sent as a whole
+const int MinBlockSize = 2 * 1024;          ///< minimum size of block
+const int MaxBlockSize = 1024 * 1024;       ///< maximum size of block
+const int StrongHashSize = 16;              ///< size of MD5 of block, content of the whole file is checked by SHA-256 anyway
+
+/**
+ * @brief Kind of patch instruction
+ */
+enum Instruction : quint8 {
+    Copy    = 1,    ///< copy consecutive blocks of stored file
+    Literal = 2,    ///< write bytes, that follow instruction
+};
+
+/**
+ * @brief Signatures of blocks of stored file
+ */
+struct Signatures
+{
+    qint32 blockSize = 0;           ///< size of every block except the last one
+    qint64 fileSize = 0;            ///< size of stored file, the last block may be shorter
+    QVector<quint32> weak;          ///< rolling checksums of blocks
+    QVector<QByteArray> strong;     ///< MD5 of blocks
+
+    int blockCount() const { return weak.size(); }
+    qint64 blockLength(int index) const { return qMin<qint64>(blockSize, fileSize - qint64(index) * blockSize); }
+};
+
+int blockSizeFor(qint64 fileSize);
+quint32 weakChecksum(const char *data, int size);
+QByteArray strongHash(const char *data, int size);
+
+bool computeSignatures(QIODevice *file, Signatures &signatures);
+QByteArray encodeSignatures(const Signatures &signatures);
+bool decodeSignatures(const QByteArray &payload, Signatures &signatures);
+
+bool applyPatch(const QByteArray &patch, QIODevice *base, qint32 blockSize, QIODevice *target, QCryptographicHash *hash, qint64 &written);
+
+/**
+ * @brief Makes patch of file against signatures piece by piece, so big file is never read into memory as a whole
+ */
+class Encoder
+{
+public:
+    Encoder(QIODevice *file, const Signatures &signatures);
+
+    QByteArray next();
+    bool atEnd() const { return finished; }
+    bool hasError() const { return error; }
+    qint64 position() const { return described; }
+    qint64 literalBytes() const { return literal; }
+    qint64 copiedBytes() const { return copied; }
+
+private:
+    bool fill(int needed);
+    void putLiteral(QDataStream &out, int end);
+    void putCopy(QDataStream &out);
+    int findBlock(int length, quint32 weak) const;
+
+    QIODevice *file;                    ///< new file
+    Signatures signatures;              ///< signatures of stored file
+    QMultiHash<quint32, int> blocks;    ///< weak checksum -> index of block with such checksum
+    QByteArray buffer;                  ///< read part of file, that isn't described by patch yet
+    int window = 0;                     ///< start of window of block size in buffer
+    int literalStart = 0;               ///< start of bytes in buffer, that will be sent as literal
+    bool eof = false;                   ///< the whole file was read into buffer
+    bool rolling = false;               ///< s1 and s2 are checksums of window
+    quint32 s1 = 0;                     ///< sum of bytes of window
+    quint32 s2 = 0;                     ///< weighted sum of bytes of window
+    qint64 copyFirst = -1;              ///< the first block of copy, that isn't put into patch yet, -1 if there is none
+    qint64 copyCount = 0;               ///< count of blocks of that copy
+    bool finished = false;              ///< the last patch was returned
+    bool error = false;                 ///< file can't be read
+    qint64 described = 0;               ///< bytes of new file described by returned patches
+    qint64 literal = 0;                 ///< bytes of new file sent as literal data
+    qint64 copied = 0;                  ///< bytes of new file sent as references to blocks
+};
+
+}
+
+#endif // DELTASYNC_H
@@ -1,6 +1,6 @@
-#include "logging_categories.h"
-
-Q_LOGGING_CATEGORY(logDebug,    "Debug")
-Q_LOGGING_CATEGORY(logInfo,     "Info")
-Q_LOGGING_CATEGORY(logWarning,  "Warning")
-Q_LOGGING_CATEGORY(logCritical, "Critical")
+#include "logging_categories.h"
+
+Q_LOGGING_CATEGORY(logDebug,    "Debug")
+Q_LOGGING_CATEGORY(logInfo,     "Info")
+Q_LOGGING_CATEGORY(logWarning,  "Warning")
+Q_LOGGING_CATEGORY(logCritical, "Critical")
@@ -1,12 +1,12 @@
-#ifndef LOGGING_CATEGORIES_H
-#define LOGGING_CATEGORIES_H
-
-
-#include <QLoggingCategory>
-
-Q_DECLARE_LOGGING_CATEGORY(logDebug)
-Q_DECLARE_LOGGING_CATEGORY(logInfo)
-Q_DECLARE_LOGGING_CATEGORY(logWarning)
-Q_DECLARE_LOGGING_CATEGORY(logCritical)
-
-#endif // LOGGING_CATEGORIES_H
+#ifndef LOGGING_CATEGORIES_H
+#define LOGGING_CATEGORIES_H
+
+
+#include <QLoggingCategory>
+
+Q_DECLARE_LOGGING_CATEGORY(logDebug)
+Q_DECLARE_LOGGING_CATEGORY(logInfo)
+Q_DECLARE_LOGGING_CATEGORY(logWarning)
+Q_DECLARE_LOGGING_CATEGORY(logCritical)
+
+#endif // LOGGING_CATEGORIES_H
@@ -0,0 +1,227 @@
+#include "multipartupload.h"
+
+#include <QFileInfo>
+
+static const qint64 MinPartSize = 8 * 1024 * 1024; ///< smaller parts aren't worth their own connection
+static const quint32 PartRequestId = 1;            ///< every connection carries only one request
+
+/**
+ * @brief Split file into parts
+ * @param filePath
+ * @param hash raw SHA-256 of file
+ * @param connections maximum count of connections, file gets fewer of them if its parts would be too small
+ * @param parent
+ */
+MultipartUpload::MultipartUpload(const QString &filePath, const QByteArray &hash, int connections, QObject *parent)
+    : QObject(parent)
+    , path(filePath)
+    , name(QFileInfo(filePath).fileName().toUtf8())
+    , hash(hash)
+{
+    qint64 fileSize = QFileInfo(filePath).size();
+    int count = int(qBound<qint64>(1, fileSize / MinPartSize, qMax(1, connections)));
+    qint64 length = (fileSize + count - 1) / count;
+
+    for (qint64 offset = 0; offset < fileSize; offset += length) {
+        Part part;
+        part.range.fileSize = fileSize;
+        part.range.offset = offset;
+        part.range.length = qMin(length, fileSize - offset);
+        parts.append(part);
+    }
+}
+
+/**
+ * @brief Drop connections and files of parts
+ */
+MultipartUpload::~MultipartUpload()
+{
+    close();
+}
+
+/**
+ * @brief Connect all parts to server, every part is opened as soon as its connection is established
+ * @param host
+ * @param port
+ */
+void MultipartUpload::start(const QString &host, int port)
+{
+    if (parts.isEmpty()) {
+        fail(QString("File %1 is empty, it can't be sent in parts!").arg(path));
+        return;
+    }
+
+    for (int index = 0; index < parts.size(); ++index) {
+        Part &part = parts[index];
+        part.file = new QFile(path, this);
+        if (!part.file->open(QIODevice::ReadOnly)) {
+            fail(QString("Can't open file %1 to read!").arg(path));
+            return;
+        }
+
+        part.socket = new QTcpSocket(this);
+        connect(part.socket, &QTcpSocket::connected, this, [this, index]() { openPart(index); });
+        connect(part.socket, &QTcpSocket::readyRead, this, [this, index]() { readPart(index); });
+        connect(part.socket, &QTcpSocket::bytesWritten, this, [this, index]() { sendNextChunk(index); });
+        connect(part.socket, &QTcpSocket::disconnected, this, [this]() {
+            fail(QString("Connection was closed before all parts of file %1 were saved").arg(path));
+        });
+        // see https://stackoverflow.com/questions/35655512/compile-error-when-connecting-qtcpsocketerror-using-the-new-qt5-signal-slot
+        connect(part.socket, static_cast<void (QTcpSocket::*)(QAbstractSocket::SocketError)>(&QAbstractSocket::error), this, [this, index]() {
+            fail(QString("The following error occurred: %1.").arg(parts[index].socket->errorString()));
+        });
+        part.socket->connectToHost(host, quint16(port));
+    }
+
+    emit newDebugMessage(QString("File %1 is sent in %2 parts").arg(path).arg(parts.size()));
+}
+
+/**
+ * @brief Ask server how much of part it has already received
+ * @param index
+ */
+void MultipartUpload::openPart(int index)
+{
+    QByteArray payload = Protocol::encodePart(hash, parts[index].range);
+    Protocol::writeFrame(parts[index].socket, Protocol::HaveHash, Protocol::Multipart, PartRequestId, name,
+                         payload.constData(), payload.size());
+}
+
+/**
+ * @brief Handle answers of server on connection of part, frames, that aren't about part, are ignored
+ * @param index
+ */
+void MultipartUpload::readPart(int index)
+{
+    forever {
+        if (completed)
+            return;
+
+        Protocol::FrameHeader header;
+        QByteArray frameName;
+        QByteArray buffer;
+        Protocol::ReadStatus status = Protocol::readFrame(parts[index].socket, header, frameName, buffer);
+        if (status == Protocol::NeedMoreData)
+            return;
+        if (status == Protocol::BadFrame) {
+            fail("Got malformed frame from server!");
+            return;
+        }
+
+        if (header.opcode == Protocol::HaveHash || header.opcode == Protocol::Save)
+            partAnswered(index, header);
+    }
+}
+
+/**
+ * @brief Send next chunks of part while socket has room for them, the last chunk of part has Protocol::LastChunk flag
+ * @param index
+ */
+void MultipartUpload::sendNextChunk(int index)
+{
+    Part &part = parts[index];
+    if (completed || part.hashPending || part.sent)
+        return;
+
+    const qint64 end = part.range.offset + part.range.length;
+    char chunk[Protocol::ChunkSize];
+    while (part.socket->bytesToWrite() < Protocol::ChunkSize) {
+        qint64 position = part.file->pos();
+        qint64 size = part.file->read(chunk, qMin(Protocol::ChunkSize, end - position));
+        if (size < 0) {
+            fail(QString("An error occurred while trying to read file %1!").arg(path));
+            return;
+        }
+
+        // part, that was received completely before, is finished by an empty chunk
+        bool last = position + size >= end;
+        if (!last && size == 0) {
+            fail(QString("File %1 was changed while it was being sent!").arg(path));
+            return;
+        }
+        Protocol::writeFrame(part.socket, Protocol::Save, last ? Protocol::LastChunk : Protocol::NoFlags,
+                             PartRequestId, name, chunk, size, quint64(position));
+
+        if (last) {
+            part.sent = true;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Start sending of part from where server has stopped, or finish part, when server has confirmed it
+ * @param index
+ * @param header header of Protocol::HaveHash or Protocol::Save answer
+ */
+void MultipartUpload::partAnswered(int index, const Protocol::FrameHeader &header)
+{
+    Part &part = parts[index];
+    if (header.flags & Protocol::Failed) {
+        fail(QString("Server failed to save part of file %1 at %2!").arg(path).arg(part.range.offset));
+        return;
+    }
+
+    if (header.opcode == Protocol::HaveHash && !(header.flags & Protocol::Found)) {
+        qint64 offset = qint64(header.offset);
+        if (!part.hashPending || offset < part.range.offset || offset > part.range.offset + part.range.length || !part.file->seek(offset)) {
+            fail(QString("Server has wrong position %1 in part of file %2!").arg(offset).arg(path));
+            return;
+        }
+        part.hashPending = false;
+        if (offset > part.range.offset)
+            emit newDebugMessage(QString("Part of file %1 at %2 is resumed from %3").arg(path).arg(part.range.offset).arg(offset));
+        sendNextChunk(index);
+        return;
+    }
+
+    // content is already stored or part is saved
+    if (part.done)
+        return;
+    part.done = true;
+    part.socket->disconnect(this);
+    part.socket->disconnectFromHost();
+    part.file->close();
+
+    if (++confirmed == parts.size()) {
+        emit newDebugMessage(QString("All %1 parts of file %2 were saved on server").arg(parts.size()).arg(path));
+        completed = true;
+        close();
+        emit finished(path, true);
+    }
+}
+
+/**
+ * @brief Stop upload, server keeps received parts
+ * @param message
+ */
+void MultipartUpload::fail(const QString &message)
+{
+    if (completed)
+        return;
+    completed = true;
+
+    emit newWarningMessage(message);
+    close();
+    emit finished(path, false);
+}
+
+/**
+ * @brief Close connections and files of all parts
+ */
+void MultipartUpload::close()
+{
+    for (Part &part : parts) {
+        if (part.socket) {
+            part.socket->disconnect(this);
+            part.socket->abort();
+            part.socket->deleteLater();
+            part.socket = nullptr;
+        }
+        if (part.file) {
+            part.file->close();
+            part.file->deleteLater();
+            part.file = nullptr;
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef MULTIPARTUPLOAD_H
+#define MULTIPARTUPLOAD_H
+
+#include <QObject>
+
+#include <QTcpSocket>
+#include <QFile>
+#include <QVector>
+
+#include "protocol.h"
+
+/**
+ * @brief Upload of one big file in parts over several connections at once
+ *
+ * @details File is split into equal parts, every part is sent over its own connection: Protocol::HaveHash
+ * with Protocol::Multipart flag opens part (see Protocol::FilePart), server answers how much of part it has,
+ * then chunks of part are sent in Protocol::Save frames with their offsets in the whole file.
+ * Server assembles parts at their offsets and adds file into table, when all parts have arrived.
+ * If any connection fails, the whole upload fails, server keeps received parts, so the next attempt resumes them.
+ */
+class MultipartUpload : public QObject
+{
+    Q_OBJECT
+public:
+    MultipartUpload(const QString &filePath, const QByteArray &hash, int connections, QObject *parent = nullptr);
+    ~MultipartUpload();
+
+    void start(const QString &host, int port);
+    QString filePath() const { return path; }
+
+signals:
+    void newDebugMessage(QString);
+    void newWarningMessage(QString);
+    void newCriticalMessage(QString);
+
+    void finished(const QString &filePath, bool ok);
+
+private:
+    /**
+     * @brief Part of file and connection, that sends it
+     */
+    struct Part
+    {
+        QTcpSocket *socket = nullptr;
+        QFile *file = nullptr;          ///< own handle of file, so parts are read independently
+        Protocol::FilePart range;
+        bool hashPending = true;        ///< server hasn't answered yet how much of part it has
+        bool sent = false;              ///< the last chunk of part was written
+        bool done = false;              ///< server has confirmed part
+    };
+
+    void openPart(int index);
+    void readPart(int index);
+    void sendNextChunk(int index);
+    void partAnswered(int index, const Protocol::FrameHeader &header);
+    void fail(const QString &message);
+    void close();
+
+    QString path;                   ///< path of file
+    QByteArray name;                ///< UTF-8 name of file
+    QByteArray hash;                ///< raw SHA-256 of file
+    QVector<Part> parts;
+    int confirmed = 0;              ///< count of parts, that server has confirmed
+    bool completed = false;         ///< finished was emitted
+};
+
+#endif // MULTIPARTUPLOAD_H
@@ -0,0 +1,392 @@
+#include "protocol.h"
+
+#include <QtEndian>
+#include <QDataStream>
+
+#include <cmath>
+
+namespace Protocol {
+
+/**
+ * @brief Encode fixed part of header into FixedHeaderSize bytes
+ * @param header
+ * @param out buffer of at least FixedHeaderSize bytes
+ */
+void encodeHeader(const FrameHeader &header, char *out)
+{
+    uchar *data = reinterpret_cast<uchar*>(out);
+    data[0] = header.version;
+    data[1] = header.opcode;
+    qToBigEndian<quint16>(header.flags, data + 2);
+    qToBigEndian<quint32>(header.requestId, data + 4);
+    qToBigEndian<quint64>(header.offset, data + 8);
+    qToBigEndian<quint64>(header.length, data + 16);
+    qToBigEndian<quint16>(header.nameSize, data + 24);
+}
+
+/**
+ * @brief Decode fixed part of header from FixedHeaderSize bytes
+ * @param in buffer of at least FixedHeaderSize bytes
+ * @param header
+ * @return false if header has unknown version or too big payload
+ */
+bool decodeHeader(const char *in, FrameHeader &header)
+{
+    const uchar *data = reinterpret_cast<const uchar*>(in);
+    header.version = data[0];
+    header.opcode = data[1];
+    header.flags = qFromBigEndian<quint16>(data + 2);
+    header.requestId = qFromBigEndian<quint32>(data + 4);
+    header.offset = qFromBigEndian<quint64>(data + 8);
+    header.length = qFromBigEndian<quint64>(data + 16);
+    header.nameSize = qFromBigEndian<quint16>(data + 24);
+
+    return header.version == Version && header.length <= MaxPayloadSize;
+}
+
+/**
+ * @brief Write one frame into device
+ * @param device
+ * @param opcode
+ * @param flags
+ * @param requestId
+ * @param name UTF-8 name, e.g. name of file. Can be empty
+ * @param payload
+ * @param size size of payload
+ * @param offset position of payload in file for chunks of files
+ * @return true if the whole frame was written
+ */
+bool writeFrame(QIODevice *device, quint8 opcode, quint16 flags, quint32 requestId,
+                const QByteArray &name, const char *payload, qint64 size, quint64 offset)
+{
+    if (name.size() > MaxNameSize || quint64(size) > MaxPayloadSize)
+        return false;
+
+    FrameHeader header;
+    header.opcode = opcode;
+    header.flags = flags;
+    header.requestId = requestId;
+    header.offset = offset;
+    header.length = quint64(size);
+    header.nameSize = quint16(name.size());
+
+    char fixed[FixedHeaderSize];
+    encodeHeader(header, fixed);
+
+    bool ok = device->write(fixed, FixedHeaderSize) == FixedHeaderSize;
+    if (ok && !name.isEmpty())
+        ok = device->write(name) == name.size();
+    if (ok && size > 0)
+        ok = device->write(payload, size) == size;
+
+    return ok;
+}
+
+/**
+ * @brief Read one frame from device if it has arrived completely
+ *
+ * @details Payload with Compressed flag is decompressed, frame that can't be decompressed is bad.
+ * Frame with bigger payload than maxPayloadSize is bad as soon as its header has arrived, before its payload is buffered.
+ *
+ * @param device
+ * @param header decoded header of read frame
+ * @param name UTF-8 name of read frame
+ * @param payload payload of read frame
+ * @param maxPayloadSize maximum size of payload before and after decompression
+ * @return status of reading
+ */
+ReadStatus readFrame(QIODevice *device, FrameHeader &header, QByteArray &name, QByteArray &payload, quint64 maxPayloadSize)
+{
+    char fixed[FixedHeaderSize];
+    if (device->peek(fixed, FixedHeaderSize) < FixedHeaderSize)
+        return NeedMoreData;
+
+    if (!decodeHeader(fixed, header) || header.length > maxPayloadSize)
+        return BadFrame;
+
+    if (device->bytesAvailable() < header.frameSize())
+        return NeedMoreData;
+
+    device->read(fixed, FixedHeaderSize);
+    name = device->read(header.nameSize);
+    payload = device->read(qint64(header.length));
+
+    if (header.flags & Compressed) {
+        // qCompress prefixes data with its big-endian size, that is checked before memory is allocated
+        if (payload.size() < 4 || qFromBigEndian<quint32>(payload.constData()) > maxPayloadSize)
+            return BadFrame;
+        payload = qUncompress(payload);
+        if (payload.isEmpty())
+            return BadFrame;
+    }
+
+    return FrameRead;
+}
+
+/**
+ * @brief Encode payload of Table and TableDelta frames
+ *
+ * @details Table carries all rows and sequence number of the last of them,
+ * TableDelta carries appended rows and sequence number of the last of them
+ *
+ * @param sequence sequence number of the last row
+ * @param rows
+ * @return
+ */
+QByteArray encodeTable(quint64 sequence, const QVector<TableRow> &rows)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_9);
+
+    out << sequence << quint32(rows.size());
+    for (const TableRow &row : rows)
+        out << row.dateTime << row.fileName << row.link << row.size;
+
+    return payload;
+}
+
+/**
+ * @brief Decode payload of Table and TableDelta frames
+ * @param payload
+ * @param sequence sequence number of the last row
+ * @param rows
+ * @return false if payload is malformed
+ */
+bool decodeTable(const QByteArray &payload, quint64 &sequence, QVector<TableRow> &rows)
+{
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_5_9);
+
+    quint32 count = 0;
+    in >> sequence >> count;
+
+    rows.clear();
+    rows.reserve(int(qMin<quint32>(count, quint32(payload.size()))));
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        TableRow row;
+        in >> row.dateTime >> row.fileName >> row.link >> row.size;
+        rows.append(row);
+    }
+
+    return in.status() == QDataStream::Ok;
+}
+
+/**
+ * @brief Estimate by sample of data if compression is worth trying
+ *
+ * @details Shannon entropy of bytes is computed on a few slices spread over data. Archives, images
+ * and other already compressed data is close to 8 bits per byte, so it isn't compressed again
+ *
+ * @param data
+ * @param size
+ * @return
+ */
+bool isCompressible(const char *data, qint64 size)
+{
+    const qint64 sliceCount = 16;
+    const qint64 sliceSize = 256;
+
+    quint32 histogram[256] = {};
+    qint64 sampled = 0;
+    qint64 step = qMax(size / sliceCount, sliceSize);
+    for (qint64 start = 0; start < size; start += step) {
+        qint64 end = qMin(start + sliceSize, size);
+        for (qint64 i = start; i < end; ++i)
+            ++histogram[quint8(data[i])];
+        sampled += end - start;
+    }
+
+    if (sampled == 0)
+        return false;
+
+    double entropy = 0;
+    for (quint32 count : histogram) {
+        if (count > 0) {
+            double p = double(count) / sampled;
+            entropy -= p * std::log2(p);
+        }
+    }
+
+    return entropy < 7.5;
+}
+
+/**
+ * @brief Compress payload with Zlib codec if it is worth it
+ * @param data
+ * @param size
+ * @return compressed payload or empty array if payload should be sent as is
+ */
+QByteArray compressPayload(const char *data, qint64 size)
+{
+    if (size < MinCompressSize || !isCompressible(data, size))
+        return QByteArray();
+
+    QByteArray compressed = qCompress(reinterpret_cast<const uchar*>(data), int(size), CompressionLevel);
+    if (compressed.size() >= size)
+        return QByteArray();
+
+    return compressed;
+}
+
+/**
+ * @brief Encode payload of Load request
+ * @param ranges ranges of files to load
+ * @return
+ */
+QByteArray encodeRanges(const QVector<FileRange> &ranges)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_9);
+
+    out << quint32(ranges.size());
+    for (const FileRange &range : ranges)
+        out << range.fileName << range.offset << range.length;
+
+    return payload;
+}
+
+/**
+ * @brief Decode payload of Load request
+ * @param payload
+ * @param ranges ranges of files to load
+ * @return false if payload is malformed
+ */
+bool decodeRanges(const QByteArray &payload, QVector<FileRange> &ranges)
+{
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_5_9);
+
+    quint32 count = 0;
+    in >> count;
+
+    ranges.clear();
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        FileRange range;
+        in >> range.fileName >> range.offset >> range.length;
+        ranges.append(range);
+    }
+
+    return in.status() == QDataStream::Ok;
+}
+
+/**
+ * @brief Encode payload of HaveHash request, that opens upload of part
+ * @param hash raw SHA-256 of the whole file
+ * @param part
+ * @return
+ */
+QByteArray encodePart(const QByteArray &hash, const FilePart &part)
+{
+    QByteArray payload = hash;
+    QDataStream out(&payload, QIODevice::WriteOnly | QIODevice::Append);
+    out.setVersion(QDataStream::Qt_5_9);
+
+    out << part.fileSize << part.offset << part.length;
+    return payload;
+}
+
+/**
+ * @brief Decode payload of HaveHash request, that opens upload of part
+ * @param payload
+ * @param hash raw SHA-256 of the whole file
+ * @param part
+ * @return false if payload is malformed or part is out of file
+ */
+bool decodePart(const QByteArray &payload, QByteArray &hash, FilePart &part)
+{
+    if (payload.size() < HashSize)
+        return false;
+    hash = payload.left(HashSize);
+
+    QDataStream in(payload.mid(HashSize));
+    in.setVersion(QDataStream::Qt_5_9);
+    in >> part.fileSize >> part.offset >> part.length;
+
+    return in.status() == QDataStream::Ok && part.fileSize > 0 && part.offset >= 0 && part.length > 0
+            && part.length <= part.fileSize - part.offset;
+}
+
+/**
+ * @brief Encode payload of Query request
+ * @param query
+ * @return
+ */
+QByteArray encodeQuery(const Query &query)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_9);
+
+    out << query.order << query.from << query.to << query.prefix << query.substring
+        << query.offset << query.limit << query.cursor;
+
+    return payload;
+}
+
+/**
+ * @brief Decode payload of Query request
+ * @param payload
+ * @param query
+ * @return false if payload is malformed
+ */
+bool decodeQuery(const QByteArray &payload, Query &query)
+{
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_5_9);
+
+    in >> query.order >> query.from >> query.to >> query.prefix >> query.substring
+       >> query.offset >> query.limit >> query.cursor;
+
+    return in.status() == QDataStream::Ok;
+}
+
+/**
+ * @brief Encode answer to Query request
+ * @param sequence sequence number of the last change of table, when page was taken
+ * @param cursor cursor of the next page, empty if there are no more rows
+ * @param rows
+ * @return
+ */
+QByteArray encodeQueryResult(quint64 sequence, const QByteArray &cursor, const QVector<TableRow> &rows)
+{
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_9);
+
+    out << sequence << cursor << quint32(rows.size());
+    for (const TableRow &row : rows)
+        out << row.dateTime << row.fileName << row.link << row.size;
+
+    return payload;
+}
+
+/**
+ * @brief Decode answer to Query request
+ * @param payload
+ * @param sequence sequence number of the last change of table, when page was taken
+ * @param cursor cursor of the next page, empty if there are no more rows
+ * @param rows
+ * @return false if payload is malformed
+ */
+bool decodeQueryResult(const QByteArray &payload, quint64 &sequence, QByteArray &cursor, QVector<TableRow> &rows)
+{
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_5_9);
+
+    quint32 count = 0;
+    in >> sequence >> cursor >> count;
+
+    rows.clear();
+    rows.reserve(int(qMin<quint32>(count, MaxQueryRows)));
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; ++i) {
+        TableRow row;
+        in >> row.dateTime >> row.fileName >> row.link >> row.size;
+        rows.append(row);
+    }
+
+    return in.status() == QDataStream::Ok;
+}
+
+}
@@ -0,0 +1,192 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+
+#include <QByteArray>
+#include <QIODevice>
+#include <QString>
+#include <QVector>
+
+/**
+ * @brief Binary framing shared by client and server
+ *
+ * @details Every message is a frame: fixed part of header, UTF-8 name and payload.
+ * Fixed part has layout (all numbers are big-endian):
+ *
+ * | offset | size | field     |
+ * |--------|------|-----------|
+ * | 0      | 1    | version   |
+ * | 1      | 1    | opcode    |
+ * | 2      | 2    | flags     |
+ * | 4      | 4    | requestId |
+ * | 8      | 8    | offset    |
+ * | 16     | 8    | length    |
+ * | 24     | 2    | nameSize  |
+ */
+namespace Protocol {
+
+const quint8 Version = 2;                           ///< version of frame header
+const int FixedHeaderSize = 26;                     ///< size of fixed part of frame header
+const int MaxNameSize = 0xFFFF;                     ///< maximum size of UTF-8 name in bytes
+const qint64 ChunkSize = 64 * 1024;                 ///< maximum size of file data sent in one frame
+const quint64 MaxPayloadSize = 64 * 1024 * 1024;    ///< frames with bigger payload are rejected
+const int HashSize = 32;                            ///< size of raw SHA-256, that identifies content of file
+const int MinCompressSize = 512;                    ///< smaller payloads are never compressed
+const int CompressionLevel = 1;                     ///< zlib level, the fastest one is enough for logs and tables
+const quint32 MaxQueryRows = 10000;                 ///< maximum count of rows in one page of Query
+
+/**
+ * @brief Kind of frame
+ */
+enum Opcode : quint8 {
+    Save    = 1,    ///< client sends chunk of file to save on server, server confirms that file was saved
+    Table   = 2,    ///< client requests table of saved files, server sends it
+    Load    = 3,    ///< client sends ranges of files to load, server sends chunk of file or end of the request
+    TableDelta = 4, ///< server sends rows that were appended to table since the previous sequence number
+    HaveHash = 5,   ///< client opens upload with SHA-256 of file, server answers if it already has such content
+                    ///< or how many bytes of it were received before (in offset), see Delta flag.
+                    ///< Several requests may be sent ahead, server opens their uploads one after another
+    Hello   = 6,    ///< client sends codecs it supports, server answers with the chosen one
+    Stats   = 7,    ///< client requests metrics, server sends them in Prometheus text exposition format
+    Query   = 8,    ///< client requests a page of table with filters, see Query, server answers with encodeQueryResult
+    Patch   = 9,    ///< client sends part of file as difference to stored file with the same name, see DeltaSync,
+                    ///< offset is position of part in file, server answers with Save when the last part was received
+};
+
+/**
+ * @brief Compression of payloads, that is negotiated per connection by Hello frames
+ */
+enum Codec : quint8 {
+    Identity    = 0,    ///< payloads are sent as is
+    Zlib        = 1,    ///< payloads may be compressed with qCompress
+};
+
+/**
+ * @brief Bits of FrameHeader::flags
+ */
+enum Flag : quint16 {
+    NoFlags     = 0x0,
+    LastChunk   = 0x1,  ///< frame carries the last chunk of file
+    Found       = 0x2,  ///< answer to HaveHash: content is already stored, file was saved without upload
+    Failed      = 0x4,  ///< answer to Save, HaveHash, Load or Query: file wasn't saved, upload can't be opened, file can't be sent or query is malformed
+    BatchDone   = 0x8,  ///< Load frame without name and payload: all files of the request were sent
+    Compressed  = 0x10, ///< payload is compressed with negotiated codec, readFrame returns it decompressed
+    Delta       = 0x20, ///< HaveHash of client: file may be sent as difference. Answer: payload has signatures of stored file
+                        ///< with the same name (see DeltaSync::encodeSignatures), file is sent in Patch frames
+    Multipart   = 0x40, ///< HaveHash of client: payload has hash and FilePart, upload sends only this part of file, see FilePart
+};
+
+/**
+ * @brief Decoded fixed part of frame header
+ */
+struct FrameHeader
+{
+    quint8 version = Version;
+    quint8 opcode = 0;
+    quint16 flags = NoFlags;
+    quint32 requestId = 0;  ///< id of request, frames of response carry id of their request
+    quint64 offset = 0;     ///< position of payload in file for chunks of files, 0 for other frames
+    quint64 length = 0;     ///< size of payload, that follows name
+    quint16 nameSize = 0;   ///< size of UTF-8 name, that follows fixed part of header
+
+    qint64 frameSize() const { return FixedHeaderSize + nameSize + length; }
+};
+
+/**
+ * @brief Row of table of saved files
+ */
+struct TableRow
+{
+    QString dateTime;   ///< date and time when file was saved
+    QString fileName;   ///< name of file
+    QString link;       ///< link to file on server
+    qint64 size = 0;    ///< size of file in bytes
+};
+
+/**
+ * @brief Range of file to load
+ */
+struct FileRange
+{
+    QString fileName;   ///< name of file
+    qint64 offset = 0;  ///< position of the first byte to load
+    qint64 length = -1; ///< count of bytes to load, -1 means up to the end of file
+};
+
+/**
+ * @brief Part of file, that is uploaded over its own connection
+ *
+ * @details Parts of one file are identified by its hash and may be sent concurrently. Chunks of part
+ * have their offsets in the whole file, every part is confirmed by Save answer, and the answer
+ * to the part, that completes file, comes after file was stored and added into table.
+ */
+struct FilePart
+{
+    qint64 fileSize = 0;    ///< size of the whole file
+    qint64 offset = 0;      ///< position of the first byte of part in file
+    qint64 length = 0;      ///< size of part
+};
+
+/**
+ * @brief Order of rows in result of Query
+ */
+enum QueryOrder : quint8 {
+    SaveOrder   = 0,    ///< order of the first save of files, as in Table
+    NewestFirst = 1,    ///< the latest saves first
+    NameOrder   = 2,    ///< names in ascending order
+};
+
+/**
+ * @brief Request of one page of table
+ *
+ * @details All filters must match. Page continues after the last row of the previous page, if its cursor is passed,
+ * then offset rows are skipped and at most limit rows are returned.
+ */
+struct Query
+{
+    quint8 order = SaveOrder;   ///< see QueryOrder
+    qint64 from = 0;            ///< only files saved at or after this time, milliseconds since epoch, 0 means no bound
+    qint64 to = 0;              ///< only files saved before this time, milliseconds since epoch, 0 means no bound
+    QString prefix;             ///< only names that start with prefix
+    QString substring;          ///< only names that contain substring, case-insensitive
+    quint32 offset = 0;         ///< count of matching rows to skip
+    quint32 limit = 0;          ///< maximum count of rows, 0 or more than MaxQueryRows means MaxQueryRows
+    QByteArray cursor;          ///< cursor of the previous page, empty for the first page
+};
+
+/**
+ * @brief Result of readFrame
+ */
+enum ReadStatus {
+    FrameRead,      ///< whole frame was read
+    NeedMoreData,   ///< frame hasn't arrived completely yet, nothing was read
+    BadFrame,       ///< header is malformed, connection can't be used anymore
+};
+
+void encodeHeader(const FrameHeader &header, char *out);
+bool decodeHeader(const char *in, FrameHeader &header);
+
+bool writeFrame(QIODevice *device, quint8 opcode, quint16 flags, quint32 requestId,
+                const QByteArray &name, const char *payload = nullptr, qint64 size = 0, quint64 offset = 0);
+ReadStatus readFrame(QIODevice *device, FrameHeader &header, QByteArray &name, QByteArray &payload, quint64 maxPayloadSize = MaxPayloadSize);
+
+QByteArray encodeTable(quint64 sequence, const QVector<TableRow> &rows);
+bool decodeTable(const QByteArray &payload, quint64 &sequence, QVector<TableRow> &rows);
+
+bool isCompressible(const char *data, qint64 size);
+QByteArray compressPayload(const char *data, qint64 size);
+
+QByteArray encodeRanges(const QVector<FileRange> &ranges);
+bool decodeRanges(const QByteArray &payload, QVector<FileRange> &ranges);
+
+QByteArray encodePart(const QByteArray &hash, const FilePart &part);
+bool decodePart(const QByteArray &payload, QByteArray &hash, FilePart &part);
+
+QByteArray encodeQuery(const Query &query);
+bool decodeQuery(const QByteArray &payload, Query &query);
+QByteArray encodeQueryResult(quint64 sequence, const QByteArray &cursor, const QVector<TableRow> &rows);
+bool decodeQueryResult(const QByteArray &payload, quint64 &sequence, QByteArray &cursor, QVector<TableRow> &rows);
+
+}
+
+#endif // PROTOCOL_H
@@ -0,0 +1,77 @@
+#include "blobstore.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+#include "durability.h"
+
+/**
+ * @brief BlobStore::BlobStore
+ * @param dirOfSavedFiles full path to dir, where saved files are stored
+ */
+BlobStore::BlobStore(const QString &dirOfSavedFiles)
+    : blobsDir(dirOfSavedFiles + "/blobs")
+{
+}
+
+/**
+ * @brief Create directory of blobs
+ * @return false if directory can't be created
+ */
+bool BlobStore::init()
+{
+    return QDir().mkpath(blobsDir);
+}
+
+/**
+ * @brief Path of blob with given content hash
+ * @param hash raw SHA-256 of content
+ * @return
+ */
+QString BlobStore::pathOf(const QByteArray &hash) const
+{
+    QString hex = QString::fromLatin1(hash.toHex());
+    return QString("%1/%2/%3").arg(blobsDir).arg(hex.left(2)).arg(hex);
+}
+
+/**
+ * @brief Check if content with given hash is already stored
+ * @param hash raw SHA-256 of content
+ * @return
+ */
+bool BlobStore::contains(const QByteArray &hash) const
+{
+    return QFileInfo::exists(pathOf(hash));
+}
+
+/**
+ * @brief Move completely received upload into blobs
+ *
+ * @details If the same content is already stored, upload is just removed
+ *
+ * @param incomingPath path of received upload
+ * @param hash raw SHA-256 of upload
+ * @param blobPath path of blob with content of upload
+ * @return false if upload can't be moved
+ */
+bool BlobStore::commit(const QString &incomingPath, const QByteArray &hash, QString &blobPath)
+{
+    blobPath = pathOf(hash);
+    if (QFileInfo::exists(blobPath)) {
+        QFile::remove(incomingPath);
+        return true;
+    }
+
+    QDir().mkpath(QFileInfo(blobPath).absolutePath());
+    if (Durability::replaceFile(incomingPath, blobPath))
+        return true;
+
+    // the same content could be committed by another worker right now
+    if (QFileInfo::exists(blobPath)) {
+        QFile::remove(incomingPath);
+        return true;
+    }
+
+    return false;
+}
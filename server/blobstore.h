@@ -0,0 +1,30 @@
+#ifndef BLOBSTORE_H
+#define BLOBSTORE_H
+
+#include <QString>
+#include <QByteArray>
+
+/**
+ * @brief Content-addressed storage of saved files
+ *
+ * @details Every unique content is stored once under blobs/<first 2 hex digits>/<SHA-256 in hex>,
+ * catalog entries of files with the same content refer to the same blob. Uploads are received
+ * into partial files (see UploadSessions) and moved into blobs when their hash is known.
+ *
+ * Methods can be called from any thread, blobs are only created by atomic renames.
+ */
+class BlobStore
+{
+public:
+    explicit BlobStore(const QString &dirOfSavedFiles);
+
+    bool init();
+    QString pathOf(const QByteArray &hash) const;
+    bool contains(const QByteArray &hash) const;
+    bool commit(const QString &incomingPath, const QByteArray &hash, QString &blobPath);
+
+private:
+    QString blobsDir;       ///< full path to dir with blobs
+};
+
+#endif // BLOBSTORE_H
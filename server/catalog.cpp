@@ -0,0 +1,769 @@
+#include "catalog.h"
+#include "catalogfile.h"
+#include "durability.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QStringList>
+#include <QDateTime>
+#include <QDataStream>
+#include <QElapsedTimer>
+
+#include <iterator>
+#include <limits>
+
+static const char DateTimeFormat[] = "dd.MM.yyyy/hh:mm:ss.zzz";     ///< format of date/time in table file
+static const char LinkPrefix[] = "file:///";                        ///< prefix of links in table file
+static const int RecentRowsLimit = 4096;                            ///< count of recent rows, that are kept for deltas
+static const quint64 CompactionMinRows = 16384;                     ///< shorter log is never compacted
+
+/**
+ * @brief Take entries of all positions from snapshot and changes after it
+ * @param reader mapped snapshot, nullptr if there is none
+ * @param changes position -> entry, that overrides record of snapshot
+ * @param count count of positions
+ * @param entries entries in order of positions
+ * @return false if record of snapshot is malformed
+ */
+static bool collect(const CatalogFile::SnapshotReader *reader, const QHash<int, CatalogEntry> &changes, int count, QVector<CatalogEntry> &entries)
+{
+    entries.resize(count);
+    for (int position = 0; position < count; ++position) {
+        QHash<int, CatalogEntry>::const_iterator it = changes.constFind(position);
+        if (it != changes.constEnd())
+            entries[position] = it.value();
+        else if (!reader || !reader->entry(quint64(position), entries[position]))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Catalog::Catalog
+ * @param pathToCatalog full path to files of catalog without extension, snapshot gets ".bin" and log gets ".log"
+ * @param dirOfSavedFiles full path to dir, where saved files are stored
+ * @param parent
+ */
+Catalog::Catalog(const QString &pathToCatalog, const QString &dirOfSavedFiles, QObject *parent)
+    : QObject(parent)
+    , pathToSnapshot(pathToCatalog + ".bin")
+    , pathToLog(pathToCatalog + ".log")
+    , pathToRotatedLog(pathToCatalog + ".log.old")
+    , dirOfSavedFiles(dirOfSavedFiles)
+    , logFile(pathToLog)
+{
+}
+
+/**
+ * @brief Load snapshot and replay logs into memory, or migrate text table file, if catalog doesn't exist yet
+ *
+ * @details Sequence numbers continue from the one, that snapshot has, every replayed record is a change.
+ * Log, that was being compacted when server stopped, is replayed before the current one.
+ *
+ * @param pathToTableFile full path to text table file of older servers
+ * @return false if catalog can't be read or migrated, server can't work then
+ */
+bool Catalog::open(const QString &pathToTableFile)
+{
+    QMutexLocker locker(&mutex);
+
+    bool exists = QFile::exists(pathToSnapshot) || QFile::exists(pathToLog) || QFile::exists(pathToRotatedLog);
+    if (!exists && QFile::exists(pathToTableFile)) {
+        if (!migrate(pathToTableFile))
+            return false;
+    } else if (!loadSnapshot() || !replayLog(pathToRotatedLog) || !replayLog(pathToLog))
+        return false;
+
+    // file is kept open, so appends don't pay for open and close
+    if (!logFile.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        emit newCriticalMessage(QString("Can't open file %1 to append!").arg(pathToLog));
+        return false;
+    }
+
+    emit newInfoMessage(QString("Catalog was loaded with %1 files, %2 changes").arg(entryCount).arg(sequence));
+    return true;
+}
+
+/**
+ * @brief Check if log has grown enough to be compacted into snapshot
+ * @return
+ */
+bool Catalog::isCompactionDue()
+{
+    QMutexLocker locker(&mutex);
+    return !compacting && logRows >= qMax(CompactionMinRows, quint64(entryCount) / 4);
+}
+
+/**
+ * @brief Write all entries into new snapshot, so startup doesn't replay the whole history of saves
+ *
+ * @details Log is rotated under lock after all its records were synced and inserted into changes,
+ * then snapshot is written without lock from the mapped one and a copy of changes, while appends go into a new log.
+ * New snapshot is mapped and changes, that it has, are dropped from memory.
+ * Rotated log is removed after snapshot has replaced the old one, if server stops before that,
+ * rotated log is replayed on startup, replay of entries is idempotent.
+ *
+ * @return false if snapshot wasn't written, rotated log is kept then
+ */
+bool Catalog::compact()
+{
+    QSharedPointer<CatalogFile::SnapshotReader> reader;
+    QHash<int, CatalogEntry> copy;
+    int copyCount = 0;
+    quint64 copySequence = 0;
+    {
+        QMutexLocker locker(&mutex);
+        if (compacting)
+            return false;
+
+        // if snapshot of the previous compaction wasn't written, its log is kept and the current one isn't rotated
+        if (!QFile::exists(pathToRotatedLog)) {
+            // lock is released while waiting, so appends may write meanwhile, rotated log must be synced completely
+            // and its records must be in changes, otherwise snapshot misses them and they are lost with rotated log
+            while (pendingRows > 0) {
+                if (syncedRows < writtenRows) {
+                    if (!waitForSync(writtenRows))
+                        return false;
+                } else
+                    rowsInserted.wait(&mutex);
+            }
+
+            logFile.close();
+            bool rotated = Durability::replaceFile(pathToLog, pathToRotatedLog);
+            if (!logFile.open(QIODevice::WriteOnly | QIODevice::Append)) {
+                emit newCriticalMessage(QString("Can't open file %1 to append!").arg(pathToLog));
+                return false;
+            }
+            if (!rotated) {
+                emit newWarningMessage(QString("Can't rotate log of catalog %1").arg(pathToLog));
+                return false;
+            }
+            logRows = 0;
+        }
+
+        compacting = true;
+        reader = mapped;    // snapshot is never changed, so it is read without lock
+        copy = changes;     // changes are shared until the next append
+        copyCount = entryCount;
+        copySequence = sequence;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    QVector<CatalogEntry> entries;
+    bool written = collect(reader.data(), copy, copyCount, entries)
+            && CatalogFile::writeSnapshot(pathToSnapshot, entries, copySequence, dirOfSavedFiles);
+    if (written)
+        QFile::remove(pathToRotatedLog);
+    entries.clear();
+
+    QSharedPointer<CatalogFile::SnapshotReader> compacted(new CatalogFile::SnapshotReader(pathToSnapshot, dirOfSavedFiles));
+    bool opened = written && compacted->open();
+
+    QMutexLocker locker(&mutex);
+    compacting = false;
+    if (!written) {
+        emit newWarningMessage(QString("Can't write snapshot of catalog %1").arg(pathToSnapshot));
+        return false;
+    }
+    // otherwise changes stay in memory and the old snapshot stays mapped, its file is kept by mapping
+    if (opened)
+        adoptSnapshot(compacted, copyCount, copySequence);
+    else
+        emit newWarningMessage(QString("Can't map compacted snapshot of catalog %1, changes are kept in memory").arg(pathToSnapshot));
+    emit newInfoMessage(QString("Catalog was compacted into %1 with %2 files in %3 ms").arg(pathToSnapshot).arg(copyCount).arg(timer.elapsed()));
+    return true;
+}
+
+/**
+ * @brief Add saved file into catalog, append it to table file and broadcast it as delta
+ *
+ * @details Entry is appended to log as binary record (see CatalogFile::encodeLogRecord).
+ * If file with such name is already in catalog, its entry is updated in place.
+ * Record is durable when method returns, records of concurrent appends share one sync (see waitForSync).
+ * Signal appended only notifies workers, they take rows with delta when their broadcast window ends.
+ *
+ * @param fileName name of file as it was sent by client
+ * @param path full path to file on server
+ * @param size size of file in bytes
+ * @param hash raw SHA-256 of content if file is stored in blob store
+ * @return false if row wasn't written to disk
+ */
+bool Catalog::append(const QString &fileName, const QString &path, qint64 size, const QByteArray &hash)
+{
+    QMutexLocker locker(&mutex);
+
+    CatalogEntry entry;
+    entry.fileName = fileName;
+    entry.path = path;
+    entry.size = size;
+    entry.hash = hash;
+    entry.timestamp = QDateTime::currentMSecsSinceEpoch();
+    Protocol::TableRow row = toRow(entry);
+
+    QByteArray record = CatalogFile::encodeLogRecord(entry, dirOfSavedFiles);
+    if (!logFile.isOpen() || logFile.write(record) != record.size()) {
+        emit newWarningMessage(QString("Can't write into log of catalog under path %1 to add new saved file with name %2").arg(pathToLog).arg(fileName));
+        return false;
+    }
+    quint64 rowNumber = ++writtenRows;
+    ++logRows;
+    ++pendingRows;
+
+    bool synced = waitForSync(rowNumber);
+    if (synced)
+        insert(entry);
+    --pendingRows;
+    rowsInserted.wakeAll();
+    if (!synced) {
+        emit newWarningMessage(QString("Can't sync log of catalog under path %1").arg(pathToLog));
+        return false;
+    }
+    emit newInfoMessage(QString("File %1 were added into catalog").arg(fileName));
+
+    recentRows.append(row);
+    if (recentRows.size() >= 2 * RecentRowsLimit)
+        recentRows.remove(0, recentRows.size() - RecentRowsLimit);    // trimmed in bulk, so append stays cheap
+
+    // worker of appending thread is called directly and takes delta, so lock must be released first
+    locker.unlock();
+    emit appended();    // update table on all clients
+    return true;
+}
+
+/**
+ * @brief Wait until row is synced to disk, must be called under lock
+ *
+ * @details Group commit: the first waiter syncs all rows that were written so far without lock,
+ * rows that are written meanwhile are synced by the next waiter in one go. So concurrent appends
+ * share syncs instead of paying one sync each.
+ *
+ * @param rowNumber number of record in log, that was written by caller
+ * @return false if sync failed
+ */
+bool Catalog::waitForSync(quint64 rowNumber)
+{
+    while (syncedRows < rowNumber) {
+        if (syncing) {
+            rowsSynced.wait(&mutex);
+            continue;
+        }
+
+        syncing = true;
+        quint64 target = writtenRows;
+        bool synced = logFile.flush();
+        int handle = logFile.handle();
+
+        mutex.unlock();
+        synced = synced && Durability::syncHandle(handle);
+        mutex.lock();
+
+        syncing = false;
+        if (synced)
+            syncedRows = target;
+        rowsSynced.wakeAll();
+        if (!synced)
+            return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Find entry of file
+ * @param fileName name of file as it was sent by client
+ * @param entry found entry
+ * @return false if there is no such file
+ */
+bool Catalog::find(const QString &fileName, CatalogEntry &entry)
+{
+    QMutexLocker locker(&mutex);
+
+    int position = positionOf(fileName);
+    return position >= 0 && entryAt(position, entry);
+}
+
+/**
+ * @brief Return all rows of table with sequence number of the last change
+ *
+ * @details Snapshot is encoded once and reused until the next change
+ *
+ * @return payload of Protocol::Table
+ */
+QByteArray Catalog::snapshot()
+{
+    QMutexLocker locker(&mutex);
+
+    if (cachedSnapshot.isEmpty()) {
+        QVector<Protocol::TableRow> rows;
+        rows.reserve(entryCount);
+        CatalogEntry entry;
+        for (int position = 0; position < entryCount; ++position) {
+            if (entryAt(position, entry))
+                rows.append(toRow(entry));
+        }
+        cachedSnapshot = Protocol::encodeTable(sequence, rows);
+    }
+
+    return cachedSnapshot;
+}
+
+/**
+ * @brief Return sequence number of the last change
+ * @return
+ */
+quint64 Catalog::lastSequence()
+{
+    QMutexLocker locker(&mutex);
+    return sequence;
+}
+
+/**
+ * @brief Encode rows of all changes after given one into one delta
+ * @param since sequence number of the last change, that client already has
+ * @param payload payload of Protocol::TableDelta, empty if there are no changes after since
+ * @param last sequence number of the last change in payload
+ * @return false if rows after since aren't kept anymore, so client needs the whole table
+ */
+bool Catalog::delta(quint64 since, QByteArray &payload, quint64 &last)
+{
+    QMutexLocker locker(&mutex);
+
+    payload.clear();
+    last = sequence;
+    if (since >= sequence)
+        return true;
+    if (sequence - since > quint64(recentRows.size()))
+        return false;
+
+    int count = int(sequence - since);
+    payload = Protocol::encodeTable(sequence, recentRows.mid(recentRows.size() - count));
+    return true;
+}
+
+/**
+ * @brief Take one page of table
+ *
+ * @details Rows are walked in requested order through the index, that fits it: position for Protocol::SaveOrder,
+ * time for Protocol::NewestFirst (so time range bounds the walk) and name for Protocol::NameOrder
+ * (so prefix bounds the walk). Index of snapshot and index of changes are merged, records of snapshot,
+ * that were saved again, are skipped in time index. Other filters are checked on every visited entry.
+ * Cursor holds time, position and name of the last row of page, so the next page continues after it
+ * even if rows were added in between.
+ *
+ * @param query
+ * @param result payload of answer to Protocol::Query, see Protocol::encodeQueryResult
+ * @return false if cursor is malformed or points outside of table
+ */
+bool Catalog::query(const Protocol::Query &query, QByteArray &result)
+{
+    QMutexLocker locker(&mutex);
+
+    quint32 limit = (query.limit == 0 || query.limit > Protocol::MaxQueryRows) ? Protocol::MaxQueryRows : query.limit;
+    quint32 skip = query.offset;
+
+    bool hasCursor = !query.cursor.isEmpty();
+    qint64 cursorTimestamp = 0;
+    qint32 cursorPosition = -1;
+    QString cursorName;
+    if (hasCursor) {
+        QDataStream in(query.cursor);
+        in.setVersion(QDataStream::Qt_5_9);
+        in >> cursorTimestamp >> cursorPosition >> cursorName;
+        // cursor comes from client, position must refer to an entry
+        if (in.status() != QDataStream::Ok || cursorPosition < -1 || cursorPosition >= entryCount)
+            return false;
+    }
+
+    QVector<Protocol::TableRow> rows;
+    int lastPosition = -1;
+    CatalogEntry last;
+    bool more = false;
+
+    // returns false when page is full
+    auto visit = [&](int position) {
+        CatalogEntry entry;
+        if (!entryAt(position, entry) || !matches(entry, query))
+            return true;
+        if (skip > 0) {
+            --skip;
+            return true;
+        }
+        if (quint32(rows.size()) == limit) {
+            more = true;
+            return false;
+        }
+        rows.append(toRow(entry));
+        lastPosition = position;
+        last = entry;
+        return true;
+    };
+
+    switch (query.order) {
+    case Protocol::NewestFirst: {
+        QPair<qint64, int> bound = hasCursor ? qMakePair(cursorTimestamp, int(cursorPosition))
+                                             : qMakePair(query.to > 0 ? query.to : std::numeric_limits<qint64>::max(), -1);
+        QMap<QPair<qint64, int>, int>::const_iterator it = byTime.lowerBound(bound);
+        quint64 rank = mapped ? mapped->lowerBoundTime(bound.first, bound.second) : 0;
+        forever {
+            while (rank > 0 && changes.contains(int(mapped->timeAt(rank - 1))))
+                --rank;
+
+            // the later of both indexes goes first
+            QPair<qint64, int> key;
+            if (rank > 0) {
+                quint64 record = mapped->timeAt(rank - 1);
+                key = qMakePair(mapped->timestamp(record), int(record));
+            }
+            if (it != byTime.constBegin() && (rank == 0 || std::prev(it).key() > key)) {
+                --it;
+                key = it.key();
+            } else if (rank > 0)
+                --rank;
+            else
+                break;
+
+            if (query.from > 0 && key.first < query.from)
+                break;
+            if (!visit(key.second))
+                break;
+        }
+        break;
+    }
+    case Protocol::NameOrder: {
+        bool after = hasCursor && cursorName >= query.prefix;
+        const QString &start = after ? cursorName : query.prefix;
+        QMap<QString, int>::const_iterator it = after ? byName.upperBound(start) : byName.lowerBound(start);
+        quint64 rank = 0;
+        quint64 ranks = mapped ? mapped->count() : 0;
+        if (ranks > 0)
+            rank = after ? mapped->upperBoundName(start) : mapped->lowerBoundName(start);
+        forever {
+            // the smaller name of both indexes goes first, names of changes aren't in snapshot
+            QString name;
+            int position = -1;
+            if (rank < ranks) {
+                position = int(mapped->nameAt(rank));
+                name = mapped->name(quint64(position));
+            }
+            if (it != byName.constEnd() && (rank == ranks || it.key() < name)) {
+                name = it.key();
+                position = it.value();
+                ++it;
+            } else if (rank < ranks)
+                ++rank;
+            else
+                break;
+
+            if (!name.startsWith(query.prefix))
+                break;
+            if (!visit(position))
+                break;
+        }
+        break;
+    }
+    default:
+        for (int position = hasCursor ? cursorPosition + 1 : 0; position < entryCount; ++position) {
+            if (!visit(position))
+                break;
+        }
+        break;
+    }
+
+    QByteArray cursor;
+    if (more) {
+        QDataStream out(&cursor, QIODevice::WriteOnly);
+        out.setVersion(QDataStream::Qt_5_9);
+        out << last.timestamp << qint32(lastPosition) << last.fileName;
+    }
+
+    result = Protocol::encodeQueryResult(sequence, cursor, rows);
+    return true;
+}
+
+/**
+ * @brief Return snapshot compressed with Protocol::Zlib codec
+ *
+ * @details Table is resent to every client on connect and after missed deltas, so it is compressed once
+ * and reused until the next change
+ *
+ * @return compressed payload of Protocol::Table or empty array if snapshot isn't worth compressing
+ */
+QByteArray Catalog::compressedSnapshot()
+{
+    QByteArray raw = snapshot();
+
+    QMutexLocker locker(&mutex);
+    if (cachedCompressedSnapshot.isEmpty() && raw.isSharedWith(cachedSnapshot))
+        cachedCompressedSnapshot = Protocol::compressPayload(raw.constData(), raw.size());
+
+    return cachedCompressedSnapshot;
+}
+
+/**
+ * @brief Map snapshot into memory, catalog without snapshot starts empty
+ *
+ * @details Snapshot is checked by its footer and stays mapped, records are decoded when they are looked up.
+ * Snapshot of older version has no indexes, so it is rewritten once.
+ *
+ * @return false if snapshot is corrupted
+ */
+bool Catalog::loadSnapshot()
+{
+    if (!QFile::exists(pathToSnapshot))
+        return true;
+
+    QElapsedTimer timer;
+    timer.start();
+    QSharedPointer<CatalogFile::SnapshotReader> reader(new CatalogFile::SnapshotReader(pathToSnapshot, dirOfSavedFiles));
+    if (!reader->open() || reader->count() > quint64(std::numeric_limits<int>::max())) {
+        emit newCriticalMessage(QString("Snapshot of catalog %1 can't be read or its checksum doesn't match!").arg(pathToSnapshot));
+        return false;
+    }
+
+    if (!reader->hasIndexes()) {
+        QVector<CatalogEntry> entries;
+        if (!collect(reader.data(), QHash<int, CatalogEntry>(), int(reader->count()), entries)
+                || !CatalogFile::writeSnapshot(pathToSnapshot, entries, reader->sequence(), dirOfSavedFiles)) {
+            emit newCriticalMessage(QString("Snapshot of catalog %1 of older version can't be rewritten!").arg(pathToSnapshot));
+            return false;
+        }
+        reader.reset(new CatalogFile::SnapshotReader(pathToSnapshot, dirOfSavedFiles));
+        if (!reader->open()) {
+            emit newCriticalMessage(QString("Rewritten snapshot of catalog %1 can't be read!").arg(pathToSnapshot));
+            return false;
+        }
+        emit newInfoMessage(QString("Snapshot of catalog %1 was rewritten with indexes").arg(pathToSnapshot));
+    }
+
+    mapped = reader;
+    entryCount = int(reader->count());
+    sequence = reader->sequence();
+
+    emit newDebugMessage(QString("Snapshot of catalog with %1 files was mapped in %2 ms").arg(entryCount).arg(timer.elapsed()));
+    return true;
+}
+
+/**
+ * @brief Map snapshot, that was written from entries, and drop its changes from memory, must be called under lock
+ * @param reader opened snapshot
+ * @param snapshotCount count of entries in snapshot
+ * @param snapshotSequence sequence number of the last change, that snapshot has
+ */
+void Catalog::adoptSnapshot(const QSharedPointer<CatalogFile::SnapshotReader> &reader, int snapshotCount, quint64 snapshotSequence)
+{
+    mapped = reader;
+
+    // names of snapshot are found by its index
+    for (QHash<QString, int>::iterator it = index.begin(); it != index.end();) {
+        if (it.value() < snapshotCount) {
+            byName.remove(it.key());
+            it = index.erase(it);
+        } else
+            ++it;
+    }
+
+    // entries, that were saved again after snapshot was taken, keep overriding it
+    for (QHash<int, quint64>::iterator it = changedAt.begin(); it != changedAt.end();) {
+        if (it.value() <= snapshotSequence) {
+            int position = it.key();
+            byTime.remove(qMakePair(changes.value(position).timestamp, position));
+            changes.remove(position);
+            it = changedAt.erase(it);
+        } else
+            ++it;
+    }
+}
+
+/**
+ * @brief Replay records of log into changes
+ *
+ * @details Record, that doesn't match its checksum, was torn by a crash before it was synced,
+ * so it is dropped together with the rest of log and cut off the file.
+ *
+ * @param path full path to log
+ * @return false if log can't be read
+ */
+bool Catalog::replayLog(const QString &path)
+{
+    QVector<CatalogEntry> records;
+    qint64 completeSize = CatalogFile::readLog(path, dirOfSavedFiles, records);
+    if (completeSize < 0) {
+        emit newCriticalMessage(QString("Can't open file %1 to read!").arg(path));
+        return false;
+    }
+
+    for (const CatalogEntry &entry : records)
+        insert(entry);
+    if (path == pathToLog)
+        logRows = quint64(records.size());
+
+    if (completeSize < QFileInfo(path).size()) {
+        emit newWarningMessage(QString("Torn record at the end of %1 was dropped").arg(path));
+        if (!QFile::resize(path, completeSize))
+            emit newWarningMessage(QString("Can't cut torn record off %1").arg(path));
+    }
+    return true;
+}
+
+/**
+ * @brief Convert text table file of older servers into snapshot, table file is renamed then, so it is migrated once
+ *
+ * @details Format of rows is: "dateTime,fileName,link,size[,hash]", where link="file:///path" and hash is SHA-256 in hex
+ * for files in blob store. Name of file may contain commas, so date/time is taken before the first comma and link
+ * after the last ",file:///". Size and hash are optional trailing fields, rows that were written before sizes
+ * were logged get size of file on disk. Row without line break was torn by a crash, so it is dropped.
+ *
+ * @param pathToTableFile full path to table file
+ * @return false if table file can't be read or snapshot can't be written
+ */
+bool Catalog::migrate(const QString &pathToTableFile)
+{
+    QFile file(pathToTableFile);
+    if (!file.open(QIODevice::ReadOnly)) {
+        emit newCriticalMessage(QString("Can't open file %1 to read!").arg(pathToTableFile));
+        return false;
+    }
+
+    while (!file.atEnd()) {
+        QByteArray bytes = file.readLine();
+        if (!bytes.endsWith('\n')) {
+            emit newWarningMessage(QString("Torn row at the end of %1 was dropped").arg(pathToTableFile));
+            break;
+        }
+
+        QString line = QString::fromUtf8(bytes).trimmed();
+        int first = line.indexOf(',');
+        int last = line.lastIndexOf(",file:///");
+        if (first == -1 || last <= first)
+            continue;
+
+        CatalogEntry entry;
+        entry.timestamp = QDateTime::fromString(line.left(first), DateTimeFormat).toMSecsSinceEpoch();
+        entry.fileName = line.mid(first + 1, last - first - 1);
+
+        QStringList fields = line.mid(last + 1).split(',');
+        if (fields.size() >= 3 && fields.last().size() == 2 * Protocol::HashSize)
+            entry.hash = QByteArray::fromHex(fields.takeLast().toLatin1());
+        bool hasSize = false;
+        if (fields.size() >= 2)
+            entry.size = fields.last().toLongLong(&hasSize);
+        if (hasSize)
+            fields.removeLast();
+        QString link = fields.join(',');
+        entry.path = link.mid(int(sizeof(LinkPrefix)) - 1);
+        if (!hasSize)
+            entry.size = QFileInfo(entry.path).size();
+
+        insert(entry);
+    }
+    file.close();
+
+    QVector<CatalogEntry> entries;
+    if (!collect(nullptr, changes, entryCount, entries) || !CatalogFile::writeSnapshot(pathToSnapshot, entries, sequence, dirOfSavedFiles)) {
+        emit newCriticalMessage(QString("Can't write snapshot of catalog %1").arg(pathToSnapshot));
+        return false;
+    }
+    QSharedPointer<CatalogFile::SnapshotReader> reader(new CatalogFile::SnapshotReader(pathToSnapshot, dirOfSavedFiles));
+    if (reader->open())
+        adoptSnapshot(reader, entryCount, sequence);
+
+    QString migratedPath = pathToTableFile + ".migrated";
+    if (!QFile::rename(pathToTableFile, migratedPath))
+        emit newWarningMessage(QString("Can't rename migrated table file %1").arg(pathToTableFile));
+    emit newInfoMessage(QString("Table file %1 with %2 rows was migrated into %3, it is kept as %4")
+                        .arg(pathToTableFile).arg(sequence).arg(pathToSnapshot).arg(migratedPath));
+    return true;
+}
+
+/**
+ * @brief Put entry into changes as the next change, entry of file with the same name is replaced in place
+ * @param entry
+ */
+void Catalog::insert(const CatalogEntry &entry)
+{
+    int position = positionOf(entry.fileName);
+    if (position < 0) {
+        position = entryCount++;
+        index.insert(entry.fileName, position);
+        byName.insert(entry.fileName, position);
+    } else {
+        QHash<int, CatalogEntry>::const_iterator it = changes.constFind(position);
+        if (it != changes.constEnd())
+            byTime.remove(qMakePair(it->timestamp, position));
+    }
+
+    changes.insert(position, entry);
+    changedAt.insert(position, ++sequence);
+    byTime.insert(qMakePair(entry.timestamp, position), position);
+
+    cachedSnapshot.clear();
+    cachedCompressedSnapshot.clear();
+}
+
+/**
+ * @brief Find position of entry of file in changes or in snapshot
+ * @param fileName name of file as it was sent by client
+ * @return -1 if there is no such file
+ */
+int Catalog::positionOf(const QString &fileName) const
+{
+    QHash<QString, int>::const_iterator it = index.constFind(fileName);
+    if (it != index.constEnd())
+        return it.value();
+
+    quint64 record = 0;
+    if (mapped && mapped->find(fileName, record))
+        return int(record);
+    return -1;
+}
+
+/**
+ * @brief Take entry by position, change after snapshot overrides its record
+ * @param position
+ * @param entry
+ * @return false if record of snapshot is malformed
+ */
+bool Catalog::entryAt(int position, CatalogEntry &entry) const
+{
+    QHash<int, CatalogEntry>::const_iterator it = changes.constFind(position);
+    if (it != changes.constEnd()) {
+        entry = it.value();
+        return true;
+    }
+    return mapped && mapped->entry(quint64(position), entry);
+}
+
+/**
+ * @brief Check filters of query
+ * @param entry
+ * @param query
+ * @return true if entry passes all filters
+ */
+bool Catalog::matches(const CatalogEntry &entry, const Protocol::Query &query) const
+{
+    if (query.from > 0 && entry.timestamp < query.from)
+        return false;
+    if (query.to > 0 && entry.timestamp >= query.to)
+        return false;
+    if (!query.prefix.isEmpty() && !entry.fileName.startsWith(query.prefix))
+        return false;
+    if (!query.substring.isEmpty() && !entry.fileName.contains(query.substring, Qt::CaseInsensitive))
+        return false;
+    return true;
+}
+
+/**
+ * @brief Convert entry into row that is sent to clients
+ * @param entry
+ * @return
+ */
+Protocol::TableRow Catalog::toRow(const CatalogEntry &entry) const
+{
+    Protocol::TableRow row;
+    row.dateTime = QDateTime::fromMSecsSinceEpoch(entry.timestamp).toString(DateTimeFormat);
+    row.fileName = entry.fileName;
+    row.link = QString("%1%2").arg(LinkPrefix).arg(entry.path);
+    row.size = entry.size;
+    return row;
+}
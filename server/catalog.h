@@ -0,0 +1,114 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <QObject>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QFile>
+#include <QHash>
+#include <QMap>
+#include <QPair>
+#include <QVector>
+#include <QSharedPointer>
+
+#include "protocol.h"
+
+/**
+ * @brief Saved file as it is known to catalog
+ */
+struct CatalogEntry
+{
+    QString fileName;       ///< name of file as it was sent by client
+    QString path;           ///< full path to file on server
+    qint64 size = 0;        ///< size of file in bytes
+    qint64 timestamp = 0;   ///< time of the last save in milliseconds since epoch
+    QByteArray hash;        ///< raw SHA-256 of content if file is stored in blob store, empty otherwise
+};
+
+namespace CatalogFile {
+class SnapshotReader;
+}
+
+/**
+ * @brief Table of saved files, that is shared by all workers
+ *
+ * @details On disk catalog is a binary snapshot and an append-only log, that gets a record on every save
+ * (see CatalogFile). Snapshot stays mapped into memory and entries are looked up in it by its indexes,
+ * so startup doesn't build containers of the whole table. Entries, that were saved after snapshot,
+ * are kept in memory and override records of snapshot. Every entry has a position in order of the first save,
+ * re-uploads update entries in place. Log is also the write-ahead log of catalog: record is synced to disk
+ * before entry becomes visible, and concurrent appends share one sync. Compaction writes all entries into
+ * a new snapshot, maps it and starts an empty log. Text table file of older servers is migrated into snapshot once.
+ * Entries are indexed by name and by time of the last save both in snapshot and in memory, so pages of queries
+ * (see Protocol::Query) are taken by merging both indexes without scanning the whole table.
+ *
+ * Methods can be called from any thread. Every change gets the next sequence number,
+ * so clients can apply broadcasted deltas and detect missed ones. Rows of recent changes are kept,
+ * so workers can send every client one combined delta since the change it already has.
+ */
+class Catalog : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Catalog(const QString &pathToCatalog, const QString &dirOfSavedFiles, QObject *parent = nullptr);
+
+    bool open(const QString &pathToTableFile);
+    bool isCompactionDue();
+    bool compact();
+
+    bool append(const QString &fileName, const QString &path, qint64 size, const QByteArray &hash = QByteArray());
+    bool find(const QString &fileName, CatalogEntry &entry);
+    QByteArray snapshot();
+    QByteArray compressedSnapshot();
+    quint64 lastSequence();
+    bool delta(quint64 since, QByteArray &payload, quint64 &last);
+    bool query(const Protocol::Query &query, QByteArray &result);
+
+signals:
+    void newDebugMessage(QString);
+    void newInfoMessage(QString);
+    void newWarningMessage(QString);
+    void newCriticalMessage(QString);
+
+    void appended();                    ///< emitted after a file was saved, rows are taken by delta
+
+private:
+    bool loadSnapshot();
+    void adoptSnapshot(const QSharedPointer<CatalogFile::SnapshotReader> &reader, int snapshotCount, quint64 snapshotSequence);
+    bool replayLog(const QString &path);
+    bool migrate(const QString &pathToTableFile);
+    bool waitForSync(quint64 rowNumber);
+    void insert(const CatalogEntry &entry);
+    int positionOf(const QString &fileName) const;
+    bool entryAt(int position, CatalogEntry &entry) const;
+    Protocol::TableRow toRow(const CatalogEntry &entry) const;
+    bool matches(const CatalogEntry &entry, const Protocol::Query &query) const;
+
+    QMutex mutex;                       ///< guards everything below
+    QString pathToSnapshot;             ///< full path to snapshot of catalog
+    QString pathToLog;                  ///< full path to log of saves since snapshot
+    QString pathToRotatedLog;           ///< full path to log, that is being compacted into snapshot
+    QString dirOfSavedFiles;            ///< full path to dir, where saved files are stored
+    QFile logFile;                      ///< log, that is kept open for appends
+    quint64 writtenRows = 0;            ///< records that were written into logFile since start
+    quint64 syncedRows = 0;             ///< records that are on disk
+    quint64 logRows = 0;                ///< records in logFile, they are replayed on startup
+    bool compacting = false;            ///< snapshot is being written
+    bool syncing = false;               ///< some append is syncing logFile right now
+    QWaitCondition rowsSynced;          ///< wakes appends, that wait for their rows to be synced
+    quint64 pendingRows = 0;            ///< records that were written into logFile, but aren't in changes yet
+    QWaitCondition rowsInserted;        ///< wakes compaction, that waits for written records to get into changes
+    QSharedPointer<CatalogFile::SnapshotReader> mapped; ///< snapshot, whose records are the first positions, nullptr if there is none
+    int entryCount = 0;                 ///< count of entries, positions are less than it
+    QHash<int, CatalogEntry> changes;   ///< position -> entry, that was saved after snapshot
+    QHash<int, quint64> changedAt;      ///< position -> sequence number of the last change of entry in changes
+    QHash<QString, int> index;          ///< name of file, that isn't in snapshot -> position
+    QMap<QString, int> byName;          ///< the same names in order of names
+    QMap<QPair<qint64, int>, int> byTime;   ///< time of the last save and position -> position of entries in changes, in order of time
+    quint64 sequence = 0;               ///< sequence number of the last change
+    QVector<Protocol::TableRow> recentRows; ///< rows of recent changes, the last one has number sequence
+    QByteArray cachedSnapshot;          ///< encoded snapshot, empty if entries were changed after it was encoded
+    QByteArray cachedCompressedSnapshot;///< compressed cachedSnapshot, empty if it wasn't compressed yet
+};
+
+#endif // CATALOG_H
@@ -0,0 +1,473 @@
+#include "catalogfile.h"
+#include "durability.h"
+
+#include <QtEndian>
+
+#include <algorithm>
+#include <cstring>
+
+namespace CatalogFile {
+
+static const char HeaderMagic[] = "SFCT";       ///< first bytes of snapshot
+static const char FooterMagic[] = "TCFS";       ///< last bytes of complete snapshot
+static const int WriteSize = 1024 * 1024;       ///< snapshot is written in pieces of this size
+
+/**
+ * @brief Store path relative to dir of saved files, if it is under it
+ * @param path full path to file
+ * @param dirOfSavedFiles
+ * @param flags RelativePath is set if path is relative
+ * @return UTF-8 path
+ */
+static QByteArray storedPath(const QString &path, const QString &dirOfSavedFiles, quint32 &flags)
+{
+    QString prefix = dirOfSavedFiles + "/";
+    if (path.startsWith(prefix)) {
+        flags |= RelativePath;
+        return path.mid(prefix.size()).toUtf8();
+    }
+    return path.toUtf8();
+}
+
+/**
+ * @brief Restore full path of file
+ * @param data UTF-8 path
+ * @param size size of path in bytes
+ * @param flags flags of record
+ * @param dirOfSavedFiles
+ * @return
+ */
+static QString resolvedPath(const char *data, int size, quint32 flags, const QString &dirOfSavedFiles)
+{
+    QString path = QString::fromUtf8(data, size);
+    return (flags & RelativePath) ? dirOfSavedFiles + "/" + path : path;
+}
+
+/**
+ * @brief CRC-32 (IEEE 802.3) of data
+ * @param data
+ * @param size
+ * @param crc CRC of preceding data, so checksum can be computed piece by piece
+ * @return
+ */
+quint32 crc32(const char *data, qint64 size, quint32 crc)
+{
+    static const QVector<quint32> table = [] {
+        QVector<quint32> values(256);
+        for (quint32 i = 0; i < 256; ++i) {
+            quint32 value = i;
+            for (int bit = 0; bit < 8; ++bit)
+                value = (value & 1) ? (value >> 1) ^ 0xEDB88320u : value >> 1;
+            values[int(i)] = value;
+        }
+        return values;
+    }();
+
+    const uchar *bytes = reinterpret_cast<const uchar*>(data);
+    crc = ~crc;
+    for (qint64 i = 0; i < size; ++i)
+        crc = table[int((crc ^ bytes[i]) & 0xFF)] ^ (crc >> 8);
+    return ~crc;
+}
+
+/**
+ * @brief Write entries into snapshot, that replaces file under path atomically
+ *
+ * @details Indexes are sorted first, then records and heap are written in one pass over entries through two handles
+ * of the same file, heap starts right after indexes, so every record knows offsets of its strings at once
+ *
+ * @param path full path to snapshot
+ * @param entries entries in order of the first save
+ * @param sequence sequence number of the last change, that entries have
+ * @param dirOfSavedFiles
+ * @return false if snapshot wasn't written
+ */
+bool writeSnapshot(const QString &path, const QVector<CatalogEntry> &entries, quint64 sequence, const QString &dirOfSavedFiles)
+{
+    const int count = entries.size();
+    QVector<quint32> byName(count);
+    QVector<quint32> byTime(count);
+    for (int i = 0; i < count; ++i) {
+        byName[i] = quint32(i);
+        byTime[i] = quint32(i);
+    }
+    std::sort(byName.begin(), byName.end(), [&entries](quint32 left, quint32 right) {
+        return entries[int(left)].fileName < entries[int(right)].fileName;
+    });
+    std::sort(byTime.begin(), byTime.end(), [&entries](quint32 left, quint32 right) {
+        return qMakePair(entries[int(left)].timestamp, left) < qMakePair(entries[int(right)].timestamp, right);
+    });
+
+    QFile file(path + ".tmp");
+    QFile heapFile(file.fileName());
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || !heapFile.open(QIODevice::ReadWrite)
+            || !heapFile.seek(HeaderSize + qint64(count) * (RecordSize + 2 * IndexEntrySize))) {
+        file.remove();
+        return false;
+    }
+
+    quint32 recordsCrc = 0;
+    quint32 heapCrc = 0;
+    QByteArray records;
+    QByteArray heap;
+    records.reserve(WriteSize + RecordSize);
+    heap.reserve(WriteSize + 2 * MaxPathSize);
+    auto flush = [](QFile &target, QByteArray &buffer, quint32 &crc) {
+        crc = crc32(buffer.constData(), buffer.size(), crc);
+        bool written = target.write(buffer) == buffer.size();
+        buffer.clear();
+        return written;
+    };
+
+    char header[HeaderSize] = {};
+    memcpy(header, HeaderMagic, 4);
+    qToBigEndian<quint32>(Version, header + 4);
+    qToBigEndian<quint32>(RecordSize, header + 8);
+    records.append(header, HeaderSize);
+
+    bool written = true;
+    quint64 heapSize = 0;
+    for (const CatalogEntry &entry : entries) {
+        quint32 flags = entry.hash.size() == Protocol::HashSize ? HasHash : 0;
+        QByteArray name = entry.fileName.toUtf8();
+        QByteArray stored = storedPath(entry.path, dirOfSavedFiles, flags);
+
+        char record[RecordSize] = {};
+        qToBigEndian<qint64>(entry.timestamp, record);
+        qToBigEndian<qint64>(entry.size, record + 8);
+        qToBigEndian<quint64>(heapSize, record + 16);
+        qToBigEndian<quint64>(heapSize + quint64(name.size()), record + 24);
+        qToBigEndian<quint32>(quint32(name.size()), record + 32);
+        qToBigEndian<quint32>(quint32(stored.size()), record + 36);
+        qToBigEndian<quint32>(flags, record + 40);
+        if (flags & HasHash)
+            memcpy(record + 48, entry.hash.constData(), Protocol::HashSize);
+        records.append(record, RecordSize);
+        heap.append(name).append(stored);
+        heapSize += quint64(name.size() + stored.size());
+
+        if (records.size() >= WriteSize)
+            written = written && flush(file, records, recordsCrc);
+        if (heap.size() >= WriteSize)
+            written = written && flush(heapFile, heap, heapCrc);
+    }
+
+    for (const QVector<quint32> &index : { byName, byTime }) {
+        for (quint32 number : index) {
+            char value[IndexEntrySize];
+            qToBigEndian<quint32>(number, value);
+            records.append(value, IndexEntrySize);
+            if (records.size() >= WriteSize)
+                written = written && flush(file, records, recordsCrc);
+        }
+    }
+
+    char footer[FooterSize] = {};
+    qToBigEndian<quint64>(quint64(count), footer);
+    qToBigEndian<quint64>(heapSize, footer + 8);
+    qToBigEndian<quint64>(sequence, footer + 16);
+    heap.append(footer, 24);
+    written = written && flush(file, records, recordsCrc) && flush(heapFile, heap, heapCrc);
+    qToBigEndian<quint32>(recordsCrc, footer + 24);
+    qToBigEndian<quint32>(heapCrc, footer + 28);
+    memcpy(footer + 36, FooterMagic, 4);
+
+    written = written && heapFile.write(footer + 24, FooterSize - 24) == FooterSize - 24 && file.flush() && Durability::syncFile(heapFile);
+    file.close();
+    heapFile.close();
+    if (!written || !Durability::replaceFile(file.fileName(), path)) {
+        file.remove();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Encode entry into record of log
+ * @param entry
+ * @param dirOfSavedFiles
+ * @return
+ */
+QByteArray encodeLogRecord(const CatalogEntry &entry, const QString &dirOfSavedFiles)
+{
+    quint32 flags = entry.hash.size() == Protocol::HashSize ? HasHash : 0;
+    QByteArray name = entry.fileName.toUtf8();
+    QByteArray path = storedPath(entry.path, dirOfSavedFiles, flags);
+
+    QByteArray record(LogRecordSize, '\0');
+    char *fixed = record.data();
+    qToBigEndian<quint32>(quint32(name.size()), fixed + 4);
+    qToBigEndian<quint32>(quint32(path.size()), fixed + 8);
+    qToBigEndian<quint32>(flags, fixed + 12);
+    qToBigEndian<qint64>(entry.timestamp, fixed + 16);
+    qToBigEndian<qint64>(entry.size, fixed + 24);
+    if (flags & HasHash)
+        memcpy(fixed + 32, entry.hash.constData(), Protocol::HashSize);
+    record.append(name).append(path);
+
+    qToBigEndian<quint32>(crc32(record.constData() + 4, record.size() - 4), record.data());
+    return record;
+}
+
+/**
+ * @brief Read all complete records of log
+ * @param path full path to log
+ * @param dirOfSavedFiles
+ * @param entries entries of records in order of log
+ * @return size of complete records, it is less than size of file if log has torn tail, -1 if log can't be read
+ */
+qint64 readLog(const QString &path, const QString &dirOfSavedFiles, QVector<CatalogEntry> &entries)
+{
+    QFile file(path);
+    if (!file.exists())
+        return 0;
+    if (!file.open(QIODevice::ReadOnly))
+        return -1;
+
+    qint64 size = file.size();
+    if (size == 0)
+        return 0;
+    const char *data = reinterpret_cast<const char*>(file.map(0, size));
+    if (!data)
+        return -1;
+
+    qint64 position = 0;
+    while (size - position >= LogRecordSize) {
+        const char *fixed = data + position;
+        quint32 nameSize = qFromBigEndian<quint32>(fixed + 4);
+        quint32 pathSize = qFromBigEndian<quint32>(fixed + 8);
+        if (nameSize > quint32(Protocol::MaxNameSize) || pathSize > quint32(MaxPathSize))
+            break;
+        qint64 recordSize = LogRecordSize + qint64(nameSize) + qint64(pathSize);
+        if (size - position < recordSize || qFromBigEndian<quint32>(fixed) != crc32(fixed + 4, recordSize - 4))
+            break;
+
+        CatalogEntry entry;
+        quint32 flags = qFromBigEndian<quint32>(fixed + 12);
+        entry.timestamp = qFromBigEndian<qint64>(fixed + 16);
+        entry.size = qFromBigEndian<qint64>(fixed + 24);
+        if (flags & HasHash)
+            entry.hash = QByteArray(fixed + 32, Protocol::HashSize);
+        entry.fileName = QString::fromUtf8(fixed + LogRecordSize, int(nameSize));
+        entry.path = resolvedPath(fixed + LogRecordSize + nameSize, int(pathSize), flags, dirOfSavedFiles);
+        entries.append(entry);
+        position += recordSize;
+    }
+
+    return position;
+}
+
+/**
+ * @brief SnapshotReader::SnapshotReader
+ * @param path full path to snapshot
+ * @param dirOfSavedFiles
+ */
+SnapshotReader::SnapshotReader(const QString &path, const QString &dirOfSavedFiles)
+    : file(path)
+    , dirOfSavedFiles(dirOfSavedFiles)
+{
+}
+
+/**
+ * @brief Map snapshot and check its header and footer, checksums cover the whole snapshot
+ *
+ * @details Snapshot of version 2 is accepted too, it has no indexes (see hasIndexes)
+ *
+ * @return false if snapshot can't be mapped or is corrupted
+ */
+bool SnapshotReader::open()
+{
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    qint64 size = file.size();
+    if (size < HeaderSize + FooterSize)
+        return false;
+    data = file.map(0, size);
+    if (!data)
+        return false;
+
+    const char *bytes = reinterpret_cast<const char*>(data);
+    const char *footer = bytes + size - FooterSize;
+    version = qFromBigEndian<quint32>(bytes + 4);
+    if (memcmp(bytes, HeaderMagic, 4) != 0 || memcmp(footer + 36, FooterMagic, 4) != 0
+            || (version != Version && version != 2) || qFromBigEndian<quint32>(bytes + 8) != quint32(RecordSize))
+        return false;
+
+    records = qFromBigEndian<quint64>(footer);
+    heapSize = qFromBigEndian<quint64>(footer + 8);
+    lastSequence = qFromBigEndian<quint64>(footer + 16);
+    quint64 recordSize = RecordSize + (hasIndexes() ? 2 * IndexEntrySize : 0);
+    quint64 expected = quint64(HeaderSize + FooterSize) + heapSize;
+    if (records > quint64(size) / recordSize || heapSize > quint64(size) || expected + records * recordSize != quint64(size))
+        return false;
+
+    heapStart = HeaderSize + records * recordSize;
+    return qFromBigEndian<quint32>(footer + 24) == crc32(bytes, qint64(heapStart))
+            && qFromBigEndian<quint32>(footer + 28) == crc32(bytes + heapStart, qint64(heapSize) + 24);
+}
+
+/**
+ * @brief Decode record of snapshot
+ * @param index number of record
+ * @param entry
+ * @return false if record refers to strings outside of heap
+ */
+bool SnapshotReader::entry(quint64 index, CatalogEntry &entry) const
+{
+    int nameSize = 0;
+    int pathSize = 0;
+    const char *name = string(index, 16, 32, quint32(Protocol::MaxNameSize), nameSize);
+    const char *path = string(index, 24, 36, quint32(MaxPathSize), pathSize);
+    if (!name || !path)
+        return false;
+
+    const char *record = reinterpret_cast<const char*>(data) + HeaderSize + index * RecordSize;
+    quint32 flags = qFromBigEndian<quint32>(record + 40);
+    entry.timestamp = qFromBigEndian<qint64>(record);
+    entry.size = qFromBigEndian<qint64>(record + 8);
+    entry.hash = (flags & HasHash) ? QByteArray(record + 48, Protocol::HashSize) : QByteArray();
+    entry.fileName = QString::fromUtf8(name, nameSize);
+    entry.path = resolvedPath(path, pathSize, flags, dirOfSavedFiles);
+    return true;
+}
+
+/**
+ * @brief Decode only name of record, so indexes are searched without decoding whole records
+ * @param index number of record
+ * @return empty string if record is malformed
+ */
+QString SnapshotReader::name(quint64 index) const
+{
+    int size = 0;
+    const char *name = string(index, 16, 32, quint32(Protocol::MaxNameSize), size);
+    return name ? QString::fromUtf8(name, size) : QString();
+}
+
+/**
+ * @brief Time of the last save of record
+ * @param index number of record
+ * @return 0 if there is no such record
+ */
+qint64 SnapshotReader::timestamp(quint64 index) const
+{
+    if (!data || index >= records)
+        return 0;
+    return qFromBigEndian<qint64>(data + HeaderSize + index * RecordSize);
+}
+
+/**
+ * @brief Find record of file by bisection of name index
+ * @param name name of file
+ * @param index number of found record
+ * @return false if there is no such file
+ */
+bool SnapshotReader::find(const QString &name, quint64 &index) const
+{
+    quint64 rank = lowerBoundName(name);
+    if (rank == records)
+        return false;
+    index = nameAt(rank);
+    return this->name(index) == name;
+}
+
+/**
+ * @brief Number of record, that has given place in order of names
+ * @param rank place in name index, less than count
+ * @return
+ */
+quint64 SnapshotReader::nameAt(quint64 rank) const
+{
+    return qFromBigEndian<quint32>(data + HeaderSize + records * RecordSize + rank * IndexEntrySize);
+}
+
+/**
+ * @brief Number of record, that has given place in order of timestamp and number
+ * @param rank place in time index, less than count
+ * @return
+ */
+quint64 SnapshotReader::timeAt(quint64 rank) const
+{
+    return qFromBigEndian<quint32>(data + HeaderSize + records * (RecordSize + IndexEntrySize) + rank * IndexEntrySize);
+}
+
+/**
+ * @brief Place of the first record in order of names, whose name isn't less than given one
+ * @param name
+ * @return count if there is no such record
+ */
+quint64 SnapshotReader::lowerBoundName(const QString &name) const
+{
+    quint64 first = 0;
+    quint64 count = hasIndexes() ? records : 0;
+    while (count > 0) {
+        quint64 step = count / 2;
+        if (this->name(nameAt(first + step)) < name) {
+            first += step + 1;
+            count -= step + 1;
+        } else
+            count = step;
+    }
+    return first;
+}
+
+/**
+ * @brief Place of the first record in order of names, whose name is greater than given one
+ * @param name
+ * @return count if there is no such record
+ */
+quint64 SnapshotReader::upperBoundName(const QString &name) const
+{
+    quint64 rank = lowerBoundName(name);
+    if (rank < records && this->name(nameAt(rank)) == name)
+        ++rank;
+    return rank;
+}
+
+/**
+ * @brief Place of the first record in order of time, that isn't earlier than given timestamp and number
+ * @param timestamp
+ * @param index number of record, records with the same timestamp are ordered by it
+ * @return count if there is no such record
+ */
+quint64 SnapshotReader::lowerBoundTime(qint64 timestamp, qint64 index) const
+{
+    quint64 first = 0;
+    quint64 count = hasIndexes() ? records : 0;
+    while (count > 0) {
+        quint64 step = count / 2;
+        quint64 record = timeAt(first + step);
+        if (qMakePair(this->timestamp(record), qint64(record)) < qMakePair(timestamp, index)) {
+            first += step + 1;
+            count -= step + 1;
+        } else
+            count = step;
+    }
+    return first;
+}
+
+/**
+ * @brief Locate string of record in heap
+ * @param index number of record
+ * @param offsetField position of offset of string in record
+ * @param sizeField position of size of string in record
+ * @param maxSize longer strings are malformed
+ * @param size size of string in bytes
+ * @return nullptr if there is no such record or string lies outside of heap
+ */
+const char *SnapshotReader::string(quint64 index, int offsetField, int sizeField, quint32 maxSize, int &size) const
+{
+    if (!data || index >= records)
+        return nullptr;
+
+    const char *record = reinterpret_cast<const char*>(data) + HeaderSize + index * RecordSize;
+    quint64 offset = qFromBigEndian<quint64>(record + offsetField);
+    quint32 length = qFromBigEndian<quint32>(record + sizeField);
+    if (length > maxSize || length > heapSize || offset > heapSize - length)
+        return nullptr;
+
+    size = int(length);
+    return reinterpret_cast<const char*>(data) + heapStart + offset;
+}
+
+}
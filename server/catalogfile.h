@@ -0,0 +1,99 @@
+#ifndef CATALOGFILE_H
+#define CATALOGFILE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <QVector>
+
+#include "catalog.h"
+
+/**
+ * @brief Binary files of catalog: snapshot with fixed-size records and log of appended entries
+ *
+ * @details Snapshot is written at once by compaction and is never changed, it stays mapped into memory while server runs,
+ * so entries are looked up in it instead of being loaded into containers. Indexes hold numbers of records
+ * in order of names and in order of time of the last save and position, they are searched by bisection.
+ * All numbers are big-endian, names and paths are UTF-8 in string heap, paths under dir of saved files are relative:
+ *
+ * | part       | size          | fields                                                                          |
+ * |------------|---------------|---------------------------------------------------------------------------------|
+ * | header     | 16            | magic, version, RecordSize, reserved                                            |
+ * | records    | count * 80    | timestamp, size, name offset, path offset, name size, path size, flags, reserved, hash |
+ * | name index | count * 4     | numbers of records in order of names                                            |
+ * | time index | count * 4     | numbers of records in order of timestamp and number                             |
+ * | heap       | heap size     | names and paths of records                                                      |
+ * | footer     | 40            | count, heap size, sequence, CRC-32 of header, records and indexes, CRC-32 of heap and the first 24 bytes of footer, reserved, magic |
+ *
+ * Snapshot of version 2 has no indexes, it is read only to be rewritten.
+ *
+ * Log is appended by every save and is synced before entry becomes visible. Its record has fixed part
+ * (CRC-32 of the rest of record, name size, path size, flags, timestamp, size, hash), name and path follow it.
+ * Record without matching CRC was torn by a crash, it and everything after it is dropped.
+ */
+namespace CatalogFile {
+
+const quint32 Version = 3;          ///< version of snapshot
+const int HeaderSize = 16;          ///< size of header of snapshot
+const int RecordSize = 80;          ///< size of record of snapshot
+const int FooterSize = 40;          ///< size of footer of snapshot
+const int IndexEntrySize = 4;       ///< size of number of record in index of snapshot
+const int LogRecordSize = 64;       ///< size of fixed part of record of log
+const int MaxPathSize = 0xFFFF;     ///< records with longer names or paths are malformed
+
+/**
+ * @brief Bits of flags of record
+ */
+enum RecordFlag : quint32 {
+    HasHash         = 0x1,  ///< file is stored in blob store, record has its hash
+    RelativePath    = 0x2,  ///< path is relative to dir of saved files
+};
+
+quint32 crc32(const char *data, qint64 size, quint32 crc = 0);
+
+bool writeSnapshot(const QString &path, const QVector<CatalogEntry> &entries, quint64 sequence, const QString &dirOfSavedFiles);
+
+QByteArray encodeLogRecord(const CatalogEntry &entry, const QString &dirOfSavedFiles);
+qint64 readLog(const QString &path, const QString &dirOfSavedFiles, QVector<CatalogEntry> &entries);
+
+/**
+ * @brief Snapshot mapped into memory, records are decoded by index without parsing the whole file
+ *
+ * @details Methods are const and may be called from several threads
+ */
+class SnapshotReader
+{
+public:
+    SnapshotReader(const QString &path, const QString &dirOfSavedFiles);
+
+    bool open();
+    quint64 count() const { return records; }
+    quint64 sequence() const { return lastSequence; }
+    bool hasIndexes() const { return version >= 3; }
+    bool entry(quint64 index, CatalogEntry &entry) const;
+    QString name(quint64 index) const;
+    qint64 timestamp(quint64 index) const;
+
+    bool find(const QString &name, quint64 &index) const;
+    quint64 nameAt(quint64 rank) const;
+    quint64 timeAt(quint64 rank) const;
+    quint64 lowerBoundName(const QString &name) const;
+    quint64 upperBoundName(const QString &name) const;
+    quint64 lowerBoundTime(qint64 timestamp, qint64 index) const;
+
+private:
+    const char *string(quint64 index, int offsetField, int sizeField, quint32 maxSize, int &size) const;
+
+    QFile file;                 ///< snapshot, that stays open while it is mapped
+    QString dirOfSavedFiles;    ///< relative paths are resolved against it
+    const uchar *data = nullptr;///< mapped snapshot
+    quint32 version = 0;        ///< version of snapshot
+    quint64 records = 0;        ///< count of records
+    quint64 heapStart = 0;      ///< position of string heap in snapshot
+    quint64 heapSize = 0;       ///< size of string heap
+    quint64 lastSequence = 0;   ///< sequence number of the last change, that snapshot has
+};
+
+}
+
+#endif // CATALOGFILE_H
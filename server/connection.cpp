@@ -0,0 +1,106 @@
+#include "connection.h"
+
+#include <QHostAddress>
+
+/**
+ * @brief TcpConnection::TcpConnection
+ * @param parent
+ */
+TcpConnection::TcpConnection(QObject *parent)
+    : Connection(parent)
+    , socket(new QTcpSocket(this))
+{
+    connect(socket, &QTcpSocket::readyRead, this, &TcpConnection::readyRead);
+    connect(socket, &QTcpSocket::bytesWritten, this, &TcpConnection::bytesWritten);
+    connect(socket, &QTcpSocket::disconnected, this, &TcpConnection::socketDisconnected);
+    // see https://stackoverflow.com/questions/35655512/compile-error-when-connecting-qtcpsocketerror-using-the-new-qt5-signal-slot
+    connect(socket, static_cast<void (QTcpSocket::*)(QAbstractSocket::SocketError)>(&QAbstractSocket::error), this, &TcpConnection::socketError);
+}
+
+/**
+ * @brief Take accepted connection into socket
+ * @param socketDescriptor native descriptor of accepted connection
+ * @return
+ */
+bool TcpConnection::setSocketDescriptor(qintptr socketDescriptor)
+{
+    if (!socket->setSocketDescriptor(socketDescriptor)) {
+        setErrorString(socket->errorString());
+        return false;
+    }
+
+    // bytes are buffered by socket, device keeps only peeked ones
+    return open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+}
+
+qintptr TcpConnection::socketDescriptor() const
+{
+    return socket->socketDescriptor();
+}
+
+QString TcpConnection::peerName() const
+{
+    return QString("%1:%2").arg(socket->peerAddress().toString()).arg(socket->peerPort());
+}
+
+void TcpConnection::setReadBufferSize(qint64 size)
+{
+    socket->setReadBufferSize(size);
+}
+
+void TcpConnection::abort()
+{
+    socket->abort();
+    if (isOpen())
+        QIODevice::close();
+}
+
+/**
+ * @brief Close socket after its unsent bytes were written
+ */
+void TcpConnection::close()
+{
+    socket->close();
+    if (isOpen())
+        QIODevice::close();
+}
+
+qint64 TcpConnection::bytesAvailable() const
+{
+    return QIODevice::bytesAvailable() + socket->bytesAvailable();
+}
+
+qint64 TcpConnection::bytesToWrite() const
+{
+    return socket->bytesToWrite();
+}
+
+qint64 TcpConnection::readData(char *data, qint64 maxSize)
+{
+    return socket->read(data, maxSize);
+}
+
+qint64 TcpConnection::writeData(const char *data, qint64 size)
+{
+    return socket->write(data, size);
+}
+
+/**
+ * @brief Close device, when client has disconnected
+ */
+void TcpConnection::socketDisconnected()
+{
+    if (isOpen())
+        QIODevice::close();
+    emit disconnected();
+}
+
+/**
+ * @brief Pass error of socket with its description
+ * @param socketError
+ */
+void TcpConnection::socketError(QAbstractSocket::SocketError socketError)
+{
+    setErrorString(socket->errorString());
+    emit errorOccurred(socketError);
+}
@@ -0,0 +1,83 @@
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <QIODevice>
+#include <QAbstractSocket>
+#include <QTcpSocket>
+
+/**
+ * @brief Connection of one client, that is served by Worker
+ *
+ * @details Worker reads frames from connection and writes frames into it as into any sequential device,
+ * so the same protocol is spoken over every network engine: TcpConnection uses Qt sockets,
+ * EpollConnection uses its own buffers and is driven by EpollEngine.
+ *
+ * Bytes, that were peeked by Protocol::readFrame, are kept in buffer of QIODevice, so implementations
+ * count them in bytesAvailable.
+ */
+class Connection : public QIODevice
+{
+    Q_OBJECT
+public:
+    explicit Connection(QObject *parent = nullptr) : QIODevice(parent) {}
+
+    bool isSequential() const override { return true; }
+
+    /**
+     * @brief Take accepted connection and open device for reading and writing
+     * @param socketDescriptor native descriptor of accepted connection
+     * @return false if descriptor can't be used, see errorString
+     */
+    virtual bool setSocketDescriptor(qintptr socketDescriptor) = 0;
+    virtual qintptr socketDescriptor() const = 0;
+    /**
+     * @brief Address and port of client, used in messages and metrics
+     */
+    virtual QString peerName() const = 0;
+    /**
+     * @brief Limit unread bytes, that are kept in memory, the rest waits in the kernel
+     * @param size
+     */
+    virtual void setReadBufferSize(qint64 size) = 0;
+    /**
+     * @brief Close connection at once, unsent bytes are discarded
+     */
+    virtual void abort() = 0;
+
+signals:
+    void disconnected();
+    void errorOccurred(QAbstractSocket::SocketError socketError);
+};
+
+/**
+ * @brief Connection, that is served by QTcpSocket and event loop of Qt
+ */
+class TcpConnection : public Connection
+{
+    Q_OBJECT
+public:
+    explicit TcpConnection(QObject *parent = nullptr);
+
+    bool setSocketDescriptor(qintptr socketDescriptor) override;
+    qintptr socketDescriptor() const override;
+    QString peerName() const override;
+    void setReadBufferSize(qint64 size) override;
+    void abort() override;
+    void close() override;
+
+    qint64 bytesAvailable() const override;
+    qint64 bytesToWrite() const override;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 size) override;
+
+private slots:
+    void socketDisconnected();
+    void socketError(QAbstractSocket::SocketError socketError);
+
+private:
+    QTcpSocket *socket;     ///< socket of client
+};
+
+#endif // CONNECTION_H
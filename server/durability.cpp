@@ -0,0 +1,92 @@
+#include "durability.h"
+
+#include <QFileInfo>
+
+#ifdef Q_OS_UNIX
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#endif
+
+namespace Durability {
+
+/**
+ * @brief Flush buffers of file and wait until its data reaches disk
+ * @param file opened file
+ * @return false if data may be lost on crash
+ */
+bool syncFile(QFile &file)
+{
+    return file.flush() && syncHandle(file.handle());
+}
+
+/**
+ * @brief Wait until data, that was written into descriptor, reaches disk
+ *
+ * @details Doesn't touch QFile, so it can be called without lock, that guards writes into file
+ *
+ * @param handle native descriptor of file
+ * @return false if data may be lost on crash
+ */
+bool syncHandle(int handle)
+{
+#if defined(Q_OS_LINUX)
+    return ::fdatasync(handle) == 0;
+#elif defined(Q_OS_UNIX)
+    return ::fsync(handle) == 0;
+#elif defined(Q_OS_WIN)
+    return ::_commit(handle) == 0;
+#else
+    Q_UNUSED(handle)
+    return true;
+#endif
+}
+
+/**
+ * @brief Wait until entries of directory reach disk, so renames and new files in it survive a crash
+ * @param path path to directory
+ * @return false if entries may be lost on crash
+ */
+bool syncDirectory(const QString &path)
+{
+#ifdef Q_OS_UNIX
+    int descriptor = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_DIRECTORY);
+    if (descriptor == -1)
+        return false;
+    bool synced = ::fsync(descriptor) == 0;
+    ::close(descriptor);
+    return synced;
+#else
+    Q_UNUSED(path)
+    return true;    // directory entries are journaled by file system
+#endif
+}
+
+/**
+ * @brief Atomically replace file under path to with file from
+ *
+ * @details File from must be synced already. Readers see either the old or the new file, never a missing one
+ *
+ * @param from path to complete file
+ * @param to final path
+ * @return false if file wasn't moved
+ */
+bool replaceFile(const QString &from, const QString &to)
+{
+#ifdef Q_OS_UNIX
+    if (::rename(QFile::encodeName(from).constData(), QFile::encodeName(to).constData()) != 0)
+        return false;
+#else
+    QFile::remove(to);
+    if (!QFile::rename(from, to))
+        return false;
+#endif
+
+    return syncDirectory(QFileInfo(to).absolutePath());
+}
+
+}
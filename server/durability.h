@@ -0,0 +1,22 @@
+#ifndef DURABILITY_H
+#define DURABILITY_H
+
+#include <QFile>
+#include <QString>
+
+/**
+ * @brief Helpers, that make writes survive a crash of server or of the whole machine
+ *
+ * @details Data of file is synced before file is renamed into its final path, and directory is synced
+ * after rename, so file under final path is either complete or absent.
+ */
+namespace Durability {
+
+bool syncFile(QFile &file);
+bool syncHandle(int handle);
+bool syncDirectory(const QString &path);
+bool replaceFile(const QString &from, const QString &to);
+
+}
+
+#endif // DURABILITY_H
@@ -0,0 +1,398 @@
+#include "epollengine.h"
+
+#include <QHostAddress>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+static const int InputBufferSize = 256 * 1024;     ///< initial size of input buffer of connection
+static const int OutputBufferSize = 256 * 1024;    ///< preallocated capacity of output buffer of connection
+static const int MaxEvents = 256;                  ///< events taken by one call of epoll_wait
+
+/**
+ * @brief EpollConnection::EpollConnection
+ * @param engine engine, that will wait for events of connection
+ * @param parent
+ */
+EpollConnection::EpollConnection(EpollEngine *engine, QObject *parent)
+    : Connection(parent)
+    , engine(engine)
+    , input(InputBufferSize, Qt::Uninitialized)
+{
+    output.reserve(OutputBufferSize);
+}
+
+/**
+ * @brief Close descriptor without signals
+ */
+EpollConnection::~EpollConnection()
+{
+    if (descriptor >= 0) {
+        if (engine)
+            engine->remove(this);
+        ::close(descriptor);
+    }
+}
+
+/**
+ * @brief Make accepted connection non-blocking and register it in engine
+ * @param socketDescriptor native descriptor of accepted connection
+ * @return
+ */
+bool EpollConnection::setSocketDescriptor(qintptr socketDescriptor)
+{
+    int fd = int(socketDescriptor);
+    int flags = ::fcntl(fd, F_GETFL);
+    if (flags < 0 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        setErrorString(qt_error_string(errno));
+        return false;
+    }
+
+    sockaddr_storage address;
+    socklen_t length = sizeof(address);
+    if (::getpeername(fd, reinterpret_cast<sockaddr*>(&address), &length) == 0) {
+        quint16 port = address.ss_family == AF_INET6 ? ntohs(reinterpret_cast<sockaddr_in6*>(&address)->sin6_port)
+                                                     : ntohs(reinterpret_cast<sockaddr_in*>(&address)->sin_port);
+        peer = QString("%1:%2").arg(QHostAddress(reinterpret_cast<sockaddr*>(&address)).toString()).arg(port);
+    }
+
+    descriptor = fd;
+    if (!engine || !engine->add(this)) {
+        setErrorString(engine ? engine->errorString() : QString("Network engine was destroyed"));
+        descriptor = -1;
+        return false;
+    }
+
+    return open(QIODevice::ReadWrite | QIODevice::Unbuffered);
+}
+
+qintptr EpollConnection::socketDescriptor() const
+{
+    return descriptor;
+}
+
+QString EpollConnection::peerName() const
+{
+    return peer;
+}
+
+void EpollConnection::setReadBufferSize(qint64 size)
+{
+    readBufferSize = size;
+}
+
+void EpollConnection::abort()
+{
+    closeDescriptor();
+}
+
+/**
+ * @brief Send as much of unsent bytes as kernel takes now and close connection
+ */
+void EpollConnection::close()
+{
+    flush();
+    closeDescriptor();
+}
+
+qint64 EpollConnection::bytesAvailable() const
+{
+    return QIODevice::bytesAvailable() + (inputEnd - inputBegin);
+}
+
+qint64 EpollConnection::bytesToWrite() const
+{
+    return output.size() - outputBegin;
+}
+
+/**
+ * @brief Take received bytes from input buffer
+ *
+ * @details Reading of descriptor, that was stopped because input buffer was full, continues in the next iteration of event loop
+ *
+ * @param data
+ * @param maxSize
+ * @return
+ */
+qint64 EpollConnection::readData(char *data, qint64 maxSize)
+{
+    qint64 count = qMin(maxSize, qint64(inputEnd - inputBegin));
+    if (count > 0) {
+        memcpy(data, input.constData() + inputBegin, size_t(count));
+        inputBegin += int(count);
+    }
+
+    if (inputBegin == inputEnd) {
+        inputBegin = inputEnd = 0;
+        // buffer, that has grown for large frame, is given back
+        if (input.size() > InputBufferSize)
+            input = QByteArray(InputBufferSize, Qt::Uninitialized);
+    }
+
+    if (inputFull && count > 0) {
+        inputFull = false;
+        QMetaObject::invokeMethod(this, "receive", Qt::QueuedConnection);
+    }
+
+    if (count == 0 && descriptor < 0)
+        return -1;
+    return count;
+}
+
+/**
+ * @brief Queue bytes into output buffer, they are sent by engine with bytes of other frames
+ * @param data
+ * @param size
+ * @return
+ */
+qint64 EpollConnection::writeData(const char *data, qint64 size)
+{
+    if (descriptor < 0)
+        return -1;
+
+    output.append(data, int(size));
+    if (engine)
+        engine->scheduleFlush(this);
+    return size;
+}
+
+/**
+ * @brief Read descriptor until kernel has nothing more or input buffer is full
+ */
+void EpollConnection::receive()
+{
+    qint64 received = 0;
+    bool peerClosed = false;
+    inputFull = false;
+
+    while (descriptor >= 0) {
+        if (inputEnd == input.size()) {
+            if (inputBegin > 0) {
+                // unread bytes are moved to the beginning
+                memmove(input.data(), input.constData() + inputBegin, size_t(inputEnd - inputBegin));
+                inputEnd -= inputBegin;
+                inputBegin = 0;
+            } else if (readBufferSize == 0 || input.size() < readBufferSize) {
+                // buffer grows only for frame, that doesn't fit into it
+                qint64 size = qint64(input.size()) * 2;
+                if (readBufferSize > 0)
+                    size = qMin(size, readBufferSize);
+                input.resize(int(size));
+            } else {
+                inputFull = true;
+                break;
+            }
+        }
+
+        ssize_t count = ::recv(descriptor, input.data() + inputEnd, size_t(input.size() - inputEnd), 0);
+        if (count > 0) {
+            inputEnd += int(count);
+            received += count;
+        } else if (count == 0) {
+            peerClosed = true;
+            break;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else {
+            fail(errno);
+            return;
+        }
+    }
+
+    if (received > 0)
+        emit readyRead();
+    if (peerClosed)
+        closeDescriptor();
+}
+
+/**
+ * @brief Send queued bytes until kernel takes nothing more, the rest is sent when descriptor is writable again
+ */
+void EpollConnection::flush()
+{
+    qint64 sent = 0;
+    while (descriptor >= 0 && outputBegin < output.size()) {
+        ssize_t count = ::send(descriptor, output.constData() + outputBegin, size_t(output.size() - outputBegin), MSG_NOSIGNAL);
+        if (count > 0) {
+            outputBegin += int(count);
+            sent += count;
+        } else if (count < 0 && errno == EINTR) {
+            continue;
+        } else if (count == 0 || errno == EAGAIN || errno == EWOULDBLOCK) {
+            break;
+        } else {
+            fail(errno);
+            return;
+        }
+    }
+
+    if (outputBegin == output.size()) {
+        output.resize(0);   // reserved capacity is kept
+        outputBegin = 0;
+    } else if (outputBegin > output.size() / 2) {
+        output.remove(0, outputBegin);
+        outputBegin = 0;
+    }
+
+    if (sent > 0)
+        emit bytesWritten(sent);
+}
+
+/**
+ * @brief Report error of system call and close connection
+ * @param error errno of failed call
+ */
+void EpollConnection::fail(int error)
+{
+    setErrorString(qt_error_string(error));
+    emit errorOccurred(error == ECONNRESET || error == EPIPE ? QAbstractSocket::RemoteHostClosedError
+                                                             : QAbstractSocket::NetworkError);
+    closeDescriptor();
+}
+
+/**
+ * @brief Unregister and close descriptor, unsent bytes are discarded
+ */
+void EpollConnection::closeDescriptor()
+{
+    if (descriptor < 0)
+        return;
+
+    if (engine)
+        engine->remove(this);
+    ::close(descriptor);
+    descriptor = -1;
+    output.resize(0);
+    outputBegin = 0;
+
+    if (isOpen())
+        QIODevice::close();
+    emit disconnected();
+}
+
+/**
+ * @brief Create epoll instance and watch it in event loop
+ * @param parent
+ */
+EpollEngine::EpollEngine(QObject *parent)
+    : QObject(parent)
+    , events(MaxEvents)
+{
+    epollDescriptor = ::epoll_create1(EPOLL_CLOEXEC);
+    if (epollDescriptor < 0) {
+        error = qt_error_string(errno);
+        return;
+    }
+
+    notifier = new QSocketNotifier(epollDescriptor, QSocketNotifier::Read, this);
+    connect(notifier, &QSocketNotifier::activated, this, &EpollEngine::processEvents);
+}
+
+EpollEngine::~EpollEngine()
+{
+    delete notifier;
+    if (epollDescriptor >= 0)
+        ::close(epollDescriptor);
+}
+
+/**
+ * @brief Check whether epoll instance was created
+ * @return
+ */
+bool EpollEngine::isValid() const
+{
+    return epollDescriptor >= 0;
+}
+
+QString EpollEngine::errorString() const
+{
+    return error;
+}
+
+/**
+ * @brief Handle one batch of events: ready connections are read, writable ones are flushed with the rest of queued output
+ *
+ * @details Batch is limited by MaxEvents, so timers of worker aren't starved. Notifier fires again
+ * while epoll has more events.
+ */
+void EpollEngine::processEvents()
+{
+    int count = ::epoll_wait(epollDescriptor, events.data(), events.size(), 0);
+    for (int i = 0; i < count; ++i) {
+        // closed connections are unregistered at once and deleted later, so pointers of one batch stay valid
+        EpollConnection *connection = static_cast<EpollConnection*>(events[i].data.ptr);
+        if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+            connection->receive();
+        if (events[i].events & EPOLLOUT)
+            pending.insert(connection);
+    }
+
+    flushPending();
+}
+
+/**
+ * @brief Send queued output of all connections
+ */
+void EpollEngine::flushPending()
+{
+    flushScheduled = false;
+    // connections, that write during flush, are queued again
+    const QSet<EpollConnection*> connections = pending;
+    pending.clear();
+    for (EpollConnection *connection : connections)
+        connection->flush();
+}
+
+/**
+ * @brief Register descriptor of connection for edge-triggered events
+ * @param connection
+ * @return
+ */
+bool EpollEngine::add(EpollConnection *connection)
+{
+    if (epollDescriptor < 0)
+        return false;
+
+    epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = connection;
+    if (::epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, connection->descriptor, &event) < 0) {
+        error = qt_error_string(errno);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Unregister descriptor of connection, that is being closed
+ *
+ * @details Descriptor is removed explicitly, because duplicates of it (see Worker::sendFileToClientZeroCopy) would keep it registered
+ *
+ * @param connection
+ */
+void EpollEngine::remove(EpollConnection *connection)
+{
+    if (epollDescriptor >= 0)
+        ::epoll_ctl(epollDescriptor, EPOLL_CTL_DEL, connection->descriptor, nullptr);
+    pending.remove(connection);
+}
+
+/**
+ * @brief Queue connection to be flushed in the next iteration of event loop
+ * @param connection
+ */
+void EpollEngine::scheduleFlush(EpollConnection *connection)
+{
+    pending.insert(connection);
+    if (!flushScheduled) {
+        flushScheduled = true;
+        QMetaObject::invokeMethod(this, "flushPending", Qt::QueuedConnection);
+    }
+}
@@ -0,0 +1,106 @@
+#ifndef EPOLLENGINE_H
+#define EPOLLENGINE_H
+
+#include <QObject>
+#include <QByteArray>
+#include <QPointer>
+#include <QSet>
+#include <QSocketNotifier>
+#include <QVector>
+
+#include <sys/epoll.h>
+
+#include "connection.h"
+
+class EpollEngine;
+
+/**
+ * @brief Connection, that is read and written by EpollEngine with plain system calls
+ *
+ * @details Descriptor is non-blocking and registered edge-triggered, so connection reads until kernel has
+ * nothing more and writes until kernel takes nothing more. Input and output buffers are allocated once,
+ * input buffer grows only for frames, that don't fit into it, up to read buffer size.
+ *
+ * Written bytes are queued and sent by engine once per iteration of event loop, so all frames,
+ * that were written while requests were handled, go into the kernel with one call.
+ */
+class EpollConnection : public Connection
+{
+    Q_OBJECT
+public:
+    explicit EpollConnection(EpollEngine *engine, QObject *parent = nullptr);
+    ~EpollConnection();
+
+    bool setSocketDescriptor(qintptr socketDescriptor) override;
+    qintptr socketDescriptor() const override;
+    QString peerName() const override;
+    void setReadBufferSize(qint64 size) override;
+    void abort() override;
+    void close() override;
+
+    qint64 bytesAvailable() const override;
+    qint64 bytesToWrite() const override;
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 size) override;
+
+private slots:
+    void receive();
+
+private:
+    friend class EpollEngine;
+
+    void flush();
+    void fail(int error);
+    void closeDescriptor();
+
+    QPointer<EpollEngine> engine;   ///< engine, that waits for events of descriptor
+    int descriptor = -1;            ///< non-blocking descriptor of socket, -1 when connection is closed
+    QString peer;                   ///< address and port of client
+    QByteArray input;               ///< received bytes, that weren't read yet, are between inputBegin and inputEnd
+    int inputBegin = 0;             ///< position of the first unread byte in input
+    int inputEnd = 0;               ///< position after the last received byte in input
+    qint64 readBufferSize = 0;      ///< maximum size of input, 0 if it isn't limited
+    bool inputFull = false;         ///< kernel may have bytes, that didn't fit into input
+    QByteArray output;              ///< bytes, that weren't sent yet, start at outputBegin
+    int outputBegin = 0;            ///< position of the first unsent byte in output
+};
+
+/**
+ * @brief Network engine, that serves connections of one worker with edge-triggered epoll(7)
+ *
+ * @details Descriptor of epoll is watched by the event loop of worker's thread, so timers and queued calls
+ * of worker keep working. When any connection is ready, events are taken in batches and handled without
+ * signals of Qt sockets, then queued output of all connections is flushed at once.
+ */
+class EpollEngine : public QObject
+{
+    Q_OBJECT
+public:
+    explicit EpollEngine(QObject *parent = nullptr);
+    ~EpollEngine();
+
+    bool isValid() const;
+    QString errorString() const;
+
+private slots:
+    void processEvents();
+    void flushPending();
+
+private:
+    friend class EpollConnection;
+
+    bool add(EpollConnection *connection);
+    void remove(EpollConnection *connection);
+    void scheduleFlush(EpollConnection *connection);
+
+    int epollDescriptor = -1;               ///< descriptor of epoll instance
+    QString error;                          ///< description of the last error
+    QSocketNotifier *notifier = nullptr;    ///< notifies, when any connection has events
+    QVector<epoll_event> events;            ///< events, that are taken by one call of epoll_wait
+    QSet<EpollConnection*> pending;         ///< connections with queued output
+    bool flushScheduled = false;            ///< flushPending is already queued
+};
+
+#endif // EPOLLENGINE_H
@@ -0,0 +1,154 @@
+#include "filecache.h"
+
+#include <QScopedPointer>
+
+#include <limits>
+
+#include "metrics.h"
+
+static const qint64 MapThreshold = 1024 * 1024;     ///< files of this size and bigger are mapped instead of being read
+static const int SweepThreshold = 64;               ///< mapped files, after which released ones are swept out of index
+
+/**
+ * @brief Close file and release its mapping
+ */
+FileContent::~FileContent()
+{
+    if (file) {
+        file->close();  // unmaps file
+        delete file;
+    }
+}
+
+/**
+ * @brief FileCache::FileCache
+ * @param budget maximum total size of cached small files in bytes, 0 disables caching of small files
+ * @param metrics counters of server
+ */
+FileCache::FileCache(qint64 budget, Metrics *metrics)
+    : smallFiles(int(qMin<qint64>(budget, std::numeric_limits<int>::max())))
+    , metrics(metrics)
+{
+}
+
+/**
+ * @brief Return content of file, it is loaded if it isn't cached or mapped yet
+ * @param path full path to file on server
+ * @return nullptr if file can't be read
+ */
+QSharedPointer<FileContent> FileCache::acquire(const QString &path)
+{
+    quint64 generation = 0;
+    {
+        QMutexLocker locker(&mutex);
+        QSharedPointer<FileContent> content = find(path);
+        if (content) {
+            metrics->fileCacheHits.ref();
+            return content;
+        }
+        generation = generations.value(path);
+    }
+
+    // file is read without lock, so other workers aren't blocked by disk
+    metrics->fileCacheMisses.ref();
+    QSharedPointer<FileContent> content = load(path);
+    if (!content)
+        return content;
+
+    QMutexLocker locker(&mutex);
+    QSharedPointer<FileContent> loaded = find(path);
+    if (loaded)
+        return loaded;      // another worker was faster, its copy is shared
+    if (generations.value(path) != generation)
+        return content;     // file was replaced while it was being loaded, content may be the old one
+
+    if (content->file) {
+        if (mappedFiles.size() >= SweepThreshold) {
+            for (QHash<QString, QWeakPointer<FileContent>>::iterator it = mappedFiles.begin(); it != mappedFiles.end();) {
+                if (it.value().isNull())
+                    it = mappedFiles.erase(it);
+                else
+                    ++it;
+            }
+        }
+        mappedFiles.insert(path, content);
+    } else if (content->size <= smallFiles.maxCost()) {
+        smallFiles.insert(path, new QSharedPointer<FileContent>(content), int(content->size));
+    }
+    updateMetrics();
+
+    return content;
+}
+
+/**
+ * @brief Forget content of file, that was replaced
+ * @param path full path to file on server
+ */
+void FileCache::invalidate(const QString &path)
+{
+    QMutexLocker locker(&mutex);
+    ++generations[path];
+    smallFiles.remove(path);
+    mappedFiles.remove(path);
+    updateMetrics();
+}
+
+/**
+ * @brief Read small file or map large file
+ * @param path
+ * @return nullptr if file can't be read
+ */
+QSharedPointer<FileContent> FileCache::load(const QString &path) const
+{
+    QScopedPointer<QFile> file(new QFile(path));
+    if (!file->open(QIODevice::ReadOnly))
+        return QSharedPointer<FileContent>();
+
+    QSharedPointer<FileContent> content(new FileContent);
+    content->size = file->size();
+    if (content->size >= MapThreshold) {
+        uchar *mapped = file->map(0, content->size);
+        if (mapped) {
+            content->data = reinterpret_cast<const char *>(mapped);
+            content->file = file.take();
+            return content;
+        }
+        // file can't be mapped, it is read as small one
+    }
+
+    content->bytes = file->readAll();
+    if (content->bytes.size() != content->size)
+        return QSharedPointer<FileContent>();
+    content->data = content->bytes.constData();
+    return content;
+}
+
+/**
+ * @brief Find content of file among cached and mapped ones, must be called under lock
+ * @param path
+ * @return nullptr if content isn't loaded
+ */
+QSharedPointer<FileContent> FileCache::find(const QString &path)
+{
+    QSharedPointer<FileContent> *cached = smallFiles.object(path);     // moves file to the front of LRU
+    if (cached)
+        return *cached;
+
+    QHash<QString, QWeakPointer<FileContent>>::iterator it = mappedFiles.find(path);
+    if (it == mappedFiles.end())
+        return QSharedPointer<FileContent>();
+
+    QSharedPointer<FileContent> content = it.value().toStrongRef();
+    if (!content)
+        mappedFiles.erase(it);  // the last download has released mapping
+    return content;
+}
+
+/**
+ * @brief Publish size of cache, must be called under lock
+ */
+void FileCache::updateMetrics()
+{
+    metrics->fileCacheBytes.storeRelease(quint64(smallFiles.totalCost()));
+    metrics->fileCacheMappedFiles.storeRelease(quint64(mappedFiles.size()));
+}
@@ -0,0 +1,63 @@
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QFile>
+#include <QMutex>
+#include <QCache>
+#include <QHash>
+#include <QSharedPointer>
+#include <QWeakPointer>
+
+class Metrics;
+
+/**
+ * @brief Content of file, that is shared by all downloads of it
+ *
+ * @details Small file is read into bytes, large file is mapped into memory. Mapping is released,
+ * when the last download of file drops its reference.
+ */
+struct FileContent
+{
+    ~FileContent();
+
+    const char *data = nullptr;     ///< the first byte of content
+    qint64 size = 0;                ///< size of content in bytes
+    QByteArray bytes;               ///< content of small file
+    QFile *file = nullptr;          ///< opened large file, that is mapped at data
+};
+
+/**
+ * @brief Contents of saved files, that are being downloaded, shared by all workers
+ *
+ * @details Small files are kept in LRU cache, which total size is limited by budget, so popular files
+ * aren't read from disk again. Large files are mapped and shared as long as any download uses them.
+ * Concurrent downloads of the same file share one copy of its content.
+ *
+ * Content of path must be invalidated when file under path is replaced. Downloads, that already have
+ * content, keep sending the old one. Content, that was being loaded while path was invalidated, isn't cached.
+ *
+ * Methods can be called from any thread.
+ */
+class FileCache
+{
+public:
+    FileCache(qint64 budget, Metrics *metrics);
+
+    QSharedPointer<FileContent> acquire(const QString &path);
+    void invalidate(const QString &path);
+
+private:
+    QSharedPointer<FileContent> load(const QString &path) const;
+    QSharedPointer<FileContent> find(const QString &path);
+    void updateMetrics();
+
+    QMutex mutex;                                       ///< guards everything below
+    QCache<QString, QSharedPointer<FileContent>> smallFiles;    ///< path -> content of small file, cost is size of file
+    QHash<QString, QWeakPointer<FileContent>> mappedFiles;      ///< path -> content of large file, while it is used
+    QHash<QString, quint64> generations;                ///< path -> count of its invalidations
+    Metrics *metrics;                                   ///< hits and misses are counted here
+};
+
+#endif // FILECACHE_H
@@ -1,11 +1,95 @@
-#include <QCoreApplication>
-
-#include "server.h"
-
-int main(int argc, char *argv[])
-{
-    QCoreApplication a(argc, argv);
-    Server server(2323);
-
-    return a.exec();
-}
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QThread>
+
+#ifdef Q_OS_LINUX
+#include <signal.h>
+#endif
+
+#include "server.h"
+#include "asynclogger.h"
+#include "protocol.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption workersOption("workers", "Count of threads that handle connections, 0 handles them on the main thread.",
+                                     "count", QString::number(QThread::idealThreadCount()));
+    parser.addOption(workersOption);
+    QCommandLineOption sendfileOption("sendfile", "Send downloaded files with sendfile(2) without copying them into memory (Linux only).");
+    parser.addOption(sendfileOption);
+    QCommandLineOption engineOption("engine", "Network engine of connections: qt uses Qt sockets, epoll uses edge-triggered epoll(7) with own buffers (Linux only).",
+                                    "qt|epoll", "qt");
+    parser.addOption(engineOption);
+    QCommandLineOption dedupOption("dedup", "Store every unique content of saved files once and let clients skip uploading content that is already stored.");
+    parser.addOption(dedupOption);
+    QCommandLineOption noCompressionOption("no-compression", "Send payloads uncompressed even if clients support compression.");
+    parser.addOption(noCompressionOption);
+    QCommandLineOption metricsPortOption("metrics-port", "Serve metrics in Prometheus text format on this port of localhost, 0 disables it.",
+                                         "port", "0");
+    parser.addOption(metricsPortOption);
+    QCommandLineOption partialLifetimeOption("partial-lifetime", "Hours after which interrupted uploads can't be resumed and their received parts are removed.",
+                                             "hours", "24");
+    parser.addOption(partialLifetimeOption);
+    QCommandLineOption broadcastWindowOption("broadcast-window", "Milliseconds, during which changes of table are combined into one update for clients, 0 sends every change at once.",
+                                             "ms", "50");
+    parser.addOption(broadcastWindowOption);
+    QCommandLineOption broadcastBatchOption("broadcast-batch", "Count of changes of table, that are sent to clients before broadcast window ends.",
+                                            "count", "100");
+    parser.addOption(broadcastBatchOption);
+    QCommandLineOption cacheSizeOption("cache-size", "Megabytes of small downloaded files kept in memory, 0 reads them from disk every time. Large files are mapped.",
+                                       "megabytes", "256");
+    parser.addOption(cacheSizeOption);
+    QCommandLineOption maxFrameSizeOption("max-frame-size", "Megabytes of payload of one frame, connection that sends bigger frame is closed.",
+                                          "megabytes", "16");
+    parser.addOption(maxFrameSizeOption);
+    QCommandLineOption maxTransfersOption("max-transfers", "Files, that one connection may have queued for download at once, the rest fail.",
+                                          "count", "1024");
+    parser.addOption(maxTransfersOption);
+    QCommandLineOption maxBacklogOption("max-backlog", "Megabytes of unsent data of one connection, after which it is disconnected as slow consumer.",
+                                        "megabytes", "64");
+    parser.addOption(maxBacklogOption);
+    QCommandLineOption memoryBudgetOption("memory-budget", "Megabytes of buffers of all connections, after which new connections are refused and requests of connections with backlog are postponed.",
+                                          "megabytes", "1024");
+    parser.addOption(memoryBudgetOption);
+    QCommandLineOption logRateOption("log-rate", "Debug and info messages written per second, the rest are counted and dropped, 0 writes all of them.",
+                                     "count", "1000");
+    parser.addOption(logRateOption);
+    parser.process(a);
+
+    ServerOptions options;
+    options.workerCount = parser.value(workersOption).toInt();
+    options.zeroCopy = parser.isSet(sendfileOption);
+    options.epoll = parser.value(engineOption) == "epoll";
+    options.deduplicate = parser.isSet(dedupOption);
+    options.compression = !parser.isSet(noCompressionOption);
+    options.metricsPort = parser.value(metricsPortOption).toInt();
+    options.partialLifetime = parser.value(partialLifetimeOption).toInt();
+    options.broadcastWindow = parser.value(broadcastWindowOption).toInt();
+    options.broadcastBatch = qMax(parser.value(broadcastBatchOption).toInt(), 1);
+    options.cacheSize = qMax(parser.value(cacheSizeOption).toInt(), 0);
+    options.maxFrameSize = qBound(1, parser.value(maxFrameSizeOption).toInt(), int(Protocol::MaxPayloadSize / (1024 * 1024)));
+    options.maxTransfers = qMax(parser.value(maxTransfersOption).toInt(), 1);
+    options.maxBacklog = qMax(parser.value(maxBacklogOption).toInt(), 1);
+    options.memoryBudget = qMax(parser.value(memoryBudgetOption).toInt(), 1);
+    AsyncLogger::instance()->setRateLimit(parser.value(logRateOption).toInt());
+
+#ifdef Q_OS_LINUX
+    // sendfile(2) can't be told to not raise SIGPIPE when client has gone
+    if (options.zeroCopy)
+        signal(SIGPIPE, SIG_IGN);
+#endif
+
+    int exitCode;
+    {
+        Server server(2323, options);
+        exitCode = a.exec();
+    }
+
+    // write messages, that are still buffered
+    AsyncLogger::instance()->stop();
+    return exitCode;
+}
@@ -0,0 +1,172 @@
+#include "metrics.h"
+
+#include <QtAlgorithms>
+#include <QDateTime>
+#include <QFile>
+
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
+/**
+ * @brief Count value in its bucket
+ * @param value
+ */
+void Histogram::record(quint64 value)
+{
+    // the smallest i with value <= 2^i
+    int bucket = value <= 1 ? 0 : 64 - int(qCountLeadingZeroBits(value - 1));
+    buckets[qMin(bucket, BucketCount - 1)].fetchAndAddRelaxed(1);
+    sum.fetchAndAddRelaxed(value);
+    count.fetchAndAddRelaxed(1);
+}
+
+/**
+ * @brief Write histogram in Prometheus text exposition format
+ * @param out
+ * @param name name of metric
+ * @param help description of metric
+ */
+void Histogram::write(QTextStream &out, const QString &name, const QString &help) const
+{
+    out << "# HELP " << name << " " << help << "\n";
+    out << "# TYPE " << name << " histogram\n";
+
+    quint64 cumulative = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        cumulative += buckets[i].loadAcquire();
+        QString bound = i == BucketCount - 1 ? QString("+Inf") : QString::number(quint64(1) << i);
+        out << name << "_bucket{le=\"" << bound << "\"} " << cumulative << "\n";
+    }
+    out << name << "_sum " << sum.loadAcquire() << "\n";
+    out << name << "_count " << count.loadAcquire() << "\n";
+}
+
+/**
+ * @brief Start counting of new connection
+ * @param descriptor socket descriptor of connection
+ * @param peer address and port of client
+ * @return counters, that are updated by worker of connection
+ */
+QSharedPointer<ConnectionMetrics> Metrics::addConnection(qintptr descriptor, const QString &peer)
+{
+    QSharedPointer<ConnectionMetrics> connection(new ConnectionMetrics);
+    connection->descriptor = descriptor;
+    connection->peer = peer;
+    connection->connectedAt = QDateTime::currentMSecsSinceEpoch();
+
+    QMutexLocker locker(&mutex);
+    connections.append(connection);
+    ++connectionsTotal;
+    return connection;
+}
+
+/**
+ * @brief Stop counting of closed connection
+ * @param connection
+ */
+void Metrics::removeConnection(const QSharedPointer<ConnectionMetrics> &connection)
+{
+    QMutexLocker locker(&mutex);
+    connections.removeOne(connection);
+}
+
+/**
+ * @brief Format all metrics in Prometheus text exposition format
+ * @return
+ */
+QByteArray Metrics::exposition()
+{
+    QByteArray text;
+    QTextStream out(&text, QIODevice::WriteOnly);
+
+    {
+        QMutexLocker locker(&mutex);
+
+        out << "# HELP server_connections Connections that are open right now.\n";
+        out << "# TYPE server_connections gauge\n";
+        out << "server_connections " << connections.size() << "\n";
+        out << "# HELP server_connections_total Connections that were accepted since start.\n";
+        out << "# TYPE server_connections_total counter\n";
+        out << "server_connections_total " << connectionsTotal << "\n";
+
+        out << "# HELP server_connection_received_bytes Bytes of frames received from connection.\n";
+        out << "# TYPE server_connection_received_bytes counter\n";
+        for (const QSharedPointer<ConnectionMetrics> &connection : connections)
+            out << "server_connection_received_bytes{sd=\"" << connection->descriptor << "\",peer=\"" << connection->peer << "\"} "
+                << connection->bytesIn.loadAcquire() << "\n";
+        out << "# HELP server_connection_sent_bytes Bytes written to connection.\n";
+        out << "# TYPE server_connection_sent_bytes counter\n";
+        for (const QSharedPointer<ConnectionMetrics> &connection : connections)
+            out << "server_connection_sent_bytes{sd=\"" << connection->descriptor << "\",peer=\"" << connection->peer << "\"} "
+                << connection->bytesOut.loadAcquire() << "\n";
+        out << "# HELP server_connection_backlog_bytes Bytes waiting in write buffer of connection.\n";
+        out << "# TYPE server_connection_backlog_bytes gauge\n";
+        for (const QSharedPointer<ConnectionMetrics> &connection : connections)
+            out << "server_connection_backlog_bytes{sd=\"" << connection->descriptor << "\",peer=\"" << connection->peer << "\"} "
+                << connection->backlog.loadAcquire() << "\n";
+    }
+
+    out << "# HELP server_frames_total Frames that were received.\n";
+    out << "# TYPE server_frames_total counter\n";
+    out << "server_frames_total " << framesIn.loadAcquire() << "\n";
+    out << "# HELP server_bad_frames_total Malformed frames, their connections were closed.\n";
+    out << "# TYPE server_bad_frames_total counter\n";
+    out << "server_bad_frames_total " << badFrames.loadAcquire() << "\n";
+    out << "# HELP server_uploads_total Files that were saved.\n";
+    out << "# TYPE server_uploads_total counter\n";
+    out << "server_uploads_total " << uploads.loadAcquire() << "\n";
+    out << "# HELP server_downloads_total Files that were sent.\n";
+    out << "# TYPE server_downloads_total counter\n";
+    out << "server_downloads_total " << downloads.loadAcquire() << "\n";
+    out << "# HELP server_broadcasts_total Table deltas that were broadcasted by workers.\n";
+    out << "# TYPE server_broadcasts_total counter\n";
+    out << "server_broadcasts_total " << broadcasts.loadAcquire() << "\n";
+    out << "# HELP server_file_cache_hits_total Downloads, that got content of file from cache.\n";
+    out << "# TYPE server_file_cache_hits_total counter\n";
+    out << "server_file_cache_hits_total " << fileCacheHits.loadAcquire() << "\n";
+    out << "# HELP server_file_cache_misses_total Downloads, that had to read or map file.\n";
+    out << "# TYPE server_file_cache_misses_total counter\n";
+    out << "server_file_cache_misses_total " << fileCacheMisses.loadAcquire() << "\n";
+    out << "# HELP server_file_cache_bytes Size of small files kept in cache.\n";
+    out << "# TYPE server_file_cache_bytes gauge\n";
+    out << "server_file_cache_bytes " << fileCacheBytes.loadAcquire() << "\n";
+    out << "# HELP server_file_cache_mapped_files Large files, that are indexed as mapped, including just released ones.\n";
+    out << "# TYPE server_file_cache_mapped_files gauge\n";
+    out << "server_file_cache_mapped_files " << fileCacheMappedFiles.loadAcquire() << "\n";
+    out << "# HELP server_held_bytes Unread and unsent bytes in buffers of all connections.\n";
+    out << "# TYPE server_held_bytes gauge\n";
+    out << "server_held_bytes " << heldBytes.loadAcquire() << "\n";
+    out << "# HELP server_refused_connections_total Connections that were refused, because memory budget was exceeded.\n";
+    out << "# TYPE server_refused_connections_total counter\n";
+    out << "server_refused_connections_total " << refusedConnections.loadAcquire() << "\n";
+    out << "# HELP server_evictions_total Connections that were closed as slow consumers.\n";
+    out << "# TYPE server_evictions_total counter\n";
+    out << "server_evictions_total " << evictions.loadAcquire() << "\n";
+    out << "# HELP server_throttled_reads_total Times when requests of connection were postponed until its backlog drains.\n";
+    out << "# TYPE server_throttled_reads_total counter\n";
+    out << "server_throttled_reads_total " << throttledReads.loadAcquire() << "\n";
+
+    uploadDuration.write(out, "server_upload_duration_microseconds", "Time from the first chunk to the stored file.");
+    downloadDuration.write(out, "server_download_duration_microseconds", "Time from opening of file to its last chunk.");
+    frameParseTime.write(out, "server_frame_parse_microseconds", "Time of parsing one complete frame.");
+    diskWriteLatency.write(out, "server_disk_write_microseconds", "Time of writing one received chunk.");
+    socketBacklog.write(out, "server_socket_backlog_bytes", "Bytes waiting in write buffer of socket after a write.");
+    broadcastFanout.write(out, "server_broadcast_fanout_microseconds", "Time of sending one delta to all clients of a worker.");
+
+#ifdef Q_OS_LINUX
+    // the second field of statm is count of resident pages
+    QFile statm("/proc/self/statm");
+    if (statm.open(QIODevice::ReadOnly)) {
+        QList<QByteArray> fields = statm.readAll().split(' ');
+        if (fields.size() > 1) {
+            out << "# HELP process_resident_memory_bytes Resident memory size in bytes.\n";
+            out << "# TYPE process_resident_memory_bytes gauge\n";
+            out << "process_resident_memory_bytes " << fields[1].toLongLong() * sysconf(_SC_PAGESIZE) << "\n";
+        }
+    }
+#endif
+
+    out.flush();
+    return text;
+}
@@ -0,0 +1,86 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QString>
+#include <QList>
+#include <QMutex>
+#include <QAtomicInteger>
+#include <QSharedPointer>
+#include <QTextStream>
+
+/**
+ * @brief Histogram with power-of-two buckets, that can be updated from any thread without locks
+ *
+ * @details Bucket i counts values up to 2^i, the last bucket counts everything bigger
+ */
+class Histogram
+{
+public:
+    static const int BucketCount = 33;  ///< buckets up to 2^31 and +Inf
+
+    void record(quint64 value);
+    void write(QTextStream &out, const QString &name, const QString &help) const;
+
+private:
+    QAtomicInteger<quint64> buckets[BucketCount];
+    QAtomicInteger<quint64> sum;
+    QAtomicInteger<quint64> count;
+};
+
+/**
+ * @brief Counters of one connection
+ */
+struct ConnectionMetrics
+{
+    qintptr descriptor = -1;            ///< socket descriptor of connection
+    QString peer;                       ///< address and port of client
+    qint64 connectedAt = 0;             ///< time of connect in milliseconds since epoch
+    QAtomicInteger<quint64> bytesIn;    ///< bytes of received frames
+    QAtomicInteger<quint64> bytesOut;   ///< bytes written into socket
+    QAtomicInteger<quint64> backlog;    ///< bytesToWrite of socket at the last write
+};
+
+/**
+ * @brief Counters and histograms of server, that are shared by all workers
+ *
+ * @details Hot paths only do atomic increments, text exposition is formatted on demand
+ * (see Worker::sendStatsToClient and MetricsExporter). Durations are recorded in microseconds.
+ *
+ * Methods can be called from any thread.
+ */
+class Metrics
+{
+public:
+    QSharedPointer<ConnectionMetrics> addConnection(qintptr descriptor, const QString &peer);
+    void removeConnection(const QSharedPointer<ConnectionMetrics> &connection);
+
+    QByteArray exposition();
+
+    QAtomicInteger<quint64> framesIn;       ///< frames that were parsed
+    QAtomicInteger<quint64> badFrames;      ///< malformed frames, their connections were closed
+    QAtomicInteger<quint64> uploads;        ///< files that were saved
+    QAtomicInteger<quint64> downloads;      ///< files that were sent
+    QAtomicInteger<quint64> broadcasts;     ///< table deltas that were broadcasted by workers
+    QAtomicInteger<quint64> fileCacheHits;  ///< downloads, that got content from FileCache
+    QAtomicInteger<quint64> fileCacheMisses;///< downloads, that had to read or map file
+    QAtomicInteger<quint64> fileCacheBytes; ///< size of small files in FileCache
+    QAtomicInteger<quint64> fileCacheMappedFiles;   ///< large files, that are indexed by FileCache as mapped
+    QAtomicInteger<qint64> heldBytes;       ///< unread and unsent bytes in buffers of all connections
+    QAtomicInteger<quint64> refusedConnections; ///< connections that were refused, because memory budget was exceeded
+    QAtomicInteger<quint64> evictions;      ///< connections that were closed as slow consumers
+    QAtomicInteger<quint64> throttledReads; ///< times when requests of connection were postponed until its backlog drains
+
+    Histogram uploadDuration;               ///< from the first chunk to the stored file
+    Histogram downloadDuration;             ///< from opening of file to the last chunk
+    Histogram frameParseTime;               ///< time of Protocol::readFrame for complete frames
+    Histogram diskWriteLatency;             ///< time of writing one received chunk
+    Histogram socketBacklog;                ///< bytesToWrite of sockets sampled after writes, in bytes
+    Histogram broadcastFanout;              ///< time of sending one delta to all clients of a worker
+
+private:
+    QMutex mutex;                                       ///< guards connections
+    QList<QSharedPointer<ConnectionMetrics>> connections; ///< connections of all workers
+    quint64 connectionsTotal = 0;                       ///< connections that were ever accepted
+};
+
+#endif // METRICS_H
@@ -0,0 +1,63 @@
+#include "metricsexporter.h"
+
+#include "metrics.h"
+
+static const int MaxRequestSize = 8 * 1024;     ///< connections with bigger requests are closed
+
+/**
+ * @brief MetricsExporter::MetricsExporter
+ * @param metrics metrics of server
+ * @param parent
+ */
+MetricsExporter::MetricsExporter(Metrics *metrics, QObject *parent)
+    : QTcpServer(parent)
+    , metrics(metrics)
+{
+    connect(this, &QTcpServer::newConnection, this, &MetricsExporter::acceptConnection);
+}
+
+/**
+ * @brief Listen on local port, so metrics aren't exposed to network
+ * @param port
+ * @return false if port can't be listened
+ */
+bool MetricsExporter::start(quint16 port)
+{
+    return listen(QHostAddress::LocalHost, port);
+}
+
+/**
+ * @brief MetricsExporter::acceptConnection
+ */
+void MetricsExporter::acceptConnection()
+{
+    while (QTcpSocket *socket = nextPendingConnection()) {
+        connect(socket, &QTcpSocket::readyRead, this, &MetricsExporter::readRequest);
+        connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+    }
+}
+
+/**
+ * @brief Answer with metrics when the whole request has arrived
+ */
+void MetricsExporter::readRequest()
+{
+    QTcpSocket *socket = qobject_cast<QTcpSocket*>(sender());
+
+    QByteArray request = socket->peek(MaxRequestSize);
+    if (!request.contains("\r\n\r\n")) {
+        if (request.size() >= MaxRequestSize)
+            socket->abort();
+        return;
+    }
+    socket->readAll();
+
+    QByteArray body = metrics->exposition();
+    QByteArray answer = "HTTP/1.0 200 OK\r\n"
+                        "Content-Type: text/plain; version=0.0.4\r\n"
+                        "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                        "Connection: close\r\n\r\n";
+    socket->write(answer);
+    socket->write(body);
+    socket->disconnectFromHost();
+}
@@ -0,0 +1,33 @@
+#ifndef METRICSEXPORTER_H
+#define METRICSEXPORTER_H
+
+#include <QObject>
+
+#include <QTcpServer>
+#include <QTcpSocket>
+
+class Metrics;
+
+/**
+ * @brief Plain HTTP listener on local port, that answers every request with metrics
+ * in Prometheus text exposition format
+ *
+ * @details Requests are read up to the end of headers and aren't parsed, connection is closed after the answer
+ */
+class MetricsExporter : public QTcpServer
+{
+    Q_OBJECT
+public:
+    explicit MetricsExporter(Metrics *metrics, QObject *parent = nullptr);
+
+    bool start(quint16 port);
+
+private slots:
+    void acceptConnection();
+    void readRequest();
+
+private:
+    Metrics *metrics;   ///< metrics of server
+};
+
+#endif // METRICSEXPORTER_H
@@ -0,0 +1,25 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+/**
+ * @brief Settings of server, that are chosen at startup (see main.cpp)
+ */
+struct ServerOptions
+{
+    int workerCount = 0;        ///< count of threads that handle connections, 0 means that connections are handled on the main thread
+    bool zeroCopy = false;      ///< send bodies of downloaded files with sendfile(2), works on Linux only
+    bool epoll = false;         ///< serve connections with EpollEngine instead of Qt sockets, works on Linux only
+    bool deduplicate = false;   ///< store every unique content once in blob store, see BlobStore
+    bool compression = true;    ///< compress payloads for clients that support it, see Protocol::Codec
+    int metricsPort = 0;        ///< local port of Prometheus listener, 0 means that metrics are available only by Protocol::Stats
+    int partialLifetime = 24;   ///< hours after the last write, when interrupted upload can't be resumed anymore, see UploadSessions
+    int broadcastWindow = 50;   ///< milliseconds, during which changes of table are collected into one delta, 0 sends every change at once
+    int broadcastBatch = 100;   ///< count of changes, that sends delta before window ends
+    int cacheSize = 256;        ///< megabytes of small files, that are kept in memory for downloads, see FileCache
+    int maxFrameSize = 16;      ///< megabytes of payload of one frame, connection that sends bigger frame is closed
+    int maxTransfers = 1024;    ///< files, that one connection may have queued for download at once, the rest fail
+    int maxBacklog = 64;        ///< megabytes of unsent data of one connection, after which it is evicted as slow consumer
+    int memoryBudget = 1024;    ///< megabytes of buffers of all connections, after which new connections are refused
+};
+
+#endif // OPTIONS_H
@@ -1,56 +1,75 @@
-#ifndef SERVER_H
-#define SERVER_H
-
-#include <QObject>
-
-#include <QTcpServer>
-#include <QTcpSocket>
-
-/**
- * @brief Simple server without GUI
- */
-class Server : public QObject
-{
-    Q_OBJECT
-public:
-    explicit Server(int port, QObject *parent = nullptr);
-    ~Server();
-
-signals:
-    void newDebugMessage(QString);
-    void newInfoMessage(QString);
-    void newWarningMessage(QString);
-    void newCriticalMessage(QString);
-
-private slots:
-    void newConnection();
-    void appendToSocketList(QTcpSocket* socket);
-
-    void readSocket();
-    void discardSocket();
-    void displayError(QAbstractSocket::SocketError socketError);
-
-    void saveFileOnServer(QTcpSocket *socket, QString header, QByteArray &buffer);
-    void appendSavedFileToTable(QString dateTime, QString fileName);
-
-    QByteArray getTable();
-    void sendTableToClient(QTcpSocket *socket);
-    void sendTableToClients();
-
-    void sendFilesToClient(QTcpSocket *socket, QByteArray &buffer);
-    void sendFileToClient(QDataStream &socketStream, QString fileName);
-
-    void displayDebugMessage(const QString& str);
-    void displayInfoMessage(const QString& str);
-    void displayWarningMessage(const QString& str);
-    void displayCriticalMessage(const QString& str);
-
-private:
-    QTcpServer* server;                 ///<
-    QSet<QTcpSocket*> connection_set;   ///< set of all clients
-    QString dirOfSavedFiles;            ///< full path to dir, where saved files are stored
-    QString pathToTableFile;            ///< full path to file, that consist table of saved files
-
-};
-
-#endif // SERVER_H
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <QObject>
+
+#include <QTcpServer>
+#include <QList>
+#include <QThread>
+#include <QTimer>
+#include <QFuture>
+
+#include "options.h"
+
+class Catalog;
+class BlobStore;
+class UploadSessions;
+class FileCache;
+class Metrics;
+class MetricsExporter;
+class Worker;
+
+/**
+ * @brief Simple server without GUI
+ *
+ * @details Server only accepts connections and hands them to workers (see Worker),
+ * every worker runs in its own thread, so one busy client doesn't stall others
+ */
+class Server : public QTcpServer
+{
+    Q_OBJECT
+public:
+    explicit Server(int port, const ServerOptions &options = ServerOptions(), QObject *parent = nullptr);
+    ~Server();
+
+signals:
+    void newDebugMessage(QString);
+    void newInfoMessage(QString);
+    void newWarningMessage(QString);
+    void newCriticalMessage(QString);
+
+protected:
+    void incomingConnection(qintptr socketDescriptor) override;
+
+private slots:
+    void displayDebugMessage(const QString& str);
+    void displayInfoMessage(const QString& str);
+    void displayWarningMessage(const QString& str);
+    void displayCriticalMessage(const QString& str);
+
+    void expirePartialUploads();
+    void compactCatalog();
+
+private:
+    Worker *nextWorker();
+
+    Catalog *catalog;                   ///< table of saved files shared by all workers
+    BlobStore *blobStore = nullptr;     ///< content-addressed storage shared by all workers, nullptr if it isn't used
+    UploadSessions *sessions = nullptr; ///< partially received uploads shared by all workers
+    FileCache *fileCache = nullptr;     ///< contents of downloaded files shared by all workers
+    Metrics *metrics = nullptr;         ///< counters and histograms shared by all workers
+    MetricsExporter *exporter = nullptr;///< Prometheus listener, nullptr if it isn't used
+    QTimer expiryTimer;                 ///< periodically removes partial files of abandoned uploads
+    qint64 partialLifetime = 0;         ///< lifetime of partial file in milliseconds
+    QTimer compactionTimer;             ///< periodically compacts log of catalog into its snapshot
+    QFuture<void> compaction;           ///< compaction of catalog on thread pool, it is waited for on exit
+    qint64 memoryBudget = 0;            ///< connections are refused while their buffers hold more bytes
+    QList<Worker*> workers;             ///< workers that handle connections
+    QList<QThread*> threads;            ///< threads of workers, empty if connections are handled on the main thread
+    int lastWorker = -1;                ///< index of worker that got the last connection
+    QString dirOfSavedFiles;            ///< full path to dir, where saved files are stored
+    QString pathToCatalog;              ///< full path to files of catalog without extension
+
+};
+
+#endif // SERVER_H
@@ -1,26 +1,52 @@
-QT -= gui
-QT += core network widgets
-
-include (../common/common.pri)
-
-CONFIG += c++11 console
-CONFIG -= app_bundle
-
-# You can make your code fail to compile if it uses deprecated APIs.
-# In order to do so, uncomment the following line.
-#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
-
-SOURCES += \
-        main.cpp \
-        server.cpp
-
-# Default rules for deployment.
-qnx: target.path = /tmp/$${TARGET}/bin
-else: unix:!android: target.path = /opt/$${TARGET}/bin
-!isEmpty(target.path): INSTALLS += target
-
-HEADERS += \
-    server.h
-
-INCLUDEPATH += \
-    $${PWD}/../common
+QT -= gui
+QT += core network widgets concurrent
+
+include (../common/common.pri)
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+# You can make your code fail to compile if it uses deprecated APIs.
+# In order to do so, uncomment the following line.
+#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
+
+SOURCES += \
+        blobstore.cpp \
+        catalog.cpp \
+        catalogfile.cpp \
+        connection.cpp \
+        durability.cpp \
+        filecache.cpp \
+        main.cpp \
+        metrics.cpp \
+        metricsexporter.cpp \
+        server.cpp \
+        uploadsessions.cpp \
+        worker.cpp
+
+linux {
+    SOURCES += epollengine.cpp
+    HEADERS += epollengine.h
+}
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
+
+HEADERS += \
+    blobstore.h \
+    catalog.h \
+    catalogfile.h \
+    connection.h \
+    durability.h \
+    filecache.h \
+    metrics.h \
+    metricsexporter.h \
+    options.h \
+    server.h \
+    uploadsessions.h \
+    worker.h
+
+INCLUDEPATH += \
+    $${PWD}/../common
@@ -0,0 +1,253 @@
+#include "uploadsessions.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+
+/**
+ * @brief UploadSessions::UploadSessions
+ * @param dirOfSavedFiles full path to dir, where saved files are stored
+ */
+UploadSessions::UploadSessions(const QString &dirOfSavedFiles)
+    : dir(dirOfSavedFiles + "/.partial")
+{
+}
+
+/**
+ * @brief Create directory for partial files
+ * @return false if directory can't be created
+ */
+bool UploadSessions::init()
+{
+    return QDir().mkpath(dir);
+}
+
+/**
+ * @brief Directory, where partial files are kept
+ * @return
+ */
+QString UploadSessions::partialDir() const
+{
+    return dir;
+}
+
+/**
+ * @brief Path of partial file of upload
+ * @param hash raw SHA-256 of the whole file
+ * @return
+ */
+QString UploadSessions::pathOf(const QByteArray &hash) const
+{
+    return QString("%1/%2").arg(dir).arg(QString::fromLatin1(hash.toHex()));
+}
+
+/**
+ * @brief Start or resume receiving of upload
+ * @param hash raw SHA-256 of the whole file
+ * @param offset count of bytes that were already received
+ * @return false if upload is being received by another connection right now
+ */
+bool UploadSessions::open(const QByteArray &hash, qint64 &offset)
+{
+    QMutexLocker locker(&mutex);
+
+    if (active.contains(hash))
+        return false;
+
+    active.insert(hash);
+    QFileInfo partial(pathOf(hash));
+    offset = partial.exists() ? partial.size() : 0;
+    return true;
+}
+
+/**
+ * @brief Stop receiving of upload, its partial file is kept if it wasn't removed
+ * @param hash raw SHA-256 of the whole file
+ */
+void UploadSessions::close(const QByteArray &hash)
+{
+    QMutexLocker locker(&mutex);
+    active.remove(hash);
+}
+
+/**
+ * @brief Remove partial files, that weren't written for longer than lifetime
+ *
+ * @details Assembly without active parts is dropped together with its partial file, when none of its parts
+ * was opened or released within lifetime, so abandoned multipart uploads don't keep their files forever
+ *
+ * @param lifetime in milliseconds
+ * @return count of removed files
+ */
+int UploadSessions::expire(qint64 lifetime)
+{
+    QMutexLocker locker(&mutex);
+
+    int count = 0;
+    QDateTime now = QDateTime::currentDateTime();
+    for (QHash<QByteArray, Assembly>::iterator assembly = assemblies.begin(); assembly != assemblies.end();) {
+        bool inactive = now.toMSecsSinceEpoch() - assembly->lastActivity > lifetime;
+        for (const Part &part : assembly->parts)
+            inactive = inactive && !part.active;
+
+        if (!inactive) {
+            ++assembly;
+            continue;
+        }
+        if (QFile::remove(partsPathOf(assembly.key())))
+            ++count;
+        assembly = assemblies.erase(assembly);
+    }
+
+    for (const QFileInfo &partial : QDir(dir).entryInfoList(QDir::Files | QDir::Hidden)) {
+        QByteArray hash = QByteArray::fromHex(partial.baseName().toLatin1());
+        if (active.contains(hash) || assemblies.contains(hash))
+            continue;
+
+        if (partial.lastModified().msecsTo(now) > lifetime && QFile::remove(partial.absoluteFilePath()))
+            ++count;
+    }
+
+    return count;
+}
+
+/**
+ * @brief Path of partial file, that is assembled from parts
+ * @param hash raw SHA-256 of the whole file
+ * @return
+ */
+QString UploadSessions::partsPathOf(const QByteArray &hash) const
+{
+    return pathOf(hash) + ".parts";
+}
+
+/**
+ * @brief Check, whether file is being assembled from parts
+ * @param hash raw SHA-256 of the whole file
+ * @return
+ */
+bool UploadSessions::isAssembling(const QByteArray &hash)
+{
+    QMutexLocker locker(&mutex);
+    return assemblies.contains(hash);
+}
+
+/**
+ * @brief Start or resume receiving of part
+ *
+ * @details Partial file of the whole size is created by the first part. Part must be the same as before
+ * or must not overlap other parts.
+ *
+ * @param hash raw SHA-256 of the whole file
+ * @param part
+ * @param received count of bytes of part, that were already received
+ * @return false if part is being received by another connection, doesn't match other parts or file can't be created
+ */
+bool UploadSessions::openPart(const QByteArray &hash, const Protocol::FilePart &part, qint64 &received)
+{
+    QMutexLocker locker(&mutex);
+
+    QHash<QByteArray, Assembly>::iterator assembly = assemblies.find(hash);
+    if (assembly == assemblies.end()) {
+        QFile file(partsPathOf(hash));
+        if (!file.open(QIODevice::ReadWrite) || !file.resize(part.fileSize))
+            return false;
+        Assembly created;
+        created.fileSize = part.fileSize;
+        assembly = assemblies.insert(hash, created);
+    }
+
+    if (assembly->fileSize != part.fileSize)
+        return false;
+    assembly->lastActivity = QDateTime::currentMSecsSinceEpoch();
+
+    QMap<qint64, Part>::iterator it = assembly->parts.find(part.offset);
+    if (it != assembly->parts.end()) {
+        if (it->length != part.length || it->active || it->done)
+            return false;
+        it->active = true;
+        received = it->received;
+        return true;
+    }
+
+    // neighbours must end before part and start after it
+    QMap<qint64, Part>::iterator next = assembly->parts.lowerBound(part.offset);
+    if (next != assembly->parts.end() && next.key() < part.offset + part.length)
+        return false;
+    if (next != assembly->parts.begin()) {
+        QMap<qint64, Part>::iterator previous = next - 1;
+        if (previous.key() + previous->length > part.offset)
+            return false;
+    }
+
+    Part opened;
+    opened.length = part.length;
+    opened.active = true;
+    assembly->parts.insert(part.offset, opened);
+    received = 0;
+    return true;
+}
+
+/**
+ * @brief Stop receiving of part, that isn't complete, the next attempt continues from received bytes
+ * @param hash raw SHA-256 of the whole file
+ * @param offset position of part in file
+ * @param received count of bytes of part, that were written
+ */
+void UploadSessions::releasePart(const QByteArray &hash, qint64 offset, qint64 received)
+{
+    QMutexLocker locker(&mutex);
+
+    QHash<QByteArray, Assembly>::iterator assembly = assemblies.find(hash);
+    if (assembly == assemblies.end())
+        return;
+
+    assembly->lastActivity = QDateTime::currentMSecsSinceEpoch();
+    QMap<qint64, Part>::iterator it = assembly->parts.find(offset);
+    if (it != assembly->parts.end() && !it->done) {
+        it->active = false;
+        it->received = qBound<qint64>(0, received, it->length);
+    }
+}
+
+/**
+ * @brief Mark part as complete and check, whether parts cover the whole file
+ *
+ * @details Only one caller gets assembled, assembly is forgotten then and its partial file
+ * (see partsPathOf) belongs to that caller
+ *
+ * @param hash raw SHA-256 of the whole file
+ * @param offset position of part in file
+ * @param assembled all parts are complete
+ * @return false if part isn't known
+ */
+bool UploadSessions::completePart(const QByteArray &hash, qint64 offset, bool &assembled)
+{
+    QMutexLocker locker(&mutex);
+
+    assembled = false;
+    QHash<QByteArray, Assembly>::iterator assembly = assemblies.find(hash);
+    if (assembly == assemblies.end())
+        return false;
+
+    QMap<qint64, Part>::iterator it = assembly->parts.find(offset);
+    if (it == assembly->parts.end())
+        return false;
+    it->active = false;
+    it->done = true;
+    it->received = it->length;
+    assembly->lastActivity = QDateTime::currentMSecsSinceEpoch();
+
+    qint64 position = 0;
+    for (QMap<qint64, Part>::const_iterator part = assembly->parts.constBegin(); part != assembly->parts.constEnd(); ++part) {
+        if (part.key() != position || !part->done)
+            return true;
+        position += part->length;
+    }
+
+    assembled = position == assembly->fileSize;
+    if (assembled)
+        assemblies.erase(assembly);
+    return true;
+}
@@ -0,0 +1,73 @@
+#ifndef UPLOADSESSIONS_H
+#define UPLOADSESSIONS_H
+
+#include <QString>
+#include <QByteArray>
+#include <QMutex>
+#include <QSet>
+#include <QHash>
+#include <QMap>
+
+#include "protocol.h"
+
+/**
+ * @brief Partially received uploads, that can be resumed after reconnect
+ *
+ * @details Upload is identified by SHA-256 of the whole file, its received part is kept in
+ * partial directory under that hash until upload is completed or partial file expires.
+ * Only one connection at a time can write into a partial file.
+ *
+ * File, that is uploaded in parts (see Protocol::FilePart), is assembled in its own partial file.
+ * Every part is written by its own connection, received bytes of parts are remembered, so parts
+ * are resumed after reconnect while server is running. File is assembled, when all parts are complete.
+ * Assembly, whose parts weren't opened within lifetime of partial files, is dropped with its partial file.
+ *
+ * Methods can be called from any thread.
+ */
+class UploadSessions
+{
+public:
+    explicit UploadSessions(const QString &dirOfSavedFiles);
+
+    bool init();
+    QString partialDir() const;
+    QString pathOf(const QByteArray &hash) const;
+    bool open(const QByteArray &hash, qint64 &offset);
+    void close(const QByteArray &hash);
+    int expire(qint64 lifetime);
+
+    QString partsPathOf(const QByteArray &hash) const;
+    bool isAssembling(const QByteArray &hash);
+    bool openPart(const QByteArray &hash, const Protocol::FilePart &part, qint64 &received);
+    void releasePart(const QByteArray &hash, qint64 offset, qint64 received);
+    bool completePart(const QByteArray &hash, qint64 offset, bool &assembled);
+
+private:
+    /**
+     * @brief Part of file, that is uploaded in parts
+     */
+    struct Part
+    {
+        qint64 length = 0;      ///< size of part
+        qint64 received = 0;    ///< count of bytes of part, that were written
+        bool active = false;    ///< part is being received right now
+        bool done = false;      ///< all bytes of part were written and synced
+    };
+
+    /**
+     * @brief File, that is being assembled from parts
+     */
+    struct Assembly
+    {
+        qint64 fileSize = 0;        ///< size of the whole file
+        QMap<qint64, Part> parts;   ///< offset -> part, parts don't overlap
+        qint64 lastActivity = 0;    ///< time, when a part was opened, released or completed for the last time, in milliseconds since epoch
+    };
+
+    QString dir;                ///< full path to dir with partial files
+    QMutex mutex;               ///< guards active and assemblies
+    QSet<QByteArray> active;    ///< hashes of uploads that are being received right now
+    QHash<QByteArray, Assembly> assemblies; ///< hash -> file, that is being assembled
+};
+
+#endif // UPLOADSESSIONS_H
@@ -0,0 +1,1608 @@
+#include "worker.h"
+
+#include <QBuffer>
+#include <QFileInfo>
+#include <QTemporaryFile>
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QtConcurrent>
+
+#ifdef Q_OS_LINUX
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#include "logging_categories.h"
+#include "catalog.h"
+#include "blobstore.h"
+#include "uploadsessions.h"
+#include "filecache.h"
+#include "durability.h"
+#include "metrics.h"
+#include "deltasync.h"
+#ifdef Q_OS_LINUX
+#include "epollengine.h"
+#endif
+
+static const qint64 ZeroCopyChunkSize = 1024 * 1024;    ///< size of file data sent in one frame with sendfile(2)
+static const int ZeroCopyChunksPerCall = 16;            ///< count of chunks sent before other sockets are served
+static const qint64 TableBacklogLimit = 1024 * 1024;    ///< unsent bytes of client, after which its deltas are postponed
+static const qint64 ThrottleBacklog = 4 * 1024 * 1024;  ///< unsent bytes of client, after which its requests are postponed
+static const int SlowConsumerInterval = 1000;           ///< milliseconds between checks of slow consumers
+static const int SlowConsumerChecks = 10;               ///< checks, after which client with undrained backlog is closed
+static const int MaxQueuedHashes = 64;                  ///< requests of uploads, that may wait for upload in progress of one connection
+
+/**
+ * @brief Worker::Worker
+ * @param catalog table of saved files shared by all workers
+ * @param blobStore content-addressed storage shared by all workers, nullptr if files are stored under their names
+ * @param sessions partially received uploads shared by all workers
+ * @param fileCache contents of downloaded files shared by all workers
+ * @param metrics counters and histograms shared by all workers
+ * @param dirOfSavedFiles full path to dir, where saved files are stored
+ * @param options settings of server
+ * @param parent
+ */
+Worker::Worker(Catalog *catalog, BlobStore *blobStore, UploadSessions *sessions, FileCache *fileCache, Metrics *metrics, const QString &dirOfSavedFiles, const ServerOptions &options, QObject *parent)
+    : QObject(parent)
+    , catalog(catalog)
+    , blobStore(blobStore)
+    , sessions(sessions)
+    , fileCache(fileCache)
+    , metrics(metrics)
+    , dirOfSavedFiles(dirOfSavedFiles)
+    , options(options)
+    , broadcastTimer(new QTimer(this))
+    , slowConsumerTimer(new QTimer(this))
+{
+    broadcastTimer->setSingleShot(true);
+    connect(broadcastTimer, &QTimer::timeout, this, &Worker::sendTableDeltaToClients);
+    slowConsumerTimer->setInterval(SlowConsumerInterval);
+    connect(slowConsumerTimer, &QTimer::timeout, this, &Worker::checkSlowConsumers);
+    connect(catalog, &Catalog::appended, this, &Worker::tableChanged);
+}
+
+/**
+ * @brief Close all sockets of worker
+ */
+Worker::~Worker()
+{
+    for (Connection* socket : connection_set) {
+        socket->disconnect(this);
+        socket->close();
+    }
+    for (const QSharedPointer<ConnectionMetrics> &connection : connectionMetrics)
+        metrics->removeConnection(connection);
+    for (const Admission &admission : admissions)
+        metrics->heldBytes.fetchAndAddRelaxed(-admission.held);
+
+    for (Upload &upload : uploads)
+        discardUpload(upload, false);
+    for (Download &download : downloads)
+        closeDownload(download);
+}
+
+/**
+ * @brief Count of connections that are handled by worker. Can be called from any thread
+ * @return
+ */
+int Worker::load() const
+{
+    return connectionCount.load();
+}
+
+/**
+ * @brief Create socket for accepted connection in the thread of worker
+ * @param socketDescriptor native descriptor of accepted connection
+ */
+void Worker::addConnection(qintptr socketDescriptor)
+{
+    Connection *socket = nullptr;
+#ifdef Q_OS_LINUX
+    // engine is created on the thread of worker, so its notifier is watched by event loop of worker
+    if (options.epoll && !epollEngine) {
+        epollEngine = new EpollEngine(this);
+        if (!epollEngine->isValid()) {
+            emit newWarningMessage(QString("Can't create epoll instance: %1, Qt sockets are used").arg(epollEngine->errorString()));
+            delete epollEngine;
+            epollEngine = nullptr;
+            options.epoll = false;
+        }
+    }
+    if (epollEngine)
+        socket = new EpollConnection(epollEngine, this);
+#endif
+    if (!socket)
+        socket = new TcpConnection(this);
+    if (!socket->setSocketDescriptor(socketDescriptor)) {
+        emit newWarningMessage(QString("Can't use socket descriptor %1: %2").arg(socketDescriptor).arg(socket->errorString()));
+        delete socket;
+        return;
+    }
+
+    appendToSocketList(socket);
+    // timer is started on the thread of worker
+    if (!slowConsumerTimer->isActive())
+        slowConsumerTimer->start();
+}
+
+/**
+ * @brief Add received socket to the connection set and connect to the signals of the received socket
+ * @param socket received socket
+ */
+void Worker::appendToSocketList(Connection *socket)
+{
+    connection_set.insert(socket);
+    connectionCount.ref();
+    connectionMetrics.insert(socket, metrics->addConnection(socket->socketDescriptor(), socket->peerName()));
+    tableSequences.insert(socket, catalog->lastSequence());
+    admissions.insert(socket, Admission());
+    // socket doesn't buffer more than one frame of the biggest size, the rest waits in the kernel
+    socket->setReadBufferSize(qint64(options.maxFrameSize) * 1024 * 1024 + Protocol::FixedHeaderSize + Protocol::MaxNameSize);
+    connect(socket, &Connection::readyRead, this, &Worker::readSocket);
+    connect(socket, &Connection::disconnected, this, &Worker::discardSocket);
+    connect(socket, &Connection::bytesWritten, this, &Worker::countBytesWritten);
+    connect(socket, &Connection::bytesWritten, this, &Worker::continueDownload);
+    connect(socket, &Connection::errorOccurred, this, &Worker::displayError);
+    emit newInfoMessage(QString("New socket were added at socket descriptor %1").arg(socket->socketDescriptor()));
+}
+
+/**
+ * @brief Read data from socket that ready to read
+ */
+void Worker::readSocket()
+{
+    Connection* socket = qobject_cast<Connection*>(sender());
+    readFrames(socket);
+    accountHeldBytes(socket);
+}
+
+/**
+ * @brief Handle all complete frames, that were received from socket
+ *
+ * @details Frames aren't read while backlog of socket is too large (see isBacklogTooLarge), so client,
+ * that sends requests faster than it reads responses, is throttled. Reading continues in countBytesWritten.
+ * Frames aren't read either while upload of socket waits for its job, reading continues when job has finished (see runUploadJob).
+ *
+ * @param socket
+ */
+void Worker::readFrames(Connection *socket)
+{
+    const quint64 maxPayloadSize = quint64(options.maxFrameSize) * 1024 * 1024;
+
+    // several chunks may arrive within one readyRead, so handle all complete frames
+    forever {
+        if (isBacklogTooLarge(socket, ThrottleBacklog)) {
+            QHash<Connection*, Admission>::iterator it = admissions.find(socket);
+            if (it != admissions.end() && !it->throttled) {
+                it->throttled = true;
+                metrics->throttledReads.ref();
+                emit newDebugMessage(QString("Requests of client sd:%1 are postponed until its backlog of %2 bytes drains")
+                                     .arg(socket->socketDescriptor()).arg(socket->bytesToWrite()));
+            }
+            return;
+        }
+
+        QHash<Connection*, Upload>::const_iterator upload = uploads.constFind(socket);
+        if (upload != uploads.constEnd() && upload->job)
+            return;
+
+        Protocol::FrameHeader header;
+        QByteArray name;
+        QByteArray buffer;
+
+        QElapsedTimer parseTimer;
+        parseTimer.start();
+        Protocol::ReadStatus status = Protocol::readFrame(socket, header, name, buffer, maxPayloadSize);
+        if (status == Protocol::NeedMoreData) {
+            // partial frames are usual under load, so message is built only when debug output is enabled
+            if (socket->bytesAvailable() > 0 && logDebug().isDebugEnabled()) {
+                QString message = QString("%1 :: Waiting for more data to come..").arg(socket->socketDescriptor());
+                emit newDebugMessage(message);
+            }
+            return;
+        } else if (status == Protocol::BadFrame) {
+            metrics->badFrames.ref();
+            emit newWarningMessage(QString("Got malformed or too large frame from sd:%1, connection is closed").arg(socket->socketDescriptor()));
+            socket->abort();
+            return;
+        }
+
+        metrics->frameParseTime.record(quint64(parseTimer.nsecsElapsed() / 1000));
+        metrics->framesIn.ref();
+        connectionMetrics.value(socket)->bytesIn.fetchAndAddRelaxed(quint64(header.frameSize()));
+
+        switch (header.opcode) {
+        case Protocol::Save:
+            saveFileOnServer(socket, header, QString::fromUtf8(name), buffer);
+            break;
+        case Protocol::Table:
+            sendTableToClient(socket, header.requestId);
+            break;
+        case Protocol::HaveHash:
+            checkHashOnServer(socket, header, QString::fromUtf8(name), buffer);
+            break;
+        case Protocol::Patch:
+            patchFileOnServer(socket, header, QString::fromUtf8(name), buffer);
+            break;
+        case Protocol::Load:
+            sendFilesToClient(socket, header.requestId, buffer);
+            break;
+        case Protocol::Hello:
+            negotiateCodec(socket, header, buffer);
+            break;
+        case Protocol::Stats:
+            sendStatsToClient(socket, header.requestId);
+            break;
+        case Protocol::Query:
+            sendQueryResultToClient(socket, header.requestId, buffer);
+            break;
+        default:
+            emit newWarningMessage(QString("Got wrong opcode: %1!").arg(header.opcode));
+            break;
+        }
+    }
+}
+
+/**
+ * @brief Check whether socket has too many unsent bytes to handle its requests
+ *
+ * @details While buffers of all connections exceed memory budget, only clients, that keep up with responses, are served
+ *
+ * @param socket
+ * @param limit unsent bytes, that are allowed within memory budget
+ * @return
+ */
+bool Worker::isBacklogTooLarge(Connection *socket, qint64 limit) const
+{
+    if (metrics->heldBytes.loadAcquire() > qint64(options.memoryBudget) * 1024 * 1024)
+        limit = qMin(limit, Protocol::ChunkSize);
+    return socket->bytesToWrite() > limit;
+}
+
+/**
+ * @brief Update bytes, that are held in buffers of socket, in Metrics::heldBytes
+ * @param socket
+ */
+void Worker::accountHeldBytes(Connection *socket)
+{
+    QHash<Connection*, Admission>::iterator it = admissions.find(socket);
+    if (it == admissions.end())
+        return;     // socket was closed while its frames were handled
+
+    qint64 held = socket->bytesAvailable() + socket->bytesToWrite();
+    metrics->heldBytes.fetchAndAddRelaxed(held - it->held);
+    it->held = held;
+}
+
+/**
+ * @brief Close connections, whose backlog exceeds ServerOptions::maxBacklog
+ * or has been larger than ThrottleBacklog without draining for SlowConsumerChecks checks
+ */
+void Worker::checkSlowConsumers()
+{
+    const qint64 maxBacklog = qint64(options.maxBacklog) * 1024 * 1024;
+
+    // closed socket is removed from connection_set, so set is copied
+    const QList<Connection*> sockets = connection_set.values();
+    for (Connection *socket : sockets) {
+        QHash<Connection*, Admission>::iterator it = admissions.find(socket);
+        if (it == admissions.end())
+            continue;
+
+        qint64 backlog = socket->bytesToWrite();
+        if (backlog > ThrottleBacklog && backlog >= it->lastBacklog)
+            ++it->stalledChecks;
+        else
+            it->stalledChecks = 0;
+        it->lastBacklog = backlog;
+        accountHeldBytes(socket);
+
+        if (backlog > maxBacklog || it->stalledChecks >= SlowConsumerChecks) {
+            metrics->evictions.ref();
+            emit newWarningMessage(QString("Client sd:%1 doesn't read its backlog of %2 bytes, connection is closed as slow consumer")
+                                   .arg(socket->socketDescriptor()).arg(backlog));
+            socket->abort();
+        }
+    }
+
+    if (connection_set.isEmpty())
+        slowConsumerTimer->stop();
+}
+
+/**
+ * @brief Remove socket that were disconnected
+ */
+void Worker::discardSocket()
+{
+    Connection* socket = qobject_cast<Connection*>(sender());
+    QSet<Connection*>::iterator it = connection_set.find(socket);
+    if (it != connection_set.end()){
+        emit newInfoMessage(QString("A client has just left the room").arg(socket->socketDescriptor()));
+        connection_set.remove(*it);
+        connectionCount.deref();
+    }
+
+    if (uploads.contains(socket)) {
+        Upload upload = uploads.take(socket);
+        emit newWarningMessage(QString("Upload of file %1 was interrupted after %2 bytes").arg(upload.fileName).arg(upload.received));
+        discardUpload(upload, false);
+    }
+
+    queuedHashes.remove(socket);
+    codecs.remove(socket);
+    tableSequences.remove(socket);
+    laggingTables.remove(socket);
+    metrics->removeConnection(connectionMetrics.take(socket));
+    metrics->heldBytes.fetchAndAddRelaxed(-admissions.take(socket).held);
+
+    if (downloads.contains(socket)) {
+        Download download = downloads.take(socket);
+        if (download.isOpen())
+            emit newWarningMessage(QString("Download of file %1 was interrupted").arg(download.fileName));
+        closeDownload(download);
+    }
+
+    socket->deleteLater();
+}
+
+/**
+ * @brief Display the received error
+ * @param socketError
+ */
+void Worker::displayError(QAbstractSocket::SocketError socketError)
+{
+    switch (socketError) {
+        case QAbstractSocket::RemoteHostClosedError:
+        break;
+        case QAbstractSocket::HostNotFoundError:
+            emit newWarningMessage("The host was not found. Please check the host name and port settings.");
+        break;
+        case QAbstractSocket::ConnectionRefusedError:
+            emit newWarningMessage("The connection was refused by the peer. Make sure QTCPServer is running, and check that the host name and port settings are correct.");
+        break;
+        default:
+            Connection* socket = qobject_cast<Connection*>(sender());
+            emit newWarningMessage(QString("The following error occurred: %1.").arg(socket->errorString()));
+        break;
+    }
+}
+
+/**
+ * @brief Append received chunk of file to the partial file of upload
+ *
+ * @details File is sent as a sequence of Protocol::Save frames, each of them carries at most Protocol::ChunkSize bytes
+ * and its offset in file. Chunks are appended to the partial file, so the whole file is never kept in memory.
+ * When chunk with Protocol::LastChunk flag was received, upload is finished (see finishUpload).
+ *
+ * Upload is usually opened by Protocol::HaveHash frame (see checkHashOnServer), so it can be resumed.
+ * Otherwise it is received into temporary file, that is removed if connection is lost.
+ *
+ * @param socket receiver
+ * @param header header of frame
+ * @param fileName name of file
+ * @param buffer chunk of file data
+ */
+void Worker::saveFileOnServer(Connection *socket, const Protocol::FrameHeader &header, const QString &fileName, const QByteArray &buffer)
+{
+    if (!uploads.contains(socket)) {
+        emit newInfoMessage(QString("You are receiving a file from sd:%1, called %2..").arg(socket->socketDescriptor()).arg(fileName));
+
+        Upload upload;
+        upload.fileName = fileName;
+        upload.requestId = header.requestId;
+        upload.timer.start();
+        // name of file is known only when the whole content was received
+        QTemporaryFile *file = new QTemporaryFile(sessions->partialDir() + "/upload-XXXXXX");
+        file->setAutoRemove(false);
+        upload.file = file;
+        if (blobStore)
+            upload.hash.reset(new QCryptographicHash(QCryptographicHash::Sha256));
+        emit newDebugMessage(QString("Trying to safe received file under path %1..").arg(upload.file->fileName()));
+
+        if (!file->open()) {
+            discardUpload(upload, true);
+            emit newWarningMessage("An error occurred while trying to save the received file!");
+            sendFrame(socket, Protocol::Save, Protocol::LastChunk | Protocol::Failed, header.requestId, fileName.toUtf8(), QByteArray());
+            return;
+        }
+        uploads.insert(socket, upload);
+    }
+
+    Upload &upload = uploads[socket];
+    if (upload.fileName != fileName) {
+        emit newWarningMessage(QString("Got chunk of file %1 while file %2 is being received!").arg(fileName).arg(upload.fileName));
+        return;
+    }
+
+    if (header.offset != quint64(upload.received)) {
+        emit newWarningMessage(QString("Got chunk of file %1 at offset %2, but %3 bytes were received!").arg(fileName).arg(header.offset).arg(upload.received));
+        failUpload(socket);
+        return;
+    }
+
+    if (upload.multipart && upload.received + buffer.size() > upload.partEnd) {
+        emit newWarningMessage(QString("Got chunk of file %1 beyond its part, that ends at %2!").arg(fileName).arg(upload.partEnd));
+        failUpload(socket);
+        return;
+    }
+
+    QElapsedTimer writeTimer;
+    writeTimer.start();
+    bool written = upload.file->write(buffer) == buffer.size();
+    metrics->diskWriteLatency.record(quint64(writeTimer.nsecsElapsed() / 1000));
+    if (!written) {
+        emit newWarningMessage(QString("An error occurred while trying to write the received chunk of file %1!").arg(fileName));
+        failUpload(socket);
+        return;
+    }
+    if (upload.hash)
+        upload.hash->addData(buffer);
+    upload.received += buffer.size();
+
+    if (header.flags & Protocol::LastChunk) {
+        if (upload.multipart)
+            finishPart(socket);
+        else
+            finishUpload(socket);
+    }
+}
+
+/**
+ * @brief Answer if content with given hash is already stored, so client can skip sending it,
+ * otherwise open upload of that content
+ *
+ * @details If blob exists, file is added into table right away as a reference to it.
+ * Otherwise the answer carries count of bytes, that were received by previous attempts of upload
+ * in its offset, and client continues sending from there.
+ * Answer has Protocol::Failed flag if the same content is being received by another connection.
+ * Connection has one upload at a time: client checks hashes of its next files ahead, their requests
+ * wait until upload in progress is closed (see openQueuedUpload), found content is answered right away.
+ *
+ * If client can send difference (Protocol::Delta flag) and file with the same name is stored, new upload
+ * is answered with signatures of blocks of stored file, and client sends Protocol::Patch frames (see patchFileOnServer).
+ * Upload of part of file (Protocol::Multipart flag) is opened by openPart.
+ *
+ * @param socket
+ * @param header header of frame
+ * @param fileName name of file
+ * @param payload raw SHA-256 of file, followed by part of file if upload is multipart
+ */
+void Worker::checkHashOnServer(Connection *socket, const Protocol::FrameHeader &header, const QString &fileName, const QByteArray &payload)
+{
+    QByteArray hash = payload;
+    Protocol::FilePart part;
+    bool multipart = header.flags & Protocol::Multipart;
+    if (multipart && !Protocol::decodePart(payload, hash, part)) {
+        emit newWarningMessage(QString("Got malformed part of file %1 from sd:%2").arg(fileName).arg(socket->socketDescriptor()));
+        sendFrame(socket, Protocol::HaveHash, Protocol::Failed, header.requestId, fileName.toUtf8(), QByteArray());
+        return;
+    }
+
+    bool found = blobStore && hash.size() == Protocol::HashSize && blobStore->contains(hash);
+    // blob may appear while parts are received, then file is still assembled, otherwise parts, that skip upload, never complete it
+    if (found && multipart && part.offset != 0 && sessions->isAssembling(hash))
+        found = false;
+    if (found) {
+        QString blobPath = blobStore->pathOf(hash);
+        emit newInfoMessage(QString("Content of file %1 from sd:%2 is already stored under the path %3, upload is skipped").arg(fileName).arg(socket->socketDescriptor()).arg(blobPath));
+        // every part of file asks for its hash, only the first one adds row
+        bool added = (multipart && part.offset != 0) || catalog->append(fileName, blobPath, QFileInfo(blobPath).size(), hash);
+        sendFrame(socket, Protocol::HaveHash, added ? Protocol::Found : Protocol::Failed, header.requestId, fileName.toUtf8(), QByteArray());
+        return;
+    }
+
+    bool busy = uploads.contains(socket);
+    if (hash.size() != Protocol::HashSize || (busy && queuedHashes.value(socket).size() >= MaxQueuedHashes)) {
+        emit newWarningMessage(QString("Can't open upload of file %1 from sd:%2").arg(fileName).arg(socket->socketDescriptor()));
+        sendFrame(socket, Protocol::HaveHash, Protocol::Failed, header.requestId, fileName.toUtf8(), QByteArray());
+        return;
+    }
+    if (busy) {
+        QueuedHash queued;
+        queued.header = header;
+        queued.fileName = fileName;
+        queued.payload = payload;
+        queuedHashes[socket].append(queued);
+        return;
+    }
+
+    if (multipart) {
+        openPart(socket, header, fileName, hash, part);
+        return;
+    }
+
+    qint64 offset = 0;
+    if (!sessions->open(hash, offset)) {
+        emit newWarningMessage(QString("File %1 from sd:%2 is already being received by another connection").arg(fileName).arg(socket->socketDescriptor()));
+        sendFrame(socket, Protocol::HaveHash, Protocol::Failed, header.requestId, fileName.toUtf8(), QByteArray());
+        return;
+    }
+
+    Upload upload;
+    upload.fileName = fileName;
+    upload.requestId = header.requestId;
+    upload.expectedHash = hash;
+    upload.timer.start();
+    upload.hash.reset(new QCryptographicHash(QCryptographicHash::Sha256));
+    upload.file = new QFile(sessions->pathOf(hash));
+    if (!upload.file->open(QIODevice::ReadWrite)) {
+        emit newWarningMessage(QString("Can't open partial file %1!").arg(upload.file->fileName()));
+        discardUpload(upload, false);
+        sendFrame(socket, Protocol::HaveHash, Protocol::Failed, header.requestId, fileName.toUtf8(), QByteArray());
+        return;
+    }
+
+    upload.received = offset;
+    uploads.insert(socket, upload);
+
+    // resumed upload continues with plain chunks
+    if (offset > 0)
+        resumeUpload(socket);
+    else if (header.flags & Protocol::Delta)
+        offerSignatures(socket);
+    else
+        confirmUpload(socket, QByteArray());
+}
+
+/**
+ * @brief Answer Protocol::HaveHash of opened upload with position, from which client sends file
+ * @param socket
+ * @param signatures encoded signatures of stored file, if file is sent as difference to it
+ */
+void Worker::confirmUpload(Connection *socket, const QByteArray &signatures)
+{
+    const Upload &upload = uploads[socket];
+    if (upload.received > 0)
+        emit newInfoMessage(QString("Upload of file %1 from sd:%2 is resumed from %3 bytes").arg(upload.fileName).arg(socket->socketDescriptor()).arg(upload.received));
+    else if (!signatures.isEmpty())
+        emit newInfoMessage(QString("You are receiving a difference to stored file from sd:%1, called %2..").arg(socket->socketDescriptor()).arg(upload.fileName));
+    else
+        emit newInfoMessage(QString("You are receiving a file from sd:%1, called %2..").arg(socket->socketDescriptor()).arg(upload.fileName));
+
+    quint16 flags = signatures.isEmpty() ? Protocol::NoFlags : Protocol::Delta;
+    sendFrame(socket, Protocol::HaveHash, flags, upload.requestId, upload.fileName.toUtf8(), signatures, quint64(upload.received));
+}
+
+/**
+ * @brief Hash already received part of file on thread pool, then tell client, from where it continues
+ *
+ * @details Hash of the whole file is checked when upload is finished, so received part is hashed again.
+ * Part, that can't be read, is dropped and upload starts from the beginning.
+ *
+ * @param socket
+ */
+void Worker::resumeUpload(Connection *socket)
+{
+    const Upload &upload = uploads[socket];
+    QString path = upload.file->fileName();
+    qint64 size = upload.received;
+    QSharedPointer<QCryptographicHash> hash = upload.hash;
+
+    runUploadJob(socket, [path, size, hash]() {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly))
+            return false;
+        QByteArray chunk;
+        for (qint64 position = 0; position < size; position += chunk.size()) {
+            chunk = file.read(qMin<qint64>(Protocol::ChunkSize * 16, size - position));
+            if (chunk.isEmpty())
+                return false;
+            hash->addData(chunk);
+        }
+        return true;
+    }, [this](Connection *socket, bool hashed) {
+        Upload &upload = uploads[socket];
+        if (!hashed) {
+            emit newWarningMessage(QString("Can't read partial file %1, upload is restarted").arg(upload.file->fileName()));
+            upload.hash->reset();
+            upload.file->resize(0);
+            upload.received = 0;
+        }
+        upload.file->seek(upload.received);
+        confirmUpload(socket, QByteArray());
+    });
+}
+
+/**
+ * @brief Run slow reading or hashing of files of upload on thread pool, so other connections of worker aren't stalled
+ *
+ * @details Upload waits for job: frames of connection aren't read meanwhile, so chunks and patches, that client sends,
+ * are handled in order after job. Job must not touch upload, it gets copies of paths and shared objects.
+ * If upload was closed before job has finished, result is dropped.
+ *
+ * @param socket connection of upload
+ * @param job runs on thread pool, returns false on failure
+ * @param finished runs on thread of worker with result of job, while upload is still open
+ */
+void Worker::runUploadJob(Connection *socket, const std::function<bool()> &job, const std::function<void(Connection*, bool)> &finished)
+{
+    quint64 id = ++lastJob;
+    uploads[socket].job = id;
+
+    QFutureWatcher<bool> *watcher = new QFutureWatcher<bool>(this);
+    connect(watcher, &QFutureWatcher<bool>::finished, this, [this, watcher, socket, id, finished]() {
+        watcher->deleteLater();
+        QHash<Connection*, Upload>::iterator it = uploads.find(socket);
+        if (it != uploads.end() && it->job == id) {
+            it->job = 0;
+            finished(socket, watcher->result());
+        }
+
+        // frames, that arrived meanwhile, weren't read
+        if (connection_set.contains(socket)) {
+            readFrames(socket);
+            accountHeldBytes(socket);
+        }
+    });
+    watcher->setFuture(QtConcurrent::run(job));
+}
+
+/**
+ * @brief Open upload of part of file, answer carries position in file, from which client continues sending part
+ * @param socket
+ * @param header header of Protocol::HaveHash frame
+ * @param fileName name of file
+ * @param hash raw SHA-256 of the whole file
+ * @param part
+ */
+void Worker::openPart(Connection *socket, const Protocol::FrameHeader &header, const QString &fileName, const QByteArray &hash, const Protocol::FilePart &part)
+{
+    qint64 received = 0;
+    if (!sessions->openPart(hash, part, received)) {
+        emit newWarningMessage(QString("Part of file %1 at %2 from sd:%3 is being received by another connection or overlaps other parts")
+                               .arg(fileName).arg(part.offset).arg(socket->socketDescriptor()));
+        sendFrame(socket, Protocol::HaveHash, Protocol::Failed, header.requestId, fileName.toUtf8(), QByteArray());
+        return;
+    }
+
+    Upload upload;
+    upload.fileName = fileName;
+    upload.requestId = header.requestId;
+    upload.expectedHash = hash;
+    upload.multipart = true;
+    upload.partOffset = part.offset;
+    upload.partEnd = part.offset + part.length;
+    upload.received = part.offset + received;
+    upload.timer.start();
+    upload.file = new QFile(sessions->partsPathOf(hash));
+    if (!upload.file->open(QIODevice::ReadWrite) || !upload.file->seek(upload.received)) {
+        emit newWarningMessage(QString("Can't open partial file %1!").arg(upload.file->fileName()));
+        discardUpload(upload, false);
+        sendFrame(socket, Protocol::HaveHash, Protocol::Failed, header.requestId, fileName.toUtf8(), QByteArray());
+        return;
+    }
+    uploads.insert(socket, upload);
+
+    emit newInfoMessage(QString("You are receiving part of file %1 from %2 to %3 from sd:%4, %5 bytes of it were received before")
+                        .arg(fileName).arg(upload.partOffset).arg(upload.partEnd).arg(socket->socketDescriptor()).arg(received));
+    sendFrame(socket, Protocol::HaveHash, Protocol::NoFlags, header.requestId, fileName.toUtf8(), QByteArray(), quint64(upload.received));
+}
+
+/**
+ * @brief Finish completely received part, the part, that completes file, stores file and adds it into table
+ *
+ * @details Part is synced on thread pool (see runUploadJob). If it has completed file, hash of assembled file
+ * is computed and checked against the hash, that was announced by client, and file is stored by the same job.
+ * Client is answered with Protocol::Save frame for every part.
+ *
+ * @param socket
+ */
+void Worker::finishPart(Connection *socket)
+{
+    Upload &upload = uploads[socket];
+    bool flushed = upload.file->flush();
+    upload.file->close();
+
+    QString partialPath = upload.file->fileName();
+    QString fileName = upload.fileName;
+    QByteArray expectedHash = upload.expectedHash;
+    qint64 partOffset = upload.partOffset;
+    UploadSessions *sessions = this->sessions;
+    QSharedPointer<qint64> assembledSize(new qint64(-1));
+    QSharedPointer<QString> filePath(new QString);
+    runUploadJob(socket, [this, flushed, partialPath, fileName, expectedHash, partOffset, sessions, assembledSize, filePath]() {
+        QFile file(partialPath);
+        if (!flushed || !file.open(QIODevice::ReadOnly) || !Durability::syncFile(file)) {
+            emit newWarningMessage(QString("Can't sync received part of file %1 to disk!").arg(fileName));
+            return false;
+        }
+
+        bool assembled = false;
+        if (!sessions->completePart(expectedHash, partOffset, assembled)) {
+            emit newWarningMessage(QString("Part of file %1 at %2 doesn't belong to any upload!").arg(fileName).arg(partOffset));
+            return false;
+        }
+        if (!assembled)
+            return true;
+
+        // the last part owns assembled file, it is removed if it can't be stored
+        QCryptographicHash hash(QCryptographicHash::Sha256);
+        bool verified = file.seek(0) && hash.addData(&file) && hash.result() == expectedHash;
+        qint64 size = file.size();
+        file.close();
+        if (!verified)
+            emit newWarningMessage(QString("Content of assembled file %1 doesn't match its hash!").arg(fileName));
+        if (!verified || !storeFile(partialPath, fileName, size, expectedHash, *filePath)) {
+            QFile::remove(partialPath);
+            return false;
+        }
+        *assembledSize = size;
+        return true;
+    }, [this, assembledSize, filePath](Connection *socket, bool stored) {
+        const Upload &upload = uploads[socket];
+        if (stored && *assembledSize >= 0) {
+            emit newInfoMessage(QString("File from sd:%1 of size: %2 bytes was assembled from parts and stored under the path %3").arg(socket->socketDescriptor()).arg(*assembledSize).arg(*filePath));
+            metrics->uploads.ref();
+            metrics->uploadDuration.record(quint64(upload.timer.nsecsElapsed() / 1000));
+        } else if (stored)
+            emit newDebugMessage(QString("Part of file %1 from %2 to %3 was received from sd:%4").arg(upload.fileName).arg(upload.partOffset).arg(upload.partEnd).arg(socket->socketDescriptor()));
+        answerUpload(socket, stored);
+    });
+}
+
+/**
+ * @brief Answer finished upload or part with Protocol::Save frame and close it
+ * @param socket
+ * @param stored file was stored, or part was received and file was stored if part has completed it
+ */
+void Worker::answerUpload(Connection *socket, bool stored)
+{
+    Upload upload = uploads.take(socket);
+    quint16 flags = Protocol::LastChunk | (stored ? Protocol::NoFlags : Protocol::Failed);
+    sendFrame(socket, Protocol::Save, flags, upload.requestId, upload.fileName.toUtf8(), QByteArray(), quint64(upload.received));
+
+    // upload or part, that wasn't stored, is received again from its beginning
+    discardUpload(upload, !stored);
+    openQueuedUpload(socket);
+}
+
+/**
+ * @brief Handle requests of uploads, that came while the previous upload of connection was in progress
+ * @param socket
+ */
+void Worker::openQueuedUpload(Connection *socket)
+{
+    while (!uploads.contains(socket)) {
+        QHash<Connection*, QList<QueuedHash>>::iterator it = queuedHashes.find(socket);
+        if (it == queuedHashes.end())
+            return;
+        if (it->isEmpty()) {
+            queuedHashes.erase(it);
+            return;
+        }
+
+        QueuedHash queued = it->takeFirst();
+        checkHashOnServer(socket, queued.header, queued.fileName, queued.payload);
+    }
+}
+
+/**
+ * @brief Compute signatures of blocks of stored file with the same name as upload on thread pool and send them to client
+ *
+ * @details Files smaller than DeltaSync::MinFileSize and signatures, that don't fit into one frame, aren't offered,
+ * file is sent as a whole then. Stored file is opened again for patches, when signatures are ready, if it was replaced
+ * by a file of other size meanwhile, it is sent as a whole too, replacement of the same size is caught by hash of the whole file.
+ *
+ * @param socket
+ */
+void Worker::offerSignatures(Connection *socket)
+{
+    CatalogEntry entry;
+    if (!catalog->find(uploads[socket].fileName, entry) || entry.size < DeltaSync::MinFileSize) {
+        confirmUpload(socket, QByteArray());
+        return;
+    }
+
+    QString path = entry.path;
+    QSharedPointer<DeltaSync::Signatures> signatures(new DeltaSync::Signatures);
+    runUploadJob(socket, [path, signatures]() {
+        QFile base(path);
+        return base.open(QIODevice::ReadOnly) && DeltaSync::computeSignatures(&base, *signatures);
+    }, [this, path, signatures](Connection *socket, bool computed) {
+        Upload &upload = uploads[socket];
+        QByteArray payload;
+        QFile *base = new QFile(path);
+        if (!computed || !base->open(QIODevice::ReadOnly) || base->size() != signatures->fileSize) {
+            emit newWarningMessage(QString("Can't read stored file %1, it is received as a whole").arg(path));
+        } else {
+            payload = DeltaSync::encodeSignatures(*signatures);
+            if (quint64(payload.size()) > quint64(options.maxFrameSize) * 1024 * 1024)
+                payload.clear();
+        }
+
+        if (payload.isEmpty()) {
+            delete base;
+        } else {
+            upload.base.reset(base);
+            upload.blockSize = signatures->blockSize;
+        }
+        confirmUpload(socket, payload);
+    });
+}
+
+/**
+ * @brief Rebuild part of uploaded file from blocks of stored file and literal data
+ *
+ * @details Patch is applied to the partial file of upload like a chunk of Protocol::Save frame,
+ * so hash of the whole file is checked and interrupted upload is resumed as usual. Patch is applied on thread pool
+ * (see runUploadJob), one short copy instruction may copy megabytes of stored file.
+ * When frame with Protocol::LastChunk flag was received, upload is finished (see finishUpload).
+ *
+ * @param socket
+ * @param header header of frame, offset is position of part in file
+ * @param fileName name of file
+ * @param patch instructions, see DeltaSync::applyPatch
+ */
+void Worker::patchFileOnServer(Connection *socket, const Protocol::FrameHeader &header, const QString &fileName, const QByteArray &patch)
+{
+    QHash<Connection*, Upload>::iterator it = uploads.find(socket);
+    if (it == uploads.end() || !it->base) {
+        emit newWarningMessage(QString("Got difference of file %1 from sd:%2, but signatures weren't sent").arg(fileName).arg(socket->socketDescriptor()));
+        sendFrame(socket, Protocol::Save, Protocol::LastChunk | Protocol::Failed, header.requestId, fileName.toUtf8(), QByteArray());
+        return;
+    }
+
+    Upload &upload = *it;
+    if (upload.fileName != fileName) {
+        emit newWarningMessage(QString("Got difference of file %1 while file %2 is being received!").arg(fileName).arg(upload.fileName));
+        return;
+    }
+
+    if (header.offset != quint64(upload.received)) {
+        emit newWarningMessage(QString("Got difference of file %1 at offset %2, but %3 bytes were received!").arg(fileName).arg(header.offset).arg(upload.received));
+        failUpload(socket);
+        return;
+    }
+
+    // patch copies up to megabytes of stored file, so it is applied on thread pool to partial file opened by job
+    if (!upload.file->flush()) {
+        emit newWarningMessage(QString("An error occurred while trying to write the received difference of file %1!").arg(fileName));
+        failUpload(socket);
+        return;
+    }
+    QString path = upload.file->fileName();
+    qint64 offset = upload.received;
+    QSharedPointer<QFile> base = upload.base;
+    qint32 blockSize = upload.blockSize;
+    QSharedPointer<QCryptographicHash> hash = upload.hash;
+    QSharedPointer<qint64> written(new qint64(0));
+    Metrics *metrics = this->metrics;
+    bool last = header.flags & Protocol::LastChunk;
+
+    runUploadJob(socket, [patch, path, offset, base, blockSize, hash, written, metrics]() {
+        QFile target(path);
+        if (!target.open(QIODevice::ReadWrite) || !target.seek(offset))
+            return false;
+        QElapsedTimer writeTimer;
+        writeTimer.start();
+        bool applied = DeltaSync::applyPatch(patch, base.data(), blockSize, &target, hash.data(), *written) && target.flush();
+        metrics->diskWriteLatency.record(quint64(writeTimer.nsecsElapsed() / 1000));
+        return applied;
+    }, [this, fileName, written, last](Connection *socket, bool applied) {
+        Upload &upload = uploads[socket];
+        upload.received += *written;
+        if (!applied || !upload.file->seek(upload.received)) {
+            emit newWarningMessage(QString("Can't apply difference of file %1 from sd:%2!").arg(fileName).arg(socket->socketDescriptor()));
+            failUpload(socket);
+            return;
+        }
+
+        if (last)
+            finishUpload(socket);
+    });
+}
+
+/**
+ * @brief Store completely received file and add it into table
+ *
+ * @details Content hash of resumable upload is checked against the hash that was announced by client.
+ * Partial file is synced, stored (see storeFile) and its row is committed on thread pool (see runUploadJob),
+ * sync of big file and wait for group commit of catalog would stall other connections of worker.
+ * Client is answered with Protocol::Save frame, that has Protocol::Failed flag if file wasn't stored.
+ *
+ * @param socket
+ */
+void Worker::finishUpload(Connection *socket)
+{
+    Upload &upload = uploads[socket];
+    bool flushed = upload.file->flush();
+    upload.file->close();
+    if (upload.base)
+        upload.base->close();   // stored file may be replaced below
+
+    QByteArray hash;
+    if (upload.hash)
+        hash = upload.hash->result();
+    if (!upload.expectedHash.isEmpty() && hash != upload.expectedHash) {
+        emit newWarningMessage(QString("Content of received file %1 doesn't match its hash!").arg(upload.fileName));
+        answerUpload(socket, false);
+        return;
+    }
+
+    QString partialPath = upload.file->fileName();
+    QString fileName = upload.fileName;
+    qint64 size = upload.received;
+    QSharedPointer<QString> filePath(new QString);
+    runUploadJob(socket, [this, flushed, partialPath, fileName, size, hash, filePath]() {
+        // file is complete on disk before it gets its final name
+        QFile file(partialPath);
+        if (!flushed || !file.open(QIODevice::ReadOnly) || !Durability::syncFile(file)) {
+            emit newWarningMessage(QString("Can't sync received file %1 to disk!").arg(fileName));
+            return false;
+        }
+        file.close();
+        return storeFile(partialPath, fileName, size, hash, *filePath);
+    }, [this, filePath](Connection *socket, bool stored) {
+        if (stored) {
+            const Upload &upload = uploads[socket];
+            emit newInfoMessage(QString("File from sd:%1 of size: %2 bytes successfully stored on disk under the path %3").arg(socket->socketDescriptor()).arg(upload.received).arg(*filePath));
+            metrics->uploads.ref();
+            metrics->uploadDuration.record(quint64(upload.timer.nsecsElapsed() / 1000));
+        }
+        answerUpload(socket, stored);
+    });
+}
+
+/**
+ * @brief Move completely received file to its place and add it into table
+ *
+ * @details If blob store is used, file is moved into blob with its content hash or dropped if such blob already exists,
+ * otherwise it replaces file with the same name in dirOfSavedFiles. Returns only after row of file is synced.
+ * Runs on thread pool, so it touches only objects, that are shared by workers.
+ *
+ * @param partialPath full path to received file
+ * @param fileName name of file as it was sent by client
+ * @param size size of file in bytes
+ * @param hash raw SHA-256 of content, it is needed if blob store is used
+ * @param filePath full path, under which file was stored
+ * @return false if file wasn't stored
+ */
+bool Worker::storeFile(const QString &partialPath, const QString &fileName, qint64 size, const QByteArray &hash, QString &filePath)
+{
+    filePath = dirOfSavedFiles+"/"+fileName;
+    if (blobStore) {
+        if (!blobStore->commit(partialPath, hash, filePath)) {
+            emit newWarningMessage(QString("Can't move received file %1 into blob %2!").arg(fileName).arg(filePath));
+            return false;
+        }
+    } else {
+        bool replaced = Durability::replaceFile(partialPath, filePath);
+        fileCache->invalidate(filePath);    // blobs are never replaced, files under names are
+        if (!replaced) {
+            emit newWarningMessage(QString("Can't move received file %1 to %2!").arg(fileName).arg(filePath));
+            return false;
+        }
+    }
+
+    return catalog->append(fileName, filePath, size, blobStore ? hash : QByteArray());
+}
+
+/**
+ * @brief Drop upload of socket after an error and tell client about it
+ * @param socket
+ */
+void Worker::failUpload(Connection *socket)
+{
+    Upload upload = uploads.take(socket);
+    sendFrame(socket, Protocol::Save, Protocol::LastChunk | Protocol::Failed, upload.requestId, upload.fileName.toUtf8(), QByteArray(), quint64(upload.received));
+    discardUpload(upload, true);
+    openQueuedUpload(socket);
+}
+
+/**
+ * @brief Close file of upload and end its session
+ *
+ * @details Temporary file of upload without session is always removed, partial file of resumable upload
+ * is kept for the next attempt unless removePartial is set
+ *
+ * @param upload
+ * @param removePartial
+ */
+void Worker::discardUpload(Upload &upload, bool removePartial)
+{
+    if (upload.file) {
+        upload.file->close();
+        // partial file of multipart upload is shared by its parts
+        if (!upload.multipart && (removePartial || upload.expectedHash.isEmpty()))
+            upload.file->remove();
+        delete upload.file;
+        upload.file = nullptr;
+    }
+
+    if (upload.multipart) {
+        sessions->releasePart(upload.expectedHash, upload.partOffset, removePartial ? 0 : upload.received - upload.partOffset);
+        upload.expectedHash.clear();
+    } else if (!upload.expectedHash.isEmpty()) {
+        sessions->close(upload.expectedHash);
+        upload.expectedHash.clear();
+    }
+
+    upload.hash.reset();
+    upload.base.reset();
+}
+
+/**
+ * @brief Send all rows of table in one Protocol::Table frame.
+ *
+ * @details Client requests the whole table only on connect or when it has missed a delta.
+ * Table is compressed if client supports it (see negotiateCodec)
+ *
+ * @param socket
+ * @param requestId id of request
+ */
+void Worker::sendTableToClient(Connection *socket, quint32 requestId) {
+    // taken before snapshot, so changes that race with it are sent again and skipped by client
+    tableSequences.insert(socket, catalog->lastSequence());
+    laggingTables.remove(socket);
+
+    if (codecs.value(socket) == Protocol::Zlib) {
+        QByteArray compressed = catalog->compressedSnapshot();
+        if (!compressed.isEmpty()) {
+            sendFrame(socket, Protocol::Table, Protocol::Compressed, requestId, QByteArray(), compressed);
+            return;
+        }
+    }
+
+    QByteArray byteArray = catalog->snapshot();
+    sendFrame(socket, Protocol::Table, Protocol::NoFlags, requestId, QByteArray(), byteArray);
+}
+
+/**
+ * @brief Count change of table and broadcast changes when window ends or enough changes were collected
+ */
+void Worker::tableChanged()
+{
+    ++pendingChanges;
+    if (options.broadcastWindow <= 0 || pendingChanges >= options.broadcastBatch)
+        sendTableDeltaToClients();
+    else if (!broadcastTimer->isActive())
+        broadcastTimer->start(options.broadcastWindow);
+}
+
+/**
+ * @brief Broadcast changes of table to all clients of this worker
+ *
+ * @details Clients that have the same sequence number share one encoded and compressed delta.
+ * Clients with large backlog are skipped and marked as lagging.
+ */
+void Worker::sendTableDeltaToClients() {
+    broadcastTimer->stop();
+    pendingChanges = 0;
+
+    QElapsedTimer timer;
+    timer.start();
+
+    QHash<quint64, TableDelta> deltas;
+    for (Connection *socket : connection_set) {
+        if (socket) {
+            if (socket->isOpen()) {
+                if (socket->bytesToWrite() > TableBacklogLimit)
+                    laggingTables.insert(socket);   // gets all changes at once when it catches up, see countBytesWritten
+                else
+                    sendTableDelta(socket, deltas);
+            } else
+                emit newCriticalMessage(QString("Socket with sd:%1 doesn't seem to be opened!").arg(socket->socketDescriptor()));
+        } else
+            emit newCriticalMessage(QString("One socket in connection_set seems to be closed!"));
+    }
+
+    metrics->broadcasts.ref();
+    metrics->broadcastFanout.record(quint64(timer.nsecsElapsed() / 1000));
+}
+
+/**
+ * @brief Send one page of table, that matches query of client (see Catalog::query)
+ * @param socket
+ * @param requestId id of request
+ * @param buffer payload of Protocol::Query request
+ */
+void Worker::sendQueryResultToClient(Connection *socket, quint32 requestId, const QByteArray &buffer)
+{
+    Protocol::Query query;
+    QByteArray result;
+    if (!Protocol::decodeQuery(buffer, query) || !catalog->query(query, result)) {
+        emit newWarningMessage(QString("Got malformed query from sd:%1").arg(socket->socketDescriptor()));
+        sendFrame(socket, Protocol::Query, Protocol::Failed, requestId, QByteArray(), QByteArray());
+        return;
+    }
+
+    if (codecs.value(socket) == Protocol::Zlib) {
+        QByteArray compressed = Protocol::compressPayload(result.constData(), result.size());
+        if (!compressed.isEmpty()) {
+            sendFrame(socket, Protocol::Query, Protocol::Compressed, requestId, QByteArray(), compressed);
+            return;
+        }
+    }
+    sendFrame(socket, Protocol::Query, Protocol::NoFlags, requestId, QByteArray(), result);
+}
+
+/**
+ * @brief Send all changes of table, that client doesn't have yet, in one delta
+ *
+ * @details If catalog doesn't keep rows since the last change of client anymore, the whole table is sent
+ *
+ * @param socket
+ * @param deltas deltas, that were already encoded during this broadcast, by sequence number of client
+ */
+void Worker::sendTableDelta(Connection *socket, QHash<quint64, TableDelta> &deltas)
+{
+    quint64 since = tableSequences.value(socket);
+    QHash<quint64, TableDelta>::iterator it = deltas.find(since);
+    if (it == deltas.end()) {
+        TableDelta delta;
+        delta.complete = catalog->delta(since, delta.payload, delta.last);
+        it = deltas.insert(since, delta);
+    }
+
+    TableDelta &delta = it.value();
+    if (!delta.complete) {
+        emit newDebugMessage(QString("Client with sd:%1 is too far behind, the whole table is sent").arg(socket->socketDescriptor()));
+        sendTableToClient(socket);
+        return;
+    }
+    if (delta.payload.isEmpty())
+        return;
+
+    tableSequences.insert(socket, delta.last);
+    if (codecs.value(socket) == Protocol::Zlib) {
+        if (!delta.compressedOnce) {
+            delta.compressed = Protocol::compressPayload(delta.payload.constData(), delta.payload.size());
+            delta.compressedOnce = true;
+        }
+        if (!delta.compressed.isEmpty()) {
+            sendFrame(socket, Protocol::TableDelta, Protocol::Compressed, 0, QByteArray(), delta.compressed);
+            return;
+        }
+    }
+    sendFrame(socket, Protocol::TableDelta, Protocol::NoFlags, 0, QByteArray(), delta.payload);
+}
+
+/**
+ * @brief Send metrics of server in Prometheus text exposition format (see Metrics)
+ * @param socket
+ * @param requestId id of request
+ */
+void Worker::sendStatsToClient(Connection *socket, quint32 requestId)
+{
+    sendFrame(socket, Protocol::Stats, Protocol::NoFlags, requestId, QByteArray(), metrics->exposition());
+}
+
+/**
+ * @brief Choose codec of connection from codecs that client supports
+ *
+ * @details Client lists codecs in order of its preference, the first one that server supports is chosen.
+ * Compression can be disabled on server (see ServerOptions::compression), then Protocol::Identity is chosen
+ *
+ * @param socket
+ * @param header header of frame
+ * @param buffer codecs that client supports, one byte per codec
+ */
+void Worker::negotiateCodec(Connection *socket, const Protocol::FrameHeader &header, const QByteArray &buffer)
+{
+    quint8 codec = Protocol::Identity;
+    if (options.compression) {
+        for (char offered : buffer) {
+            if (quint8(offered) == Protocol::Zlib) {
+                codec = Protocol::Zlib;
+                break;
+            }
+        }
+    }
+
+    codecs.insert(socket, codec);
+    emit newDebugMessage(QString("Client sd:%1 uses codec %2").arg(socket->socketDescriptor()).arg(codec));
+
+    QByteArray answer(1, char(codec));
+    sendFrame(socket, Protocol::Hello, Protocol::NoFlags, header.requestId, QByteArray(), answer);
+}
+
+/**
+ * @brief Write frame into socket, that isn't a chunk of download
+ *
+ * @details Raw writes of zero-copy chunk would be mixed with this frame, so it is sent after the chunk
+ *
+ * @param socket
+ * @param opcode
+ * @param flags
+ * @param requestId
+ * @param name
+ * @param payload
+ * @param offset
+ */
+void Worker::sendFrame(Connection *socket, quint8 opcode, quint16 flags, quint32 requestId, const QByteArray &name, const QByteArray &payload, quint64 offset)
+{
+    if (isZeroCopyChunkInProgress(socket)) {
+        QBuffer deferred(&downloads[socket].deferred);
+        deferred.open(QIODevice::WriteOnly | QIODevice::Append);
+        Protocol::writeFrame(&deferred, opcode, flags, requestId, name, payload.constData(), payload.size(), offset);
+        return;
+    }
+
+    Protocol::writeFrame(socket, opcode, flags, requestId, name, payload.constData(), payload.size(), offset);
+}
+
+/**
+ * @brief Send selected files by client to client.
+ *
+ * @details Requested ranges of files are queued and streamed one after another (see sendFileToClient),
+ * every file as its own sequence of chunks that ends with Protocol::LastChunk flag. After the last file of request
+ * Protocol::Load frame with Protocol::BatchDone flag is sent, so client knows that the whole request was handled.
+ * Several requests can be pipelined, they are served in order. Files over ServerOptions::maxTransfers queued files of connection fail at once.
+ *
+ * @param socket
+ * @param requestId id of request
+ * @param buffer encoded ranges of files, see Protocol::encodeRanges
+ */
+void Worker::sendFilesToClient(Connection *socket, quint32 requestId, const QByteArray &buffer)
+{
+    if (socket) {
+        if (socket->isOpen()) {
+            QVector<Protocol::FileRange> ranges;
+            if (!Protocol::decodeRanges(buffer, ranges)) {
+                emit newWarningMessage(QString("Got malformed load request from client sd:%1").arg(socket->socketDescriptor()));
+                return;
+            }
+
+            Download &download = downloads[socket];
+            int queued = download.isOpen() ? 1 : 0;
+            for (const QPair<quint32, Protocol::FileRange> &request : download.pending) {
+                if (!request.second.fileName.isEmpty())
+                    ++queued;
+            }
+
+            int refused = 0;
+            for (const Protocol::FileRange &range : ranges) {
+                // files over the limit of concurrent transfers fail at once instead of growing the queue
+                if (queued >= options.maxTransfers) {
+                    sendFrame(socket, Protocol::Load, Protocol::LastChunk | Protocol::Failed, requestId, range.fileName.toUtf8(), QByteArray());
+                    ++refused;
+                    continue;
+                }
+                emit newDebugMessage(QString("Client sd:%1 requested file %2 from offset %3").arg(socket->socketDescriptor()).arg(range.fileName).arg(range.offset));
+                download.pending.append(qMakePair(requestId, range));
+                ++queued;
+            }
+            if (refused > 0)
+                emit newWarningMessage(QString("Client sd:%1 exceeded limit of %2 queued files, %3 file(s) failed").arg(socket->socketDescriptor()).arg(options.maxTransfers).arg(refused));
+            download.pending.append(qMakePair(requestId, Protocol::FileRange()));  // marks the end of request
+            sendFileToClient(socket);
+        } else
+            emit newCriticalMessage("socket doesn't seem to be opened!");
+    } else
+        emit newCriticalMessage("Not connected!");
+}
+
+/**
+ * @brief Send next chunks of requested files from dirOfSavedFiles to client
+ *
+ * @details Every chunk is sent in Protocol::Load frame with its position in file,
+ * the last chunk of requested range has Protocol::LastChunk flag. Next chunk is read from disk only when the socket's write buffer has drained below Protocol::ChunkSize,
+ * so at most one chunk per connection is kept in memory regardless of file sizes and speed of client.
+ *
+ * @param socket
+ */
+void Worker::sendFileToClient(Connection *socket)
+{
+#ifdef Q_OS_LINUX
+    if (options.zeroCopy) {
+        sendFileToClientZeroCopy(socket);
+        return;
+    }
+#endif
+
+    QHash<Connection*, Download>::iterator it = downloads.find(socket);
+    if (it == downloads.end())
+        return;
+    Download &download = it.value();
+
+    bool compress = codecs.value(socket) == Protocol::Zlib;
+    while (socket->bytesToWrite() < Protocol::ChunkSize) {
+        if (!download.content && !openNextDownload(socket, download)) {
+            downloads.erase(it);
+            return;
+        }
+
+        // chunks are written straight from content, that is shared by all downloads of file
+        qint64 position = download.offset;
+        qint64 size = qMin(Protocol::ChunkSize, download.end - position);
+        const char *chunk = download.content->data + position;
+        download.offset += size;
+
+        // empty range is sent as one empty chunk
+        bool last = size == 0 || position + size >= download.end;
+        quint16 flags = last ? Protocol::LastChunk : Protocol::NoFlags;
+        QByteArray compressed = compress ? Protocol::compressPayload(chunk, size) : QByteArray();
+        if (!compressed.isEmpty())
+            Protocol::writeFrame(socket, Protocol::Load, flags | Protocol::Compressed,
+                                 download.requestId, download.name, compressed.constData(), compressed.size(), quint64(position));
+        else
+            Protocol::writeFrame(socket, Protocol::Load, flags,
+                                 download.requestId, download.name, chunk, size, quint64(position));
+
+        if (last) {
+            metrics->downloads.ref();
+            metrics->downloadDuration.record(quint64(download.timer.nsecsElapsed() / 1000));
+            download.content.reset();
+        }
+    }
+}
+
+/**
+ * @brief Send next chunks of requested files with sendfile(2)
+ *
+ * @details Header of every chunk is sent with send(2) and the body goes straight from page cache to socket,
+ * so file data is never copied into user space. Raw writes can't overtake data buffered by connection,
+ * so a new chunk is started only when the socket's write buffer is empty, and frames that are sent
+ * while chunk is in progress are deferred (see sendTableToClient). When socket is full,
+ * sending continues after QSocketNotifier reports that it is writable again.
+ *
+ * @param socket
+ */
+void Worker::sendFileToClientZeroCopy(Connection *socket)
+{
+#ifdef Q_OS_LINUX
+    QHash<Connection*, Download>::iterator it = downloads.find(socket);
+    if (it == downloads.end())
+        return;
+    Download &download = it.value();
+
+    if (download.descriptor == -1) {
+        download.descriptor = ::dup(int(socket->socketDescriptor()));
+        if (download.descriptor == -1) {
+            emit newWarningMessage(QString("Can't duplicate socket descriptor %1, zero-copy sending is impossible").arg(socket->socketDescriptor()));
+            socket->abort();
+            return;
+        }
+        // Qt watches the original descriptor, so own notifier doesn't clash with it
+        download.notifier = new QSocketNotifier(download.descriptor, QSocketNotifier::Write, this);
+        download.notifier->setEnabled(false);
+        connect(download.notifier, &QSocketNotifier::activated, this, [this, socket]() {
+            downloads[socket].notifier->setEnabled(false);
+            sendFileToClientZeroCopy(socket);
+        });
+    }
+
+    for (int chunks = 0; chunks < ZeroCopyChunksPerCall; ++chunks) {
+        if (download.headerSent == download.header.size() && download.bodyRemaining == 0) {
+            // start a new chunk
+            if (socket->bytesToWrite() > 0)
+                return;     // bytesWritten will call this method again
+
+            if (!download.file) {
+                if (!openNextDownload(socket, download)) {
+                    closeDownload(download);
+                    downloads.erase(it);
+                    return;
+                }
+                if (socket->bytesToWrite() > 0)
+                    return;     // frames of files that can't be sent go first
+            }
+
+            qint64 size = qMin(ZeroCopyChunkSize, download.end - download.offset);
+            download.lastChunk = download.offset + size >= download.end;
+
+            Protocol::FrameHeader header;
+            header.opcode = Protocol::Load;
+            header.flags = download.lastChunk ? Protocol::LastChunk : Protocol::NoFlags;
+            header.requestId = download.requestId;
+            header.offset = quint64(download.offset);
+            header.length = quint64(size);
+            header.nameSize = quint16(download.name.size());
+
+            download.header.resize(Protocol::FixedHeaderSize);
+            Protocol::encodeHeader(header, download.header.data());
+            download.header.append(download.name);
+            download.headerSent = 0;
+            download.bodyRemaining = size;
+        }
+
+        while (download.headerSent < download.header.size()) {
+            ssize_t sent = ::send(download.descriptor, download.header.constData() + download.headerSent,
+                                  size_t(download.header.size() - download.headerSent), MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (sent < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                    download.notifier->setEnabled(true);
+                } else {
+                    emit newWarningMessage(QString("Can't send header of file %1: %2").arg(download.fileName).arg(qt_error_string(errno)));
+                    socket->abort();
+                }
+                return;
+            }
+            download.headerSent += sent;
+            connectionMetrics.value(socket)->bytesOut.fetchAndAddRelaxed(quint64(sent));
+        }
+
+        while (download.bodyRemaining > 0) {
+            off_t offset = off_t(download.offset);
+            ssize_t sent = ::sendfile(download.descriptor, download.file->handle(), &offset, size_t(download.bodyRemaining));
+            if (sent <= 0) {
+                if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+                    download.notifier->setEnabled(true);
+                } else {
+                    // file can't be shorter than announced length, connection is broken
+                    emit newWarningMessage(QString("Can't send file %1: %2").arg(download.fileName).arg(sent < 0 ? qt_error_string(errno) : QString("file was truncated")));
+                    socket->abort();
+                }
+                return;
+            }
+            download.offset += sent;
+            download.bodyRemaining -= sent;
+            connectionMetrics.value(socket)->bytesOut.fetchAndAddRelaxed(quint64(sent));
+        }
+
+        // chunk is completed, so deferred frames can go
+        download.header.clear();
+        download.headerSent = 0;
+        if (!download.deferred.isEmpty()) {
+            socket->write(download.deferred);
+            download.deferred.clear();
+        }
+
+        if (download.lastChunk) {
+            metrics->downloads.ref();
+            metrics->downloadDuration.record(quint64(download.timer.nsecsElapsed() / 1000));
+            download.file->close();
+            delete download.file;
+            download.file = nullptr;
+        }
+    }
+
+    // let other sockets of worker be served, continue on the next iteration of event loop
+    download.notifier->setEnabled(true);
+#else
+    Q_UNUSED(socket)
+#endif
+}
+
+/**
+ * @brief Open the next pending file of download at the start of requested range
+ *
+ * @details Path of file is looked up in catalog, so only files that were completely saved can be loaded.
+ * Client is told about every file, that can't be sent, with empty Protocol::Load frame that has Protocol::Failed flag,
+ * and about the end of every request (see sendFilesToClient)
+ *
+ * @param socket
+ * @param download
+ * @return false if there are no more pending files
+ */
+bool Worker::openNextDownload(Connection *socket, Download &download)
+{
+    while (!download.pending.isEmpty()) {
+        QPair<quint32, Protocol::FileRange> request = download.pending.takeFirst();
+        const Protocol::FileRange &range = request.second;
+        QString fileName = range.fileName;
+
+        if (fileName.isEmpty()) {
+            sendFrame(socket, Protocol::Load, Protocol::BatchDone, request.first, QByteArray(), QByteArray());
+            continue;
+        }
+
+        CatalogEntry entry;
+        if (!catalog->find(fileName, entry)) {
+            emit newWarningMessage(QString("File with name %1 isn't in the table of saved files").arg(fileName));
+            sendFrame(socket, Protocol::Load, Protocol::LastChunk | Protocol::Failed, request.first, fileName.toUtf8(), QByteArray());
+            continue;
+        }
+
+        // sendfile(2) reads page cache by itself, other downloads share content from cache
+        QFile *file = nullptr;
+        QSharedPointer<FileContent> content;
+        if (options.zeroCopy) {
+            file = new QFile(entry.path);
+            if (!file->open(QIODevice::ReadOnly)) {
+                delete file;
+                file = nullptr;
+            }
+        } else
+            content = fileCache->acquire(entry.path);
+
+        if (!file && !content) {
+            emit newWarningMessage(QString("Can't open file %1 to read!").arg(entry.path));
+            sendFrame(socket, Protocol::Load, Protocol::LastChunk | Protocol::Failed, request.first, fileName.toUtf8(), QByteArray());
+            continue;
+        }
+
+        qint64 size = file ? file->size() : content->size;
+        if (range.offset < 0 || range.offset > size) {
+            emit newWarningMessage(QString("Requested offset %1 is out of file %2 of size %3").arg(range.offset).arg(fileName).arg(size));
+            sendFrame(socket, Protocol::Load, Protocol::LastChunk | Protocol::Failed, request.first, fileName.toUtf8(), QByteArray());
+            delete file;
+            continue;
+        }
+
+        download.file = file;
+        download.content = content;
+        download.fileName = fileName;
+        download.name = fileName.toUtf8();
+        download.requestId = request.first;
+        download.offset = range.offset;
+        download.end = range.length < 0 ? size : qMin(size, range.offset + range.length);
+        download.timer.start();
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Close file of download and release resources of zero-copy sending
+ * @param download
+ */
+void Worker::closeDownload(Download &download)
+{
+    download.content.reset();
+    if (download.file) {
+        download.file->close();
+        delete download.file;
+        download.file = nullptr;
+    }
+
+#ifdef Q_OS_LINUX
+    if (download.notifier) {
+        delete download.notifier;
+        download.notifier = nullptr;
+    }
+    if (download.descriptor != -1) {
+        ::close(download.descriptor);
+        download.descriptor = -1;
+    }
+#endif
+}
+
+/**
+ * @brief Check if zero-copy chunk was started but not completed, so nothing else can be written to socket
+ * @param socket
+ * @return
+ */
+bool Worker::isZeroCopyChunkInProgress(Connection *socket) const
+{
+    QHash<Connection*, Download>::const_iterator it = downloads.constFind(socket);
+    if (it == downloads.constEnd())
+        return false;
+
+    return it->headerSent < it->header.size() || it->bodyRemaining > 0;
+}
+
+/**
+ * @brief Count bytes, that were written into socket, and remember its backlog.
+ * Postponed changes of table are sent and postponed requests are read, when backlog has drained
+ * @param bytes
+ */
+void Worker::countBytesWritten(qint64 bytes)
+{
+    Connection* socket = qobject_cast<Connection*>(sender());
+    QSharedPointer<ConnectionMetrics> connection = connectionMetrics.value(socket);
+    if (!connection)
+        return;
+
+    quint64 backlog = quint64(socket->bytesToWrite());
+    connection->bytesOut.fetchAndAddRelaxed(quint64(bytes));
+    connection->backlog.storeRelease(backlog);
+    metrics->socketBacklog.record(backlog);
+
+    // lagging client has caught up, so it gets all changes it has missed at once
+    if (backlog <= quint64(TableBacklogLimit) && laggingTables.remove(socket)) {
+        QHash<quint64, TableDelta> deltas;
+        sendTableDelta(socket, deltas);
+    }
+
+    // throttled client has read enough of responses, so its next requests are handled
+    QHash<Connection*, Admission>::iterator it = admissions.find(socket);
+    if (it != admissions.end() && it->throttled && !isBacklogTooLarge(socket, ThrottleBacklog / 2)) {
+        it->throttled = false;
+        readFrames(socket);
+    }
+    accountHeldBytes(socket);
+}
+
+/**
+ * @brief Continue download of socket, that has just written data
+ */
+void Worker::continueDownload()
+{
+    Connection* socket = qobject_cast<Connection*>(sender());
+    sendFileToClient(socket);
+}
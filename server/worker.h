@@ -0,0 +1,217 @@
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <QObject>
+
+#include <QFile>
+#include <QHash>
+#include <QPair>
+#include <QSet>
+#include <QAtomicInt>
+#include <QSocketNotifier>
+#include <QCryptographicHash>
+#include <QElapsedTimer>
+#include <QSharedPointer>
+#include <QTimer>
+
+#include <functional>
+
+#include "protocol.h"
+#include "options.h"
+#include "connection.h"
+
+class Catalog;
+class BlobStore;
+class UploadSessions;
+class EpollEngine;
+class FileCache;
+struct FileContent;
+class Metrics;
+struct ConnectionMetrics;
+
+/**
+ * @brief File that is being received from client chunk by chunk
+ */
+struct Upload
+{
+    QFile *file = nullptr;                  ///< opened partial file, see UploadSessions
+    QString fileName;                       ///< name of file as it was sent by client
+    quint32 requestId = 0;                  ///< id of request, that opened upload
+    qint64 received = 0;                    ///< count of bytes that were already written
+    QSharedPointer<QCryptographicHash> hash;///< hash of received content, if it is checked or blob store is used, shared with job
+    quint64 job = 0;                        ///< id of job on thread pool, that upload waits for, 0 if there is none
+    QByteArray expectedHash;                ///< hash announced by client, empty if upload can't be resumed
+    QSharedPointer<QFile> base;             ///< stored file with the same name, that Protocol::Patch frames copy blocks from, shared with job
+    qint32 blockSize = 0;                   ///< size of blocks of base, whose signatures were sent to client
+    bool multipart = false;                 ///< only part of file is received, see Protocol::FilePart
+    qint64 partOffset = 0;                  ///< position of the first byte of part in file
+    qint64 partEnd = 0;                     ///< position after the last byte of part in file
+    QElapsedTimer timer;                    ///< started when upload was opened
+};
+
+/**
+ * @brief Protocol::HaveHash request, that waits until upload of its connection is closed
+ */
+struct QueuedHash
+{
+    Protocol::FrameHeader header;           ///< header of request
+    QString fileName;                       ///< name of file
+    QByteArray payload;                     ///< raw SHA-256 of file, followed by part of file if upload is multipart
+};
+
+/**
+ * @brief Files that were requested by client and are being sent to it chunk by chunk
+ */
+struct Download
+{
+    QList<QPair<quint32, Protocol::FileRange>> pending; ///< request ids and ranges of files that are waiting to be sent, range without name ends request
+    QSharedPointer<FileContent> content;    ///< content of file that is being sent, shared with other downloads of it, see FileCache
+    QFile *file = nullptr;                  ///< opened file that is being sent with sendfile(2) instead of content
+    QString fileName;                       ///< name of file that is being sent
+    QByteArray name;                        ///< UTF-8 name of file that is being sent
+    quint32 requestId = 0;                  ///< id of request of file that is being sent
+    qint64 end = 0;                         ///< position after the last byte of requested range
+    QElapsedTimer timer;                    ///< started when file was opened
+
+    qint64 offset = 0;                      ///< position of the next byte of file to send, advanced by both cached and zero-copy sending
+
+    // state of zero-copy sending, see Worker::sendFileToClientZeroCopy
+    QByteArray header;                      ///< encoded header of chunk that is being sent
+    qint64 headerSent = 0;                  ///< count of bytes of header that were already sent
+    qint64 bodyRemaining = 0;               ///< count of bytes of chunk's body that are still to send
+    bool lastChunk = false;                 ///< chunk that is being sent is the last one
+    int descriptor = -1;                    ///< duplicate of socket descriptor, that is used for sendfile
+    QSocketNotifier *notifier = nullptr;    ///< notifies when descriptor is writable again
+    QByteArray deferred;                    ///< frames that were sent to socket while chunk was in progress
+
+    bool isOpen() const { return file || content; }
+};
+
+/**
+ * @brief Delta of table, that is encoded and compressed once for all clients, that have the same sequence number
+ */
+struct TableDelta
+{
+    bool complete = true;                   ///< rows since sequence number of clients are still kept by catalog
+    QByteArray payload;                     ///< payload of Protocol::TableDelta, empty if there are no changes
+    quint64 last = 0;                       ///< sequence number of the last row in payload
+    QByteArray compressed;                  ///< compressed payload, empty if it isn't worth compressing
+    bool compressedOnce = false;            ///< compression was already tried
+};
+
+/**
+ * @brief Limits of one connection, that keep it from making server hold too much memory
+ */
+struct Admission
+{
+    qint64 held = 0;                        ///< unread and unsent bytes of connection, that are counted in Metrics::heldBytes
+    qint64 lastBacklog = 0;                 ///< unsent bytes at the previous check of slow consumers
+    int stalledChecks = 0;                  ///< consecutive checks, at which big backlog hasn't drained
+    bool throttled = false;                 ///< requests aren't read until backlog drains
+};
+
+/**
+ * @brief Handles connections that were handed to it by Server
+ *
+ * @details Every worker lives in its own thread with its own event loop,
+ * so sockets of one worker are never touched from another thread. Sockets are Qt ones (see TcpConnection)
+ * or, if ServerOptions::epoll is set, are served by EpollEngine of worker (see EpollConnection).
+ *
+ * Changes of table are collected during broadcast window and every client gets one combined delta.
+ * Clients, that don't read fast enough, get nothing until their backlog drains and then one delta with all
+ * changes they have missed.
+ *
+ * Connection can't make server hold much memory: frames are limited by ServerOptions::maxFrameSize,
+ * requests aren't read while its backlog is big and it is closed as slow consumer, when backlog exceeds
+ * ServerOptions::maxBacklog or doesn't drain for several seconds.
+ */
+class Worker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit Worker(Catalog *catalog, BlobStore *blobStore, UploadSessions *sessions, FileCache *fileCache, Metrics *metrics, const QString &dirOfSavedFiles, const ServerOptions &options, QObject *parent = nullptr);
+    ~Worker();
+
+    int load() const;
+
+signals:
+    void newDebugMessage(QString);
+    void newInfoMessage(QString);
+    void newWarningMessage(QString);
+    void newCriticalMessage(QString);
+
+public slots:
+    void addConnection(qintptr socketDescriptor);
+
+private slots:
+    void appendToSocketList(Connection* socket);
+
+    void readSocket();
+    void checkSlowConsumers();
+    void discardSocket();
+    void displayError(QAbstractSocket::SocketError socketError);
+
+    void saveFileOnServer(Connection *socket, const Protocol::FrameHeader &header, const QString &fileName, const QByteArray &buffer);
+    void checkHashOnServer(Connection *socket, const Protocol::FrameHeader &header, const QString &fileName, const QByteArray &payload);
+    void patchFileOnServer(Connection *socket, const Protocol::FrameHeader &header, const QString &fileName, const QByteArray &patch);
+
+    void sendTableToClient(Connection *socket, quint32 requestId = 0);
+    void tableChanged();
+    void sendTableDeltaToClients();
+    void sendStatsToClient(Connection *socket, quint32 requestId);
+    void sendQueryResultToClient(Connection *socket, quint32 requestId, const QByteArray &buffer);
+    void negotiateCodec(Connection *socket, const Protocol::FrameHeader &header, const QByteArray &buffer);
+
+    void sendFilesToClient(Connection *socket, quint32 requestId, const QByteArray &buffer);
+    void sendFileToClient(Connection *socket);
+    void sendFileToClientZeroCopy(Connection *socket);
+    void continueDownload();
+    void countBytesWritten(qint64 bytes);
+
+private:
+    void readFrames(Connection *socket);
+    bool isBacklogTooLarge(Connection *socket, qint64 limit) const;
+    void accountHeldBytes(Connection *socket);
+    void sendFrame(Connection *socket, quint8 opcode, quint16 flags, quint32 requestId, const QByteArray &name, const QByteArray &payload, quint64 offset = 0);
+    void finishUpload(Connection *socket);
+    void openPart(Connection *socket, const Protocol::FrameHeader &header, const QString &fileName, const QByteArray &hash, const Protocol::FilePart &part);
+    void finishPart(Connection *socket);
+    void answerUpload(Connection *socket, bool stored);
+    void openQueuedUpload(Connection *socket);
+    bool storeFile(const QString &partialPath, const QString &fileName, qint64 size, const QByteArray &hash, QString &filePath);
+    void failUpload(Connection *socket);
+    void discardUpload(Upload &upload, bool removePartial);
+    void runUploadJob(Connection *socket, const std::function<bool()> &job, const std::function<void(Connection*, bool)> &finished);
+    void resumeUpload(Connection *socket);
+    void offerSignatures(Connection *socket);
+    void confirmUpload(Connection *socket, const QByteArray &signatures);
+    bool openNextDownload(Connection *socket, Download &download);
+    void closeDownload(Download &download);
+    bool isZeroCopyChunkInProgress(Connection *socket) const;
+    void sendTableDelta(Connection *socket, QHash<quint64, TableDelta> &deltas);
+
+    Catalog *catalog;                       ///< table of saved files shared by all workers
+    BlobStore *blobStore;                   ///< content-addressed storage shared by all workers, nullptr if it isn't used
+    UploadSessions *sessions;               ///< partially received uploads shared by all workers
+    FileCache *fileCache;                   ///< contents of downloaded files shared by all workers
+    Metrics *metrics;                       ///< counters and histograms shared by all workers
+    QString dirOfSavedFiles;                ///< full path to dir, where saved files are stored
+    ServerOptions options;                  ///< settings of server
+    QSet<Connection*> connection_set;       ///< set of clients of this worker
+    QAtomicInt connectionCount;             ///< size of connection_set, that can be read from any thread
+    QHash<Connection*, Upload> uploads;     ///< uploads that are in progress
+    QHash<Connection*, QList<QueuedHash>> queuedHashes; ///< requests of uploads, that wait for upload in progress
+    QHash<Connection*, Download> downloads; ///< downloads that are in progress
+    QHash<Connection*, quint8> codecs;      ///< codecs that were negotiated by clients, see Protocol::Codec
+    QHash<Connection*, QSharedPointer<ConnectionMetrics>> connectionMetrics;   ///< counters of connections
+    QHash<Connection*, quint64> tableSequences; ///< sequence number of the last change of table, that was sent to client
+    QSet<Connection*> laggingTables;        ///< clients, whose deltas are postponed until their backlog drains
+    QHash<Connection*, Admission> admissions;   ///< limits of connections
+    EpollEngine *epollEngine = nullptr;     ///< serves sockets, nullptr if they are Qt ones
+    QTimer *broadcastTimer;                 ///< ends broadcast window
+    QTimer *slowConsumerTimer;              ///< periodically closes connections, that don't read what is sent to them
+    int pendingChanges = 0;                 ///< changes of table in current broadcast window
+    quint64 lastJob = 0;                    ///< id of the last job of upload, that was run on thread pool
+};
+
+#endif // WORKER_H